@@ -41,3 +41,14 @@ solution "DXR"
             links {"FallbackLayer"}
         configuration{"Debug"}
             links {"FallbackLayerD"}
+
+    project "Tests"
+        targetname "DXRTests"
+		debugdir ""
+		location ( location_path )
+		language "C++"
+		kind "ConsoleApp"
+		files { "tests/**", "src/threadpool.*", "src/commandlistpool.h", "src/timeline.*", "src/ringallocator.*", "src/cpubvh.*", "src/adaptivesampler.*", "src/dirtyregion.*", "src/resolutioncontroller.*" }
+		includedirs { "include", "src", "tests" }
+        configuration{"linux"}
+            links {"pthread"}
@@ -1,6 +1,37 @@
+#include "tracerate.hlsli"
+
 RaytracingAccelerationStructure Scene : register(t0, space0);
 RWTexture2D<float4> RenderTarget : register(u0);
 
+struct AccumPixel
+{
+    float3 sum;
+    float count;
+    float lumSquaredSum;
+};
+RWStructuredBuffer<AccumPixel> Accumulation : register(u1);
+// largest relative standard error of each tile as float bits, cleared every frame
+RWByteAddressBuffer TileErrors : register(u2);
+// first hit attributes averaged over the samples, read by the cpu denoiser
+struct AuxPixel
+{
+    float3 normal;
+    float depth;
+    float3 albedo;
+};
+RWStructuredBuffer<AuxPixel> Auxiliary : register(u3);
+// non-zero for tiles traced this frame
+ByteAddressBuffer TileMask : register(t1);
+// rays per 2x2 block for the variable trace rate, see tracerate.hlsli
+RWByteAddressBuffer BlockRates : register(u4);
+// procedural spheres as center and radius, one aabb each in the blas so PrimitiveIndex() finds them
+StructuredBuffer<float4> Spheres : register(t2);
+// shadow casters only, for shadow rays so they skip everything else, the same as Scene until the engine enables it
+RaytracingAccelerationStructure ShadowScene : register(t3, space0);
+// InstanceMaskBits in dxshader.h
+#define INSTANCE_MASK_VISIBLE 0x1
+#define INSTANCE_MASK_SHADOW_CASTER 0x2
+
 struct Viewport
 {
     float2 topLeft;
@@ -13,10 +44,29 @@ cbuffer RayGenConstantBuffer : register(b0)
     Viewport stencil;
 }
 
+cbuffer SampleConstants : register(b1)
+{
+    uint sampleIndex;
+    uint tileSize;
+    uint tileCountX;
+    uint resetAccumulation;
+    uint rateMode;
+    uint frameIndex;
+    uint blockCountX;
+    uint blockCount;
+}
+
 typedef BuiltInTriangleIntersectionAttributes MyAttributes;
+struct SphereAttributes
+{
+    float3 normal;
+};
 struct HitData
 {
-    uint index : INDEX;
+    float3 color : COLOR;
+    float depth : DEPTH;
+    float3 normal : NORMAL;
+    float3 albedo : ALBEDO;
 };
 
 bool IsInside(float p, float2 range)
@@ -30,10 +80,45 @@ bool IsInsideViewport(float2 p, Viewport viewport)
         && (p.y >= viewport.topLeft.y && p.y <= viewport.bottomRight.y);
 }
 
+uint Hash(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+// subpixel offset of a sample, sample 0 is the pixel center
+float2 SampleJitter(uint2 pixel, uint index)
+{
+    if (index == 0)
+        return float2(0.5, 0.5);
+    uint seed = Hash(pixel.x ^ Hash(pixel.y ^ Hash(index)));
+    return float2(seed & 0xFFFF, seed >> 16) / 65536.0;
+}
+
+float Luminance(float3 color)
+{
+    return dot(color, float3(0.2126, 0.7152, 0.0722));
+}
+
 [shader("raygeneration")]
 void MyRaygenShader()
 {
-    float2 lerpValues = (float2)DispatchRaysIndex() / DispatchRaysDimensions();
+    uint2 pixel = DispatchRaysIndex().xy;
+    uint2 tile = pixel / tileSize;
+    uint tileIndex = tile.y * tileCountX + tile.x;
+    // converged tiles keep their accumulated result
+    if (TileMask.Load(tileIndex * 4) == 0)
+        return;
+    // skipped pixels keep last frame's sample, the reconstruction pass fills them in
+    uint blockRate = rateMode == TRACE_RATE_VARIABLE ? LoadBlockRate(BlockRates, pixel, blockCountX, blockCount, frameIndex & 1) : 1;
+    if (!IsTraced(pixel, rateMode, frameIndex, blockRate))
+        return;
+
+    float2 lerpValues = ((float2)pixel + SampleJitter(pixel, sampleIndex)) / DispatchRaysDimensions().xy;
 
     // Orthographic projection since we're raytracing in screen space
     float3 rayDir = float3(0.0, 0.0, 1);
@@ -42,6 +127,7 @@ void MyRaygenShader()
         lerp(viewport.topLeft.y, viewport.bottomRight.y, lerpValues.y),
         0.0f);
 
+    HitData payload = { float3(0, 0, 0), 0.0, float3(0, 0, 0), float3(0, 0, 0) };
     if (IsInsideViewport(origin.xy, stencil))
     {
         // Cast rays
@@ -49,25 +135,99 @@ void MyRaygenShader()
             0.0f,
             rayDir,
             10000.0f };
-        HitData payload = { 0 };
-        TraceRay(Scene, RAY_FLAG_CULL_BACK_FACING_TRIANGLES, ~0, 0, 1, 0, myRay, payload);
+        TraceRay(Scene, RAY_FLAG_CULL_BACK_FACING_TRIANGLES, INSTANCE_MASK_VISIBLE, 0, 1, 0, myRay, payload);
     }
     else
     {
         // Render interpolated DispatchRaysIndex outside the stencil window
-        RenderTarget[DispatchRaysIndex()] = float4(0, 1, 0, 1);
+        payload.color = float3(0, 1, 0);
+        payload.albedo = payload.color;
     }
+
+    uint pixelIndex = pixel.y * DispatchRaysDimensions().x + pixel.x;
+    AccumPixel accum = (AccumPixel)0;
+    if (!resetAccumulation)
+        accum = Accumulation[pixelIndex];
+    float luminance = Luminance(payload.color);
+    accum.sum += payload.color;
+    accum.count += 1.0;
+    accum.lumSquaredSum += luminance * luminance;
+    Accumulation[pixelIndex] = accum;
+
+    AuxPixel aux = { payload.normal, payload.depth, payload.albedo };
+    if (!resetAccumulation)
+    {
+        AuxPixel previous = Auxiliary[pixelIndex];
+        float blend = 1.0 / accum.count;
+        aux.normal = lerp(previous.normal, aux.normal, blend);
+        aux.depth = lerp(previous.depth, aux.depth, blend);
+        aux.albedo = lerp(previous.albedo, aux.albedo, blend);
+    }
+    Auxiliary[pixelIndex] = aux;
+
+    float3 mean = accum.sum / accum.count;
+    RenderTarget[pixel] = float4(mean, 1);
+
+    // relative standard error of the mean luminance, positive floats order like their bits
+    float meanLuminance = Luminance(mean);
+    float variance = max(accum.lumSquaredSum / accum.count - meanLuminance * meanLuminance, 0.0);
+    float error = sqrt(variance / accum.count) / max(meanLuminance, 0.01);
+    TileErrors.InterlockedMax(tileIndex * 4, asuint(error));
 }
 
 [shader("closesthit")]
 void MyClosestHitShader(inout HitData payload : SV_RayPayload, in MyAttributes attr : SV_IntersectionAttributes)
 {
     float3 barycentrics = float3(1.0 - attr.barycentrics.x - attr.barycentrics.y, attr.barycentrics.x, attr.barycentrics.y);
-    RenderTarget[DispatchRaysIndex()] = float4(barycentrics, 1);
+    payload.color = barycentrics;
+    payload.albedo = barycentrics;
+    payload.depth = RayTCurrent();
+    // the mesh is a unit sphere around its object space origin, so its normal is the object space hit position,
+    // brought to world space like the analytic spheres' so moved and scaled instances keep their normals
+    float3 objectNormal = ObjectRayOrigin() + ObjectRayDirection() * RayTCurrent();
+    payload.normal = normalize(mul(objectNormal, (float3x3)WorldToObject()));
+}
+
+// analytic ray sphere test in object space, the far root counts when the ray starts inside
+[shader("intersection")]
+void MySphereIntersectionShader()
+{
+    float4 sphere = Spheres[PrimitiveIndex()];
+    float3 direction = ObjectRayDirection();
+    float3 offset = ObjectRayOrigin() - sphere.xyz;
+    float a = dot(direction, direction);
+    float b = dot(offset, direction);
+    float c = dot(offset, offset) - sphere.w * sphere.w;
+    float discriminant = b * b - a * c;
+    if (discriminant < 0.0)
+        return;
+    float root = sqrt(discriminant);
+    float t = (-b - root) / a;
+    if (t < RayTMin())
+        t = (-b + root) / a;
+    if (t < RayTMin() || t > RayTCurrent())
+        return;
+    SphereAttributes attr;
+    attr.normal = (offset + direction * t) / sphere.w;
+    ReportHit(t, 0, attr);
+}
+
+[shader("closesthit")]
+void MySphereClosestHitShader(inout HitData payload : SV_RayPayload, in SphereAttributes attr : SV_IntersectionAttributes)
+{
+    // by the inverse transpose so scaled instances keep perpendicular normals
+    float3 normal = normalize(mul(attr.normal, (float3x3)WorldToObject()));
+    payload.color = normal * 0.5 + 0.5;
+    payload.albedo = payload.color;
+    payload.depth = RayTCurrent();
+    payload.normal = normal;
 }
 
 [shader("miss")]
 void MyMissShader(inout HitData payload : SV_RayPayload)
 {
-    RenderTarget[DispatchRaysIndex()] = float4(1, 0, 0, 1);
+    payload.color = float3(1, 0, 0);
+    payload.albedo = payload.color;
+    // TMax in a miss, so the background is far behind any geometry
+    payload.depth = RayTCurrent();
 }
\ No newline at end of file
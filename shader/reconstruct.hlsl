@@ -0,0 +1,113 @@
+#include "tracerate.hlsli"
+
+RWTexture2D<float4> Output : register(u0);
+
+struct AccumPixel
+{
+    float3 sum;
+    float count;
+    float lumSquaredSum;
+};
+// traced pixels hold this frame's sample, the others still hold the last one traced
+RWStructuredBuffer<AccumPixel> Accumulation : register(u1);
+RWByteAddressBuffer BlockRates : register(u2);
+
+cbuffer ReconstructConstants : register(b0)
+{
+    uint width;
+    uint height;
+    uint rateMode;
+    uint frameIndex;
+    uint blockCountX;
+    uint blockCount;
+    float gradientThreshold;
+    // variable rate only, also set on full rate frames so the first reduced frame has rates to read
+    uint updateRates;
+}
+
+#define GROUP_SIZE 8
+groupshared float s_Luminance[GROUP_SIZE][GROUP_SIZE];
+
+float Luminance(float3 color)
+{
+    return dot(color, float3(0.2126, 0.7152, 0.0722));
+}
+
+float3 LoadColor(uint2 pixel)
+{
+    AccumPixel accum = Accumulation[pixel.y * width + pixel.x];
+    return accum.sum / max(accum.count, 1.0);
+}
+
+bool IsPixelTraced(uint2 pixel, uint rateHalf)
+{
+    uint blockRate = rateMode == TRACE_RATE_VARIABLE ? LoadBlockRate(BlockRates, pixel, blockCountX, blockCount, rateHalf) : 1;
+    return IsTraced(pixel, rateMode, frameIndex, blockRate);
+}
+
+// Fills the pixels the raygen skipped from their history, clamped to the range of the traced pixels around them
+// so stale history can not survive a change. Then picks next frame's rate of every 2x2 block from its luminance gradient.
+[numthreads(GROUP_SIZE, GROUP_SIZE, 1)]
+void main(uint3 id : SV_DispatchThreadID, uint3 groupThread : SV_GroupThreadID)
+{
+    uint2 pixel = id.xy;
+    bool inside = all(pixel < uint2(width, height));
+    uint rateHalf = frameIndex & 1;
+    float3 color = float3(0, 0, 0);
+    bool traced = false;
+    if (inside)
+    {
+        color = LoadColor(pixel);
+        traced = IsPixelTraced(pixel, rateHalf);
+        if (!traced)
+        {
+            float3 low = float3(1e30, 1e30, 1e30);
+            float3 high = -low;
+            bool found = false;
+            for (int y = -1; y <= 1; ++y)
+            {
+                for (int x = -1; x <= 1; ++x)
+                {
+                    int2 neighbour = (int2)pixel + int2(x, y);
+                    if (any(neighbour < 0) || any(neighbour >= int2(width, height)) || !IsPixelTraced((uint2)neighbour, rateHalf))
+                        continue;
+                    float3 c = LoadColor((uint2)neighbour);
+                    low = min(low, c);
+                    high = max(high, c);
+                    found = true;
+                }
+            }
+            if (found)
+                color = clamp(color, low, high);
+        }
+        Output[pixel] = float4(color, 1);
+    }
+
+    uint tracedCount = WaveActiveCountBits(traced);
+    if (WaveIsFirstLane())
+        BlockRates.InterlockedAdd(blockCount * 2 * 4, tracedCount);
+
+    if (!updateRates)
+        return;
+    s_Luminance[groupThread.y][groupThread.x] = Luminance(color);
+    GroupMemoryBarrierWithGroupSync();
+    // one thread per block, groups are whole blocks, the gradient also looks one pixel into the next block
+    if (!inside || any(groupThread.xy & 1))
+        return;
+    float gradient = 0.0;
+    for (uint y = 0; y < 2; ++y)
+    {
+        for (uint x = 0; x < 2; ++x)
+        {
+            uint2 p = groupThread.xy + uint2(x, y);
+            float l = s_Luminance[p.y][p.x];
+            if (p.x + 1 < GROUP_SIZE)
+                gradient = max(gradient, abs(s_Luminance[p.y][p.x + 1] - l));
+            if (p.y + 1 < GROUP_SIZE)
+                gradient = max(gradient, abs(s_Luminance[p.y + 1][p.x] - l));
+        }
+    }
+    uint rate = gradient < gradientThreshold * 0.5 ? 4 : (gradient < gradientThreshold ? 2 : 1);
+    uint2 block = pixel / 2;
+    BlockRates.Store(((1 - rateHalf) * blockCount + block.y * blockCountX + block.x) * 4, rate);
+}
@@ -0,0 +1,33 @@
+// Which pixels get a primary ray this frame, shared by the raygen and the reconstruction pass.
+// Values mirror TraceRate in dxshader.h.
+#define TRACE_RATE_FULL 0
+#define TRACE_RATE_CHECKERBOARD 1
+#define TRACE_RATE_VARIABLE 2
+
+// Variable rate works on 2x2 blocks, each block stores how many pixels share one ray: 1, 2 or 4.
+// The buffer holds two halves of blockCount entries, one read this frame and one written for the next,
+// followed by a counter of the pixels traced.
+uint LoadBlockRate(RWByteAddressBuffer rates, uint2 pixel, uint blockCountX, uint blockCount, uint rateHalf)
+{
+    uint2 block = pixel / 2;
+    return rates.Load((rateHalf * blockCount + block.y * blockCountX + block.x) * 4);
+}
+
+// The traced pixels rotate with the frame index, so every pixel is refreshed at least once per rate frames.
+bool IsTraced(uint2 pixel, uint rateMode, uint frameIndex, uint blockRate)
+{
+    if (rateMode == TRACE_RATE_CHECKERBOARD)
+        return ((pixel.x + pixel.y + frameIndex) & 1) == 0;
+    if (rateMode != TRACE_RATE_VARIABLE)
+        return true;
+    uint2 local = pixel & 1;
+    if (blockRate == 4)
+    {
+        // diagonal first, so two consecutive frames already cover both checkerboard phases
+        static const uint order[4] = { 0, 3, 1, 2 };
+        return local.y * 2 + local.x == order[frameIndex & 3];
+    }
+    if (blockRate == 2)
+        return ((local.x + local.y + frameIndex) & 1) == 0;
+    return true;
+}
@@ -0,0 +1,60 @@
+RWTexture2D<float4> Output : register(u0);
+
+struct AccumPixel
+{
+    float3 sum;
+    float count;
+    float lumSquaredSum;
+};
+struct AuxPixel
+{
+    float3 normal;
+    float depth;
+    float3 albedo;
+};
+// written by the raygen at the trace resolution, rows sourceSize.x pixels long
+RWStructuredBuffer<AccumPixel> Accumulation : register(u1);
+RWStructuredBuffer<AuxPixel> Auxiliary : register(u2);
+
+cbuffer UpsampleConstants : register(b0)
+{
+    uint2 sourceSize;
+    uint2 targetSize;
+}
+
+// Depth aware bilateral upsample: bilinear weights of the four nearest traced pixels,
+// scaled down for taps whose depth or normal differ from the closest one so edges stay sharp.
+[numthreads(8, 8, 1)]
+void main(uint3 id : SV_DispatchThreadID)
+{
+    if (any(id.xy >= targetSize))
+        return;
+    float2 source = ((float2)id.xy + 0.5) * (float2)sourceSize / (float2)targetSize - 0.5;
+    int2 base = (int2)floor(source);
+    float2 f = source - (float2)base;
+
+    int2 nearest = clamp((int2)round(source), int2(0, 0), (int2)sourceSize - 1);
+    AuxPixel reference = Auxiliary[nearest.y * sourceSize.x + nearest.x];
+
+    float3 color = float3(0, 0, 0);
+    float weightSum = 0.0;
+    [unroll]
+    for (int i = 0; i < 4; ++i)
+    {
+        int2 offset = int2(i & 1, i >> 1);
+        int2 tap = clamp(base + offset, int2(0, 0), (int2)sourceSize - 1);
+        uint index = tap.y * sourceSize.x + tap.x;
+        AccumPixel accum = Accumulation[index];
+        AuxPixel aux = Auxiliary[index];
+        float2 bilinear = lerp(1.0 - f, f, (float2)offset);
+        float depthWeight = exp(-abs(aux.depth - reference.depth) / (0.05 * reference.depth + 1e-3));
+        float normalWeight = pow(saturate(dot(aux.normal, reference.normal)), 8.0);
+        // background has no normal, only depth separates it
+        if (dot(reference.normal, reference.normal) < 0.5)
+            normalWeight = 1.0;
+        float weight = bilinear.x * bilinear.y * depthWeight * normalWeight + 1e-5;
+        color += accum.sum / max(accum.count, 1.0) * weight;
+        weightSum += weight;
+    }
+    Output[id.xy] = float4(color / weightSum, 1);
+}
@@ -0,0 +1,66 @@
+#include "adaptivesampler.h"
+#include <string.h>
+
+void AdaptiveSampler::Init(uint32_t width, uint32_t height, uint32_t tileSize, float targetError, uint32_t maxSamples) {
+	m_TileSize = tileSize;
+	m_TilesX = (width + tileSize - 1) / tileSize;
+	m_TilesY = (height + tileSize - 1) / tileSize;
+	m_TargetError = targetError;
+	m_MaxSamples = maxSamples > ADAPTIVE_MIN_SAMPLES ? maxSamples : ADAPTIVE_MIN_SAMPLES;
+	m_Tiles.resize(GetTileCount());
+	m_Mask.resize(GetTileCount());
+	Reset();
+}
+
+void AdaptiveSampler::Reset() {
+	for (auto& tile : m_Tiles)
+		tile = Tile();
+	m_SampleCount = 0;
+	m_Epoch++;
+	m_ActiveTiles = GetTileCount();
+}
+
+const std::vector<uint32_t>& AdaptiveSampler::BeginFrame() {
+	//without a target every frame is a fresh single sample, like before accumulation existed
+	if (!IsEnabled()) {
+		m_Reset = true;
+		m_SampleIndex = 0;
+		m_ActiveTiles = GetTileCount();
+		for (auto& mask : m_Mask)
+			mask = 1;
+		return m_Mask;
+	}
+	m_SampleIndex = m_SampleCount++;
+	m_Reset = m_SampleIndex == 0;
+	m_ActiveTiles = 0;
+	for (uint32_t i = 0; i < GetTileCount(); ++i) {
+		Tile& tile = m_Tiles[i];
+		bool active = tile.samples < ADAPTIVE_MIN_SAMPLES || (tile.error > m_TargetError && tile.samples < m_MaxSamples);
+		m_Mask[i] = active ? 1 : 0;
+		if (active) {
+			tile.samples++;
+			m_ActiveTiles++;
+		}
+	}
+	return m_Mask;
+}
+
+void AdaptiveSampler::ReadErrors(const std::vector<uint32_t>& mask, uint32_t epoch, const uint32_t* tileErrors) {
+	if (!IsEnabled() || epoch != m_Epoch || mask.size() != m_Tiles.size())
+		return;
+	//untraced tiles report nothing, they keep the error they converged with
+	for (uint32_t i = 0; i < GetTileCount(); ++i) {
+		if (!mask[i])
+			continue;
+		memcpy(&m_Tiles[i].error, &tileErrors[i], sizeof(float));
+	}
+}
+
+double AdaptiveSampler::GetAverageSamples() const {
+	if (m_Tiles.empty())
+		return 0.0;
+	uint64_t samples = 0;
+	for (auto& tile : m_Tiles)
+		samples += tile.samples;
+	return (double)samples / (double)m_Tiles.size();
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#define ADAPTIVE_TILE_SIZE 16
+//below this many samples a tile's error estimate is not trusted
+#define ADAPTIVE_MIN_SAMPLES 8
+
+//Decides per screen tile whether it gets another sample.
+//The raygen accumulates samples and writes every traced tile's largest relative standard error,
+//tiles stay active until that error is below the target or they reached the sample cap.
+//Errors arrive frames late, so a tile can get a few samples more than it needed but never fewer.
+class AdaptiveSampler {
+public:
+	AdaptiveSampler(){}
+	~AdaptiveSampler(){}
+
+	//targetError 0 disables adaptive sampling: every tile is traced and nothing accumulates
+	void Init(uint32_t width, uint32_t height, uint32_t tileSize, float targetError, uint32_t maxSamples);
+	//drops the accumulated samples, e.g. after the pipeline changed
+	void Reset();
+	//call once per recorded frame, the mask has one uint per tile, non-zero traces it
+	const std::vector<uint32_t>& BeginFrame();
+	//errors of a completed frame as float bits, mask is the one BeginFrame returned for it
+	void ReadErrors(const std::vector<uint32_t>& mask, uint32_t epoch, const uint32_t* tileErrors);
+
+	bool IsEnabled() const { return m_TargetError > 0.0f; }
+	bool IsConverged() const { return IsEnabled() && m_ActiveTiles == 0; }
+	//the frame last begun is the first after a reset, the raygen then overwrites instead of accumulating
+	bool NeedsReset() const { return m_Reset; }
+	//seeds the frame's jitter, sample 0 is the pixel center
+	uint32_t GetSampleIndex() const { return m_SampleIndex; }
+	//frames recorded before a reset carry an older epoch and are ignored by ReadErrors
+	uint32_t GetEpoch() const { return m_Epoch; }
+	uint32_t GetTileSize() const { return m_TileSize; }
+	uint32_t GetTileCountX() const { return m_TilesX; }
+	uint32_t GetTileCount() const { return m_TilesX * m_TilesY; }
+	uint32_t GetActiveTiles() const { return m_ActiveTiles; }
+	//samples traced per pixel on average, compare with GetSampleIndex() + 1 for the saving over uniform sampling
+	double GetAverageSamples() const;
+private:
+	struct Tile {
+		uint32_t samples = 0;
+		float error = 0.0f;
+	};
+	std::vector<Tile> m_Tiles;
+	std::vector<uint32_t> m_Mask;
+	uint32_t m_TilesX = 0;
+	uint32_t m_TilesY = 0;
+	uint32_t m_TileSize = ADAPTIVE_TILE_SIZE;
+	float m_TargetError = 0.0f;
+	uint32_t m_MaxSamples = 0;
+	uint32_t m_SampleIndex = 0;
+	uint32_t m_SampleCount = 0;
+	uint32_t m_Epoch = 0;
+	uint32_t m_ActiveTiles = 0;
+	bool m_Reset = true;
+};
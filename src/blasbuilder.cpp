@@ -0,0 +1,99 @@
+#include "blasbuilder.h"
+#include <dx/d3dx12.h>
+#include <algorithm>
+
+static inline uint64_t AlignSize(uint64_t size, uint64_t alignment) {
+	return (size + (alignment - 1)) & ~(alignment - 1);
+}
+
+void BLASBuilder::Init(ID3D12RaytracingFallbackDevice* rtDevice, ResourcePool* pool, uint64_t scratchBudget) {
+	m_RTDevice = rtDevice;
+	m_Pool = pool;
+	m_ScratchBudget = scratchBudget;
+}
+
+uint32_t BLASBuilder::Add(const D3D12_RAYTRACING_GEOMETRY_DESC* geometries, uint32_t geometryCount, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS flags) {
+	Request request = {};
+	request.firstGeometry = (uint32_t)m_Geometries.size();
+	request.geometryCount = geometryCount;
+	request.flags = flags;
+	m_Geometries.insert(m_Geometries.end(), geometries, geometries + geometryCount);
+	m_Requests.push_back(request);
+	return (uint32_t)m_Requests.size() - 1;
+}
+
+std::vector<PooledBuffer> BLASBuilder::Build(ID3D12GraphicsCommandList* cmdList, ID3D12RaytracingFallbackCommandList* rtCmdList, uint64_t fenceValue) {
+	std::vector<PooledBuffer> results(m_Requests.size());
+	m_WaveCount = 0;
+	if (m_Requests.empty())
+		return results;
+
+	//sizes for every build up front, one pass over the requests
+	for (auto& request : m_Requests) {
+		D3D12_GET_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO_DESC prebuildDesc = {};
+		prebuildDesc.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+		prebuildDesc.Flags = request.flags;
+		prebuildDesc.NumDescs = request.geometryCount;
+		prebuildDesc.pGeometryDescs = m_Geometries.data() + request.firstGeometry;
+		prebuildDesc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+		m_RTDevice->GetRaytracingAccelerationStructurePrebuildInfo(&prebuildDesc, &request.info);
+	}
+
+	//largest first, so the big builds share a wave and the small ones fill up what is left of the budget
+	std::vector<uint32_t> order(m_Requests.size());
+	for (uint32_t i = 0; i < (uint32_t)order.size(); ++i)
+		order[i] = i;
+	std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+		return m_Requests[a].info.ScratchDataSizeInBytes > m_Requests[b].info.ScratchDataSizeInBytes;
+	});
+
+	//results are placed before any scratch, so a wave's scratch never lands on them and the first aliasing barrier covers them all
+	for (uint32_t index : order)
+		results[index] = m_Pool->Allocate(AlignSize(m_Requests[index].info.ResultDataMaxSizeInBytes, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT), m_RTDevice->GetAccelerationStructureResourceState());
+
+	for (size_t first = 0; first < order.size();) {
+		//a wave always has at least one build, even if that build alone is over budget
+		uint64_t scratchSize = AlignSize(m_Requests[order[first]].info.ScratchDataSizeInBytes, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
+		size_t last = first + 1;
+		for (; last < order.size(); ++last) {
+			uint64_t size = AlignSize(m_Requests[order[last]].info.ScratchDataSizeInBytes, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
+			if (scratchSize + size > m_ScratchBudget)
+				break;
+			scratchSize += size;
+		}
+
+		if (m_WaveCount > 0) {
+			//the previous wave's scratch is reused below, its builds have to finish first
+			cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(nullptr));
+		}
+		PooledBuffer scratch = m_Pool->Allocate(scratchSize, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		//null on both sides covers every placed resource, including the results placed above
+		cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Aliasing(nullptr, nullptr));
+
+		uint64_t scratchOffset = 0;
+		for (size_t i = first; i < last; ++i) {
+			const Request& request = m_Requests[order[i]];
+			D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc = {};
+			buildDesc.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
+			buildDesc.pGeometryDescs = m_Geometries.data() + request.firstGeometry;
+			buildDesc.NumDescs = request.geometryCount;
+			buildDesc.Flags = request.flags;
+			buildDesc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+			buildDesc.DestAccelerationStructureData.StartAddress = results[order[i]].resource->GetGPUVirtualAddress();
+			buildDesc.DestAccelerationStructureData.SizeInBytes = request.info.ResultDataMaxSizeInBytes;
+			buildDesc.ScratchAccelerationStructureData.StartAddress = scratch.resource->GetGPUVirtualAddress() + scratchOffset;
+			buildDesc.ScratchAccelerationStructureData.SizeInBytes = request.info.ScratchDataSizeInBytes;
+			rtCmdList->BuildRaytracingAccelerationStructure(&buildDesc);
+			scratchOffset += AlignSize(request.info.ScratchDataSizeInBytes, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BYTE_ALIGNMENT);
+		}
+		m_Pool->FreeAliased(scratch, fenceValue);
+		m_WaveCount++;
+		first = last;
+	}
+	//one barrier for all results before anything reads them
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(nullptr));
+
+	m_Geometries.clear();
+	m_Requests.clear();
+	return results;
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <dx/d3d12_1.h>
+#include <dx/D3D12RaytracingFallback.h>
+#include <stdint.h>
+#include <vector>
+#include "resourcepool.h"
+
+//Builds many bottom level acceleration structures in one submission.
+//All prebuild queries run in one pass, results are placed in the pool and the builds run in waves whose scratch fits a budget.
+//Builds in a wave share one scratch buffer and have no barriers between them, waves are separated by a single uav barrier.
+class BLASBuilder {
+public:
+	BLASBuilder(){}
+	~BLASBuilder(){}
+
+	void Init(ID3D12RaytracingFallbackDevice* rtDevice, ResourcePool* pool, uint64_t scratchBudget);
+	//geometries are copied, returns the index of the blas in the results of Build
+	uint32_t Add(const D3D12_RAYTRACING_GEOMETRY_DESC* geometries, uint32_t geometryCount, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS flags);
+	//records every added build, the results are in Add order and left in the acceleration structure state.
+	//scratch memory is handed back to the pool once fenceValue has completed.
+	std::vector<PooledBuffer> Build(ID3D12GraphicsCommandList* cmdList, ID3D12RaytracingFallbackCommandList* rtCmdList, uint64_t fenceValue);
+
+	uint32_t GetWaveCount() const { return m_WaveCount; }
+private:
+	struct Request {
+		uint32_t firstGeometry;
+		uint32_t geometryCount;
+		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAGS flags;
+		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info;
+	};
+
+	ID3D12RaytracingFallbackDevice* m_RTDevice = nullptr;
+	ResourcePool* m_Pool = nullptr;
+	uint64_t m_ScratchBudget = 0;
+	std::vector<D3D12_RAYTRACING_GEOMETRY_DESC> m_Geometries;
+	std::vector<Request> m_Requests;
+	uint32_t m_WaveCount = 0;
+};
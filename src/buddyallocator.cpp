@@ -0,0 +1,75 @@
+#include "buddyallocator.h"
+
+void BuddyAllocator::Init(uint64_t size, uint64_t minBlockSize) {
+	m_MinBlockSize = minBlockSize;
+	m_MaxOrder = 0;
+	while (BlockSize(m_MaxOrder) < size)
+		m_MaxOrder++;
+	m_Size = BlockSize(m_MaxOrder);
+	m_Used = 0;
+	m_PeakUsed = 0;
+	m_FreeLists.clear();
+	m_FreeLists.resize(m_MaxOrder + 1);
+	m_FreeLists[m_MaxOrder].insert(0);
+	m_AllocatedOrder.assign(m_Size / m_MinBlockSize, -1);
+}
+
+uint32_t BuddyAllocator::OrderForSize(uint64_t size) const {
+	uint32_t order = 0;
+	while (BlockSize(order) < size)
+		order++;
+	return order;
+}
+
+uint64_t BuddyAllocator::Allocate(uint64_t size) {
+	uint32_t order = OrderForSize(size);
+	if (order > m_MaxOrder)
+		return INVALID_OFFSET;
+	//find the smallest free block that fits
+	uint32_t current = order;
+	while (current <= m_MaxOrder && m_FreeLists[current].empty())
+		current++;
+	if (current > m_MaxOrder)
+		return INVALID_OFFSET;
+
+	uint64_t offset = *m_FreeLists[current].begin();
+	m_FreeLists[current].erase(m_FreeLists[current].begin());
+	//split down to the requested order, the upper halves go back on the free lists
+	while (current > order) {
+		current--;
+		m_FreeLists[current].insert(offset + BlockSize(current));
+	}
+	m_AllocatedOrder[offset / m_MinBlockSize] = (int8_t)order;
+	m_Used += BlockSize(order);
+	if (m_Used > m_PeakUsed)
+		m_PeakUsed = m_Used;
+	return offset;
+}
+
+void BuddyAllocator::Free(uint64_t offset) {
+	int8_t allocatedOrder = m_AllocatedOrder[offset / m_MinBlockSize];
+	if (allocatedOrder < 0)
+		return;
+	m_AllocatedOrder[offset / m_MinBlockSize] = -1;
+	uint32_t order = (uint32_t)allocatedOrder;
+	m_Used -= BlockSize(order);
+	//merge with the buddy for as long as it is free
+	while (order < m_MaxOrder) {
+		uint64_t buddy = offset ^ BlockSize(order);
+		auto it = m_FreeLists[order].find(buddy);
+		if (it == m_FreeLists[order].end())
+			break;
+		m_FreeLists[order].erase(it);
+		offset = offset < buddy ? offset : buddy;
+		order++;
+	}
+	m_FreeLists[order].insert(offset);
+}
+
+uint64_t BuddyAllocator::GetLargestFreeBlock() const {
+	for (int32_t order = (int32_t)m_MaxOrder; order >= 0; --order) {
+		if (!m_FreeLists[order].empty())
+			return BlockSize(order);
+	}
+	return 0;
+}
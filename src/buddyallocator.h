@@ -0,0 +1,34 @@
+#pragma once
+#include <stdint.h>
+#include <set>
+#include <vector>
+//Power of two buddy allocator over a range of offsets, has no D3D dependency.
+//Blocks are at least minBlockSize big, which also makes every offset minBlockSize aligned.
+class BuddyAllocator {
+public:
+	static const uint64_t INVALID_OFFSET = ~0ull;
+
+	BuddyAllocator(){}
+	~BuddyAllocator(){}
+
+	void Init(uint64_t size, uint64_t minBlockSize);
+	uint64_t Allocate(uint64_t size);
+	void Free(uint64_t offset);
+
+	uint64_t GetSize() const { return m_Size; }
+	//bytes in handed out blocks, including the rounding up to a power of two
+	uint64_t GetUsed() const { return m_Used; }
+	uint64_t GetPeakUsed() const { return m_PeakUsed; }
+	uint64_t GetLargestFreeBlock() const;
+private:
+	uint32_t OrderForSize(uint64_t size) const;
+	uint64_t BlockSize(uint32_t order) const { return m_MinBlockSize << order; }
+
+	uint64_t m_Size = 0;
+	uint64_t m_MinBlockSize = 0;
+	uint64_t m_Used = 0;
+	uint64_t m_PeakUsed = 0;
+	uint32_t m_MaxOrder = 0;
+	std::vector<std::set<uint64_t>> m_FreeLists;
+	std::vector<int8_t> m_AllocatedOrder; //per min block, order of the allocation starting there or -1
+};
@@ -0,0 +1,120 @@
+#pragma once
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "threadpool.h"
+
+//Hands out command lists to recording threads, each with an allocator of its own so one thread can record it without locking.
+//Lists keep the order they were requested in, however the recording threads finish, so they can go to the queue in one batch.
+//An allocator is only reset once the fence value its list was submitted with has completed.
+//Has no D3D dependency, the Backend creates the lists of one api (D3D12CommandLists, or a mock in the tests):
+//	typedef ... List;          default constructible, owned by the pool
+//	void Create(List& cmd);    makes a new list, open for recording
+//	void Reset(List& cmd);     reopens a list whose last submission completed
+//	void Close(List& cmd);
+//Create and Reset may run on several threads at once, each on a different list.
+template<typename Backend>
+class CommandListPool {
+public:
+	typedef typename Backend::List List;
+	typedef std::function<void(List&)> RecordJob;
+
+	CommandListPool(){}
+	~CommandListPool(){}
+
+	void Init(const Backend& backend) { m_Backend = backend; }
+	Backend& GetBackend() { return m_Backend; }
+	//thread safe, the list is returned open
+	List* Acquire();
+	//records every job on its own list, the first on the calling thread and the rest on the pool.
+	//the lists are closed and returned in job order.
+	std::vector<List*> Record(ThreadPool& pool, const std::vector<RecordJob>& jobs);
+	void Retire(const std::vector<List*>& lists, uint64_t fenceValue);
+	void Reclaim(uint64_t completedFenceValue);
+	//lists created so far, in flight or free
+	uint32_t GetListCount();
+private:
+	struct RetiredList {
+		uint64_t fenceValue;
+		List* list;
+	};
+
+	Backend m_Backend;
+	std::mutex m_Mutex;
+	std::vector<std::unique_ptr<List>> m_Lists;
+	std::vector<List*> m_FreeLists;
+	std::deque<RetiredList> m_RetiredLists;
+};
+
+template<typename Backend>
+typename CommandListPool<Backend>::List* CommandListPool<Backend>::Acquire() {
+	List* cmd = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!m_FreeLists.empty()) {
+			cmd = m_FreeLists.back();
+			m_FreeLists.pop_back();
+		}
+	}
+	if (cmd) {
+		m_Backend.Reset(*cmd);
+		return cmd;
+	}
+
+	std::unique_ptr<List> created(new List());
+	m_Backend.Create(*created);
+	cmd = created.get();
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Lists.push_back(std::move(created));
+	return cmd;
+}
+
+template<typename Backend>
+std::vector<typename CommandListPool<Backend>::List*> CommandListPool<Backend>::Record(ThreadPool& pool, const std::vector<RecordJob>& jobs) {
+	std::vector<List*> lists;
+	for (size_t i = 0; i < jobs.size(); ++i)
+		lists.push_back(Acquire());
+
+	std::vector<std::future<void>> recorded;
+	for (size_t i = 1; i < jobs.size(); ++i) {
+		List* cmd = lists[i];
+		const RecordJob* job = &jobs[i];
+		recorded.push_back(pool.Submit([this, cmd, job]() {
+			(*job)(*cmd);
+			m_Backend.Close(*cmd);
+		}));
+	}
+	if (!jobs.empty()) {
+		jobs[0](*lists[0]);
+		m_Backend.Close(*lists[0]);
+	}
+	for (auto& job : recorded)
+		job.wait();
+	return lists;
+}
+
+template<typename Backend>
+void CommandListPool<Backend>::Retire(const std::vector<List*>& lists, uint64_t fenceValue) {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	for (List* cmd : lists)
+		m_RetiredLists.push_back({ fenceValue, cmd });
+}
+
+template<typename Backend>
+void CommandListPool<Backend>::Reclaim(uint64_t completedFenceValue) {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	while (!m_RetiredLists.empty() && m_RetiredLists.front().fenceValue <= completedFenceValue) {
+		m_FreeLists.push_back(m_RetiredLists.front().list);
+		m_RetiredLists.pop_front();
+	}
+}
+
+template<typename Backend>
+uint32_t CommandListPool<Backend>::GetListCount() {
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return (uint32_t)m_Lists.size();
+}
@@ -0,0 +1,35 @@
+#include "computepass.h"
+#include <stdio.h>
+#include <vector>
+#include <string>
+
+void ComputePass::Init(ID3D12Device* device, ShaderCompiler* compiler, const char* name, const wchar_t* shader, const D3D12_ROOT_SIGNATURE_DESC& rootSignatureDesc) {
+	ComPtr<ID3DBlob> signBlob, errorBlob;
+	if (FAILED(D3D12SerializeRootSignature(&rootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, &signBlob, &errorBlob))) {
+		printf("%s: Failed to serialize root signature\n", name);
+		return;
+	}
+	std::string error = std::string(name) + ": Failed to create root signature";
+	HR(device->CreateRootSignature(0, signBlob->GetBufferPointer(), signBlob->GetBufferSize(), IID_PPV_ARGS(&m_RootSignature)), error.c_str());
+
+	ComPtr<IDxcBlob> blob = compiler->Compile(shader, L"main", L"cs_6_0", std::vector<std::wstring>());
+	if (!blob) {
+		printf("%s: Failed to compile %ls\n", name, shader);
+		return;
+	}
+	D3D12_COMPUTE_PIPELINE_STATE_DESC psoDesc = {};
+	psoDesc.pRootSignature = m_RootSignature.Get();
+	psoDesc.CS.pShaderBytecode = blob->GetBufferPointer();
+	psoDesc.CS.BytecodeLength = blob->GetBufferSize();
+	error = std::string(name) + ": Failed to create pipeline";
+	HR(device->CreateComputePipelineState(&psoDesc, IID_PPV_ARGS(&m_PipelineState)), error.c_str());
+}
+
+void ComputePass::Bind(ID3D12GraphicsCommandList* cmdList) {
+	cmdList->SetPipelineState(m_PipelineState.Get());
+	cmdList->SetComputeRootSignature(m_RootSignature.Get());
+}
+
+void ComputePass::Dispatch(ID3D12GraphicsCommandList* cmdList, uint32_t width, uint32_t height, uint32_t groupSize) {
+	cmdList->Dispatch((width + groupSize - 1) / groupSize, (height + groupSize - 1) / groupSize, 1);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <dx/d3d12_1.h>
+#include <wrl/client.h>
+#include <stdint.h>
+#include "shadercompiler.h"
+using Microsoft::WRL::ComPtr;
+#define HR(x, s) if(x != S_OK) {MessageBoxA(nullptr, s, "Failure", MB_OK);}
+
+//A compute shader and its root signature, the pipeline the Upsampler and Reconstructor are built on.
+//The owner describes the root parameters and sets the root arguments between Bind and Dispatch.
+class ComputePass {
+public:
+	ComputePass(){}
+	~ComputePass(){}
+
+	//compiles the shader's main as cs_6_0, name prefixes the error messages, may run on a pool thread
+	void Init(ID3D12Device* device, ShaderCompiler* compiler, const char* name, const wchar_t* shader, const D3D12_ROOT_SIGNATURE_DESC& rootSignatureDesc);
+	bool IsReady() const { return m_PipelineState != nullptr; }
+	void Bind(ID3D12GraphicsCommandList* cmdList);
+	//one group per groupSize x groupSize pixels
+	static void Dispatch(ID3D12GraphicsCommandList* cmdList, uint32_t width, uint32_t height, uint32_t groupSize);
+private:
+	ComPtr<ID3D12RootSignature> m_RootSignature;
+	ComPtr<ID3D12PipelineState> m_PipelineState;
+};
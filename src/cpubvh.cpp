@@ -0,0 +1,675 @@
+#include "cpubvh.h"
+#include <algorithm>
+#include <math.h>
+#include <glm/gtx/closest_point.hpp>
+#include <glm/gtx/intersect.hpp>
+
+static BvhNode MakeLeaf(const std::vector<Aabb>& bounds, const std::vector<uint32_t>& order, uint32_t first, uint32_t count) {
+	Aabb box;
+	for (uint32_t i = first; i < first + count; ++i)
+		box.Grow(bounds[order[i]]);
+	return { box.min, first, box.max, count };
+}
+
+static uint32_t BinIndex(float center, float centerMin, float scale) {
+	return std::min((uint32_t)((center - centerMin) * scale), (uint32_t)CPU_BVH_BIN_COUNT - 1);
+}
+
+void BuildBvh(const std::vector<Aabb>& bounds, std::vector<BvhNode>& nodes, std::vector<uint32_t>& order) {
+	uint32_t count = (uint32_t)bounds.size();
+	nodes.clear();
+	order.resize(count);
+	if (count == 0)
+		return;
+	std::vector<glm::vec3> centers(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		order[i] = i;
+		centers[i] = bounds[i].Center();
+	}
+	nodes.reserve(2 * count - 1);
+	nodes.push_back(MakeLeaf(bounds, order, 0, count));
+	struct BuildTask {
+		uint32_t node;
+		uint32_t depth;
+	};
+	std::vector<BuildTask> stack(1, { 0, 0 });
+	while (!stack.empty()) {
+		uint32_t nodeIndex = stack.back().node;
+		uint32_t depth = stack.back().depth;
+		stack.pop_back();
+		uint32_t first = nodes[nodeIndex].leftOrFirst;
+		uint32_t n = nodes[nodeIndex].count;
+		if (n <= CPU_BVH_MAX_LEAF_SIZE)
+			continue;
+
+		Aabb centerBounds;
+		for (uint32_t i = first; i < first + n; ++i)
+			centerBounds.Grow(centers[order[i]]);
+		int bestAxis = -1;
+		uint32_t bestBin = 0;
+		float bestCost = FLT_MAX;
+		for (int axis = 0; axis < 3; ++axis) {
+			float extent = centerBounds.max[axis] - centerBounds.min[axis];
+			if (extent <= 0.0f || depth >= CPU_BVH_MAX_SAH_DEPTH)
+				continue;
+			float scale = CPU_BVH_BIN_COUNT / extent;
+			Aabb bins[CPU_BVH_BIN_COUNT];
+			uint32_t binCounts[CPU_BVH_BIN_COUNT] = {};
+			for (uint32_t i = first; i < first + n; ++i) {
+				uint32_t bin = BinIndex(centers[order[i]][axis], centerBounds.min[axis], scale);
+				bins[bin].Grow(bounds[order[i]]);
+				++binCounts[bin];
+			}
+			//sweep from the left, then from the right evaluating every plane between bins
+			float leftArea[CPU_BVH_BIN_COUNT - 1];
+			uint32_t leftCount[CPU_BVH_BIN_COUNT - 1];
+			Aabb side;
+			uint32_t sideCount = 0;
+			for (uint32_t b = 0; b < CPU_BVH_BIN_COUNT - 1; ++b) {
+				side.Grow(bins[b]);
+				sideCount += binCounts[b];
+				leftArea[b] = side.HalfArea();
+				leftCount[b] = sideCount;
+			}
+			side = Aabb();
+			sideCount = 0;
+			for (uint32_t b = CPU_BVH_BIN_COUNT - 1; b > 0; --b) {
+				side.Grow(bins[b]);
+				sideCount += binCounts[b];
+				if (sideCount == 0 || leftCount[b - 1] == 0)
+					continue;
+				float cost = leftArea[b - 1] * leftCount[b - 1] + side.HalfArea() * sideCount;
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = b;
+				}
+			}
+		}
+
+		uint32_t mid = first + n / 2;
+		if (bestAxis >= 0) {
+			float centerMin = centerBounds.min[bestAxis];
+			float scale = CPU_BVH_BIN_COUNT / (centerBounds.max[bestAxis] - centerMin);
+			uint32_t* split = std::partition(&order[first], &order[first] + n, [&](uint32_t i) {
+				return BinIndex(centers[i][bestAxis], centerMin, scale) < bestBin;
+			});
+			mid = (uint32_t)(split - &order[0]);
+		}
+		else {
+			//too deep for SAH, or all centers coincide: halve along the widest axis so the depth stays bounded
+			glm::vec3 extent = centerBounds.max - centerBounds.min;
+			int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+			std::nth_element(&order[first], &order[mid], &order[first] + n, [&](uint32_t a, uint32_t b) {
+				return centers[a][axis] < centers[b][axis];
+			});
+		}
+		uint32_t left = (uint32_t)nodes.size();
+		nodes.push_back(MakeLeaf(bounds, order, first, mid - first));
+		nodes.push_back(MakeLeaf(bounds, order, mid, first + n - mid));
+		nodes[nodeIndex].leftOrFirst = left;
+		nodes[nodeIndex].count = 0;
+		stack.push_back({ left, depth + 1 });
+		stack.push_back({ left + 1, depth + 1 });
+	}
+}
+
+float IntersectAabb(const CpuTraversalRay& ray, const glm::vec3& boundsMin, const glm::vec3& boundsMax, float tMax) {
+	glm::vec3 t0 = (boundsMin - ray.origin) * ray.invDirection;
+	glm::vec3 t1 = (boundsMax - ray.origin) * ray.invDirection;
+	glm::vec3 tNear = glm::min(t0, t1);
+	glm::vec3 tFar = glm::max(t0, t1);
+	float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, ray.tMin));
+	float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+	return enter <= exit ? enter : FLT_MAX;
+}
+
+//Front to back walk calling leaf(first, count) on every leaf the ray reaches before hit.t.
+//leaf returns whether it shortened hit.t, the walk ends at the first such leaf for any hit rays.
+template<typename LeafFunc>
+static bool TraverseBvh(const std::vector<BvhNode>& nodes, const CpuTraversalRay& ray, bool anyHit, CpuHit& hit, LeafFunc leaf) {
+	if (nodes.empty())
+		return false;
+	uint32_t stack[CPU_BVH_STACK_SIZE];
+	float stackEnter[CPU_BVH_STACK_SIZE];
+	uint32_t depth = 0;
+	float rootEnter = IntersectAabb(ray, nodes[0].boundsMin, nodes[0].boundsMax, hit.t);
+	if (rootEnter == FLT_MAX)
+		return false;
+	stack[depth] = 0;
+	stackEnter[depth++] = rootEnter;
+	bool found = false;
+	while (depth > 0) {
+		--depth;
+		//a closer hit may have been found since the node was pushed
+		if (stackEnter[depth] > hit.t)
+			continue;
+		const BvhNode& node = nodes[stack[depth]];
+		if (node.count > 0) {
+			if (leaf(node.leftOrFirst, node.count)) {
+				found = true;
+				if (anyHit)
+					return true;
+			}
+			continue;
+		}
+		uint32_t nearChild = node.leftOrFirst;
+		uint32_t farChild = nearChild + 1;
+		float nearEnter = IntersectAabb(ray, nodes[nearChild].boundsMin, nodes[nearChild].boundsMax, hit.t);
+		float farEnter = IntersectAabb(ray, nodes[farChild].boundsMin, nodes[farChild].boundsMax, hit.t);
+		if (farEnter < nearEnter) {
+			std::swap(nearChild, farChild);
+			std::swap(nearEnter, farEnter);
+		}
+		if (farEnter != FLT_MAX) {
+			stack[depth] = farChild;
+			stackEnter[depth++] = farEnter;
+		}
+		if (nearEnter != FLT_MAX) {
+			stack[depth] = nearChild;
+			stackEnter[depth++] = nearEnter;
+		}
+	}
+	return found;
+}
+
+//Depth first walk over every node test accepts, calling leaf(first, count) on the accepted leaves.
+template<typename NodeTest, typename LeafFunc>
+static void VisitBvh(const std::vector<BvhNode>& nodes, NodeTest test, LeafFunc leaf) {
+	if (nodes.empty() || !test(nodes[0]))
+		return;
+	uint32_t stack[CPU_BVH_STACK_SIZE];
+	uint32_t depth = 0;
+	stack[depth++] = 0;
+	while (depth > 0) {
+		const BvhNode& node = nodes[stack[--depth]];
+		if (node.count > 0) {
+			leaf(node.leftOrFirst, node.count);
+			continue;
+		}
+		for (uint32_t child = node.leftOrFirst; child < node.leftOrFirst + 2; ++child) {
+			if (test(nodes[child]))
+				stack[depth++] = child;
+		}
+	}
+}
+
+//Nearest first walk calling leaf(first, count) on every leaf whose lower bound distance is below bound,
+//leaf may lower bound as it finds closer primitives.
+template<typename NodeDistance, typename LeafFunc>
+static void NearestBvh(const std::vector<BvhNode>& nodes, NodeDistance nodeDistance, const float& bound, LeafFunc leaf) {
+	if (nodes.empty())
+		return;
+	uint32_t stack[CPU_BVH_STACK_SIZE];
+	float stackDistance[CPU_BVH_STACK_SIZE];
+	uint32_t depth = 0;
+	stack[depth] = 0;
+	stackDistance[depth++] = nodeDistance(nodes[0]);
+	while (depth > 0) {
+		--depth;
+		if (stackDistance[depth] >= bound)
+			continue;
+		const BvhNode& node = nodes[stack[depth]];
+		if (node.count > 0) {
+			leaf(node.leftOrFirst, node.count);
+			continue;
+		}
+		uint32_t nearChild = node.leftOrFirst;
+		uint32_t farChild = nearChild + 1;
+		float nearDistance = nodeDistance(nodes[nearChild]);
+		float farDistance = nodeDistance(nodes[farChild]);
+		if (farDistance < nearDistance) {
+			std::swap(nearChild, farChild);
+			std::swap(nearDistance, farDistance);
+		}
+		if (farDistance < bound) {
+			stack[depth] = farChild;
+			stackDistance[depth++] = farDistance;
+		}
+		if (nearDistance < bound) {
+			stack[depth] = nearChild;
+			stackDistance[depth++] = nearDistance;
+		}
+	}
+}
+
+static float DistanceToAabb(const glm::vec3& p, const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+	return glm::length(glm::max(glm::max(boundsMin - p, p - boundsMax), glm::vec3(0.0f)));
+}
+
+static bool AabbOverlaps(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const Aabb& other) {
+	return glm::all(glm::lessThanEqual(boundsMin, other.max)) && glm::all(glm::lessThanEqual(other.min, boundsMax));
+}
+
+//bounds of the transformed corners
+static Aabb TransformAabb(const Aabb& bounds, const glm::mat4& transform) {
+	Aabb result;
+	if (bounds.IsEmpty())
+		return result;
+	for (uint32_t corner = 0; corner < 8; ++corner) {
+		glm::vec3 p((corner & 1) ? bounds.max.x : bounds.min.x, (corner & 2) ? bounds.max.y : bounds.min.y, (corner & 4) ? bounds.max.z : bounds.min.z);
+		result.Grow(glm::vec3(transform * glm::vec4(p, 1.0f)));
+	}
+	return result;
+}
+
+//square roots of the smallest and largest eigenvalue of m^T m, closed form for symmetric 3x3 matrices
+static void SingularValueRange(const glm::mat3& m, float* smallest, float* largest) {
+	glm::mat3 s = glm::transpose(m) * m;
+	float offDiagonal = s[0][1] * s[0][1] + s[0][2] * s[0][2] + s[1][2] * s[1][2];
+	float q = (s[0][0] + s[1][1] + s[2][2]) / 3.0f;
+	float p = sqrtf(((s[0][0] - q) * (s[0][0] - q) + (s[1][1] - q) * (s[1][1] - q) + (s[2][2] - q) * (s[2][2] - q) + 2.0f * offDiagonal) / 6.0f);
+	float low = q;
+	float high = q;
+	if (p > 0.0f) {
+		float angle = acosf(glm::clamp(glm::determinant((s - glm::mat3(q)) / p) * 0.5f, -1.0f, 1.0f)) / 3.0f;
+		low = q + 2.0f * p * cosf(angle + 2.0943951f);
+		high = q + 2.0f * p * cosf(angle);
+	}
+	//a little under and over, rounding must not make culling against them cut away a primitive
+	*smallest = sqrtf(std::max(low, 0.0f)) * 0.999f;
+	*largest = sqrtf(std::max(high, 0.0f)) * 1.001f;
+}
+
+static glm::vec3 ClosestPointOnSegment(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b) {
+	return a == b ? a : glm::closestPointOnLine(p, a, b);
+}
+
+static glm::vec3 ClosestPointOnTriangle(const glm::vec3& p, const glm::vec3* tri) {
+	glm::vec3 e1 = tri[1] - tri[0];
+	glm::vec3 e2 = tri[2] - tri[0];
+	glm::vec3 n = glm::cross(e1, e2);
+	float area = glm::dot(n, n);
+	if (area > 0.0f) {
+		//inside when the projection lies on the inner side of all three edges
+		glm::vec3 projected = p - n * (glm::dot(p - tri[0], n) / area);
+		if (glm::dot(glm::cross(e1, projected - tri[0]), n) >= 0.0f && glm::dot(glm::cross(tri[2] - tri[1], projected - tri[1]), n) >= 0.0f &&
+			glm::dot(glm::cross(-e2, projected - tri[2]), n) >= 0.0f)
+			return projected;
+	}
+	glm::vec3 best = ClosestPointOnSegment(p, tri[0], tri[1]);
+	for (int edge = 1; edge < 3; ++edge) {
+		glm::vec3 candidate = ClosestPointOnSegment(p, tri[edge], tri[(edge + 1) % 3]);
+		if (glm::dot(candidate - p, candidate - p) < glm::dot(best - p, best - p))
+			best = candidate;
+	}
+	return best;
+}
+
+//separating axis test: the box faces, the triangle's normal and the nine edge cross products
+static bool TriangleOverlapsBox(const glm::vec3* tri, const glm::vec3& center, const glm::vec3& halfSize) {
+	glm::vec3 v[3] = { tri[0] - center, tri[1] - center, tri[2] - center };
+	for (int axis = 0; axis < 3; ++axis) {
+		if (std::min(std::min(v[0][axis], v[1][axis]), v[2][axis]) > halfSize[axis] || std::max(std::max(v[0][axis], v[1][axis]), v[2][axis]) < -halfSize[axis])
+			return false;
+	}
+	glm::vec3 edges[3] = { v[1] - v[0], v[2] - v[1], v[0] - v[2] };
+	glm::vec3 n = glm::cross(edges[0], edges[1]);
+	if (fabsf(glm::dot(n, v[0])) > glm::dot(halfSize, glm::abs(n)))
+		return false;
+	for (int edge = 0; edge < 3; ++edge) {
+		for (int axis = 0; axis < 3; ++axis) {
+			glm::vec3 unit(0.0f);
+			unit[axis] = 1.0f;
+			glm::vec3 separating = glm::cross(unit, edges[edge]);
+			float p0 = glm::dot(v[0], separating);
+			float p1 = glm::dot(v[1], separating);
+			float p2 = glm::dot(v[2], separating);
+			float radius = glm::dot(halfSize, glm::abs(separating));
+			if (std::min(std::min(p0, p1), p2) > radius || std::max(std::max(p0, p1), p2) < -radius)
+				return false;
+		}
+	}
+	return true;
+}
+
+Aabb CpuOverlapVolume::GetBounds() const {
+	glm::vec3 halfSize = type == SPHERE ? glm::vec3(extent.x) : extent;
+	Aabb bounds;
+	bounds.min = center - halfSize;
+	bounds.max = center + halfSize;
+	return bounds;
+}
+
+bool CpuOverlapVolume::Overlaps(const glm::vec3* triangle) const {
+	if (type == BOX)
+		return TriangleOverlapsBox(triangle, center, extent);
+	glm::vec3 closest = ClosestPointOnTriangle(center, triangle);
+	return glm::dot(closest - center, closest - center) <= extent.x * extent.x;
+}
+
+bool CpuOverlapVolume::OverlapsSphere(const glm::vec3& sphereCenter, float radius) const {
+	if (type == BOX) {
+		glm::vec3 closest = glm::clamp(sphereCenter, center - extent, center + extent);
+		return glm::dot(closest - sphereCenter, closest - sphereCenter) <= radius * radius;
+	}
+	float reach = radius + extent.x;
+	return glm::dot(sphereCenter - center, sphereCenter - center) <= reach * reach;
+}
+
+CpuFrustum CpuFrustum::FromMatrix(const glm::mat4& viewProjection) {
+	glm::mat4 rows = glm::transpose(viewProjection);
+	CpuFrustum frustum;
+	frustum.planes[0] = rows[3] + rows[0];
+	frustum.planes[1] = rows[3] - rows[0];
+	frustum.planes[2] = rows[3] + rows[1];
+	frustum.planes[3] = rows[3] - rows[1];
+	frustum.planes[4] = rows[2];
+	frustum.planes[5] = rows[3] - rows[2];
+	return frustum;
+}
+
+bool CpuFrustum::Intersects(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const {
+	for (const glm::vec4& plane : planes) {
+		//the corner furthest along the plane's normal
+		glm::vec3 corner(plane.x >= 0.0f ? boundsMax.x : boundsMin.x, plane.y >= 0.0f ? boundsMax.y : boundsMin.y, plane.z >= 0.0f ? boundsMax.z : boundsMin.z);
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+void CpuBLAS::BuildPrimitives(std::vector<Aabb>& bounds) {
+	m_Bounds = Aabb();
+	for (const Aabb& b : bounds)
+		m_Bounds.Grow(b);
+	BuildBvh(bounds, m_Nodes, m_PrimitiveIds);
+}
+
+void CpuBLAS::Build(const glm::vec3* vertices, uint32_t vertexCount) {
+	uint32_t triangleCount = vertexCount / 3;
+	std::vector<Aabb> bounds(triangleCount);
+	for (uint32_t i = 0; i < triangleCount; ++i) {
+		for (uint32_t k = 0; k < 3; ++k)
+			bounds[i].Grow(vertices[i * 3 + k]);
+	}
+	BuildPrimitives(bounds);
+	//store triangles in leaf order so a leaf reads one contiguous run
+	m_Triangles.resize(triangleCount);
+	for (uint32_t i = 0; i < triangleCount; ++i) {
+		const glm::vec3* v = &vertices[m_PrimitiveIds[i] * 3];
+		m_Triangles[i] = { v[0], v[1] - v[0], v[2] - v[0] };
+	}
+	m_PrimitiveBounds.clear();
+	m_Spheres.clear();
+}
+
+void CpuBLAS::BuildSpheres(const glm::vec4* spheres, uint32_t count) {
+	std::vector<Aabb> bounds(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		bounds[i].min = glm::vec3(spheres[i]) - spheres[i].w;
+		bounds[i].max = glm::vec3(spheres[i]) + spheres[i].w;
+	}
+	BuildProcedural(bounds.data(), count, nullptr, nullptr);
+	m_Spheres.resize(count);
+	for (uint32_t i = 0; i < count; ++i)
+		m_Spheres[i] = spheres[m_PrimitiveIds[i]];
+}
+
+void CpuBLAS::BuildProcedural(const Aabb* bounds, uint32_t count, CpuIntersectFunc intersect, void* userData) {
+	std::vector<Aabb> primitiveBounds(bounds, bounds + count);
+	BuildPrimitives(primitiveBounds);
+	m_PrimitiveBounds.resize(count);
+	for (uint32_t i = 0; i < count; ++i)
+		m_PrimitiveBounds[i] = bounds[m_PrimitiveIds[i]];
+	m_Intersect = intersect;
+	m_UserData = userData;
+	m_Triangles.clear();
+	m_Spheres.clear();
+}
+
+//built in intersector for spheres, the far root is taken when the ray starts inside or the near root is before tMin
+static bool IntersectSphere(const glm::vec4& sphere, const CpuTraversalRay& ray, CpuHit& hit) {
+	float length = glm::length(ray.direction);
+	if (length == 0.0f)
+		return false;
+	glm::vec3 direction = ray.direction / length;
+	glm::vec3 center(sphere);
+	float distance;
+	if (!glm::intersectRaySphere(ray.origin, direction, center, sphere.w * sphere.w, distance))
+		return false;
+	if (distance < ray.tMin * length) {
+		float farDistance = 2.0f * glm::dot(center - ray.origin, direction) - distance;
+		if (farDistance <= distance)
+			return false;
+		distance = farDistance;
+	}
+	float t = distance / length;
+	if (t < ray.tMin || t >= hit.t)
+		return false;
+	hit.t = t;
+	hit.u = 0.0f;
+	hit.v = 0.0f;
+	return true;
+}
+
+bool CpuBLAS::Intersect(const CpuTraversalRay& ray, uint32_t flags, CpuHit& hit) const {
+	bool cullBack = (flags & CPU_TRACE_CULL_BACK_FACING) != 0;
+	if (IsProcedural()) {
+		//back face culling only applies to triangles, as on the gpu
+		return TraverseBvh(m_Nodes, ray, (flags & CPU_TRACE_ANY_HIT) != 0, hit, [&](uint32_t first, uint32_t count) {
+			bool found = false;
+			for (uint32_t i = first; i < first + count; ++i) {
+				if (IntersectAabb(ray, m_PrimitiveBounds[i].min, m_PrimitiveBounds[i].max, hit.t) == FLT_MAX)
+					continue;
+				if (m_Intersect ? !m_Intersect(m_UserData, m_PrimitiveIds[i], ray, hit) : !IntersectSphere(m_Spheres[i], ray, hit))
+					continue;
+				hit.primitiveId = m_PrimitiveIds[i];
+				found = true;
+				if (flags & CPU_TRACE_ANY_HIT)
+					break;
+			}
+			return found;
+		});
+	}
+	return TraverseBvh(m_Nodes, ray, (flags & CPU_TRACE_ANY_HIT) != 0, hit, [&](uint32_t first, uint32_t count) {
+		bool found = false;
+		for (uint32_t i = first; i < first + count; ++i) {
+			//Moller-Trumbore, det > 0 for triangles wound clockwise towards the ray origin
+			const Triangle& tri = m_Triangles[i];
+			glm::vec3 p = glm::cross(ray.direction, tri.e2);
+			float det = glm::dot(tri.e1, p);
+			if (cullBack ? det <= 0.0f : det == 0.0f)
+				continue;
+			float invDet = 1.0f / det;
+			glm::vec3 s = ray.origin - tri.v0;
+			float u = glm::dot(s, p) * invDet;
+			if (u < 0.0f || u > 1.0f)
+				continue;
+			glm::vec3 q = glm::cross(s, tri.e1);
+			float v = glm::dot(ray.direction, q) * invDet;
+			if (v < 0.0f || u + v > 1.0f)
+				continue;
+			float t = glm::dot(tri.e2, q) * invDet;
+			if (t < ray.tMin || t >= hit.t)
+				continue;
+			hit.t = t;
+			hit.u = u;
+			hit.v = v;
+			hit.primitiveId = m_PrimitiveIds[i];
+			found = true;
+			if (flags & CPU_TRACE_ANY_HIT)
+				break;
+		}
+		return found;
+	});
+}
+
+bool CpuBLAS::FindClosestPoint(const glm::vec3& localPoint, const glm::vec3& worldPoint, const glm::mat4& transform, float minScale, CpuClosestPoint& result) const {
+	bool found = false;
+	NearestBvh(m_Nodes, [&](const BvhNode& node) {
+		return DistanceToAabb(localPoint, node.boundsMin, node.boundsMax) * minScale;
+	}, result.distance, [&](uint32_t first, uint32_t count) {
+		for (uint32_t i = first; i < first + count; ++i) {
+			glm::vec3 closest;
+			if (IsProcedural()) {
+				closest = glm::vec3(transform * glm::vec4(ClosestPointOnPrimitive(i, localPoint), 1.0f));
+			} else {
+				glm::vec3 world[3];
+				GetWorldTriangle(i, transform, world);
+				closest = ClosestPointOnTriangle(worldPoint, world);
+			}
+			float distance = glm::length(closest - worldPoint);
+			if (distance >= result.distance)
+				continue;
+			result.position = closest;
+			result.distance = distance;
+			result.primitiveId = m_PrimitiveIds[i];
+			found = true;
+		}
+	});
+	return found;
+}
+
+void CpuBLAS::Overlap(const CpuOverlapVolume& volume, const Aabb& localBounds, const glm::mat4& transform, float maxScale, uint32_t instanceId, std::vector<CpuOverlap>& results) const {
+	VisitBvh(m_Nodes, [&](const BvhNode& node) {
+		return AabbOverlaps(node.boundsMin, node.boundsMax, localBounds);
+	}, [&](uint32_t first, uint32_t count) {
+		for (uint32_t i = first; i < first + count; ++i) {
+			if (IsProcedural()) {
+				if (!AabbOverlaps(m_PrimitiveBounds[i].min, m_PrimitiveBounds[i].max, localBounds))
+					continue;
+				//a sphere stays one under rotation and uniform scale, other transforms test the sphere around its ellipsoid
+				if (!m_Intersect && !volume.OverlapsSphere(glm::vec3(transform * glm::vec4(glm::vec3(m_Spheres[i]), 1.0f)), m_Spheres[i].w * maxScale))
+					continue;
+				results.push_back({ instanceId, m_PrimitiveIds[i] });
+				continue;
+			}
+			glm::vec3 world[3];
+			GetWorldTriangle(i, transform, world);
+			if (volume.Overlaps(world))
+				results.push_back({ instanceId, m_PrimitiveIds[i] });
+		}
+	});
+}
+
+glm::vec3 CpuBLAS::ClosestPointOnPrimitive(uint32_t index, const glm::vec3& localPoint) const {
+	if (m_Intersect)
+		return glm::clamp(localPoint, m_PrimitiveBounds[index].min, m_PrimitiveBounds[index].max);
+	const glm::vec4& sphere = m_Spheres[index];
+	glm::vec3 offset = localPoint - glm::vec3(sphere);
+	float length = glm::length(offset);
+	//any surface point is closest to the center
+	return glm::vec3(sphere) + (length > 0.0f ? offset / length : glm::vec3(1.0f, 0.0f, 0.0f)) * sphere.w;
+}
+
+void CpuBLAS::GetWorldTriangle(uint32_t index, const glm::mat4& transform, glm::vec3* world) const {
+	const Triangle& tri = m_Triangles[index];
+	world[0] = glm::vec3(transform * glm::vec4(tri.v0, 1.0f));
+	world[1] = glm::vec3(transform * glm::vec4(tri.v0 + tri.e1, 1.0f));
+	world[2] = glm::vec3(transform * glm::vec4(tri.v0 + tri.e2, 1.0f));
+}
+
+uint32_t CpuScene::AddTriangles(const glm::vec3* vertices, uint32_t vertexCount) {
+	m_Geometries.emplace_back();
+	m_Geometries.back().Build(vertices, vertexCount);
+	return (uint32_t)m_Geometries.size() - 1;
+}
+
+uint32_t CpuScene::AddSpheres(const glm::vec4* spheres, uint32_t count) {
+	m_Geometries.emplace_back();
+	m_Geometries.back().BuildSpheres(spheres, count);
+	return (uint32_t)m_Geometries.size() - 1;
+}
+
+uint32_t CpuScene::AddProcedural(const Aabb* bounds, uint32_t count, CpuIntersectFunc intersect, void* userData) {
+	m_Geometries.emplace_back();
+	m_Geometries.back().BuildProcedural(bounds, count, intersect, userData);
+	return (uint32_t)m_Geometries.size() - 1;
+}
+
+uint32_t CpuScene::AddInstance(uint32_t geometry, const glm::mat4& transform) {
+	CpuInstance instance;
+	instance.geometry = geometry;
+	m_Instances.push_back(instance);
+	SetInstanceTransform((uint32_t)m_Instances.size() - 1, transform);
+	return (uint32_t)m_Instances.size() - 1;
+}
+
+void CpuScene::SetInstanceTransform(uint32_t instance, const glm::mat4& transform) {
+	CpuInstance& inst = m_Instances[instance];
+	inst.transform = transform;
+	inst.inverse = glm::inverse(transform);
+	inst.worldBounds = TransformAabb(m_Geometries[inst.geometry].GetBounds(), transform);
+	SingularValueRange(glm::mat3(transform), &inst.minScale, &inst.maxScale);
+}
+
+void CpuScene::Build() {
+	std::vector<Aabb> bounds(m_Instances.size());
+	for (size_t i = 0; i < m_Instances.size(); ++i)
+		bounds[i] = m_Instances[i].worldBounds;
+	BuildBvh(bounds, m_Nodes, m_InstanceOrder);
+}
+
+bool CpuScene::Intersect(const CpuRay& ray, uint32_t flags, CpuHit& hit) const {
+	hit = CpuHit();
+	hit.t = ray.tMax;
+	CpuTraversalRay worldRay(ray.origin, ray.direction, ray.tMin);
+	return TraverseBvh(m_Nodes, worldRay, (flags & CPU_TRACE_ANY_HIT) != 0, hit, [&](uint32_t first, uint32_t count) {
+		bool found = false;
+		for (uint32_t i = first; i < first + count; ++i) {
+			uint32_t instanceId = m_InstanceOrder[i];
+			const CpuInstance& instance = m_Instances[instanceId];
+			//the direction is not renormalized, so t means the same distance in both spaces
+			CpuTraversalRay localRay(glm::vec3(instance.inverse * glm::vec4(ray.origin, 1.0f)),
+				glm::vec3(instance.inverse * glm::vec4(ray.direction, 0.0f)), ray.tMin);
+			if (m_Geometries[instance.geometry].Intersect(localRay, flags, hit)) {
+				hit.instanceId = instanceId;
+				found = true;
+				if (flags & CPU_TRACE_ANY_HIT)
+					break;
+			}
+		}
+		return found;
+	});
+}
+
+bool CpuScene::FindClosestPoint(const glm::vec3& point, float maxDistance, CpuClosestPoint& result) const {
+	result = CpuClosestPoint();
+	result.position = point;
+	result.distance = maxDistance;
+	bool found = false;
+	NearestBvh(m_Nodes, [&](const BvhNode& node) {
+		return DistanceToAabb(point, node.boundsMin, node.boundsMax);
+	}, result.distance, [&](uint32_t first, uint32_t count) {
+		for (uint32_t i = first; i < first + count; ++i) {
+			uint32_t instanceId = m_InstanceOrder[i];
+			const CpuInstance& instance = m_Instances[instanceId];
+			if (DistanceToAabb(point, instance.worldBounds.min, instance.worldBounds.max) >= result.distance)
+				continue;
+			glm::vec3 localPoint = glm::vec3(instance.inverse * glm::vec4(point, 1.0f));
+			if (m_Geometries[instance.geometry].FindClosestPoint(localPoint, point, instance.transform, instance.minScale, result)) {
+				result.instanceId = instanceId;
+				found = true;
+			}
+		}
+	});
+	return found;
+}
+
+void CpuScene::Overlap(const CpuOverlapVolume& volume, std::vector<CpuOverlap>& results) const {
+	Aabb bounds = volume.GetBounds();
+	VisitBvh(m_Nodes, [&](const BvhNode& node) {
+		return AabbOverlaps(node.boundsMin, node.boundsMax, bounds);
+	}, [&](uint32_t first, uint32_t count) {
+		for (uint32_t i = first; i < first + count; ++i) {
+			uint32_t instanceId = m_InstanceOrder[i];
+			const CpuInstance& instance = m_Instances[instanceId];
+			if (!AabbOverlaps(instance.worldBounds.min, instance.worldBounds.max, bounds))
+				continue;
+			m_Geometries[instance.geometry].Overlap(volume, TransformAabb(bounds, instance.inverse), instance.transform, instance.maxScale, instanceId, results);
+		}
+	});
+}
+
+void CpuScene::CullFrustum(const CpuFrustum& frustum, std::vector<uint32_t>& instances) const {
+	VisitBvh(m_Nodes, [&](const BvhNode& node) {
+		return frustum.Intersects(node.boundsMin, node.boundsMax);
+	}, [&](uint32_t first, uint32_t count) {
+		for (uint32_t i = first; i < first + count; ++i) {
+			const CpuInstance& instance = m_Instances[m_InstanceOrder[i]];
+			if (frustum.Intersects(instance.worldBounds.min, instance.worldBounds.max))
+				instances.push_back(m_InstanceOrder[i]);
+		}
+	});
+}
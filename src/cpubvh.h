@@ -0,0 +1,213 @@
+#pragma once
+#include <stdint.h>
+#include <float.h>
+#include <vector>
+#include <glm/glm.hpp>
+#define CPU_BVH_MAX_LEAF_SIZE 4
+#define CPU_BVH_BIN_COUNT 16
+//nodes deeper than this are split at the median instead of by SAH, which adds at most 31 levels for 2^32 primitives.
+//degenerate inputs, like centers at 2^-i, would otherwise let SAH peel off one primitive per level
+#define CPU_BVH_MAX_SAH_DEPTH 32
+//deepest traversal stack, a walk holds at most one entry per level of the tree plus one
+#define CPU_BVH_STACK_SIZE 64
+#define CPU_INVALID_ID 0xFFFFFFFFu
+
+enum CpuTraceFlags {
+	CPU_TRACE_CLOSEST_HIT = 0,
+	//stop at the first hit found, for occlusion and line of sight
+	CPU_TRACE_ANY_HIT = 1 << 0,
+	//like RAY_FLAG_CULL_BACK_FACING_TRIANGLES, front faces are clockwise seen from the ray origin
+	CPU_TRACE_CULL_BACK_FACING = 1 << 1
+};
+
+struct Aabb {
+	glm::vec3 min = glm::vec3(FLT_MAX);
+	glm::vec3 max = glm::vec3(-FLT_MAX);
+
+	void Grow(const glm::vec3& p) { min = glm::min(min, p); max = glm::max(max, p); }
+	void Grow(const Aabb& b) { min = glm::min(min, b.min); max = glm::max(max, b.max); }
+	bool IsEmpty() const { return min.x > max.x; }
+	glm::vec3 Center() const { return (min + max) * 0.5f; }
+	float HalfArea() const {
+		glm::vec3 e = max - min;
+		return IsEmpty() ? 0.0f : e.x * e.y + e.y * e.z + e.z * e.x;
+	}
+};
+
+//leaves have count > 0 and reference order[leftOrFirst, leftOrFirst + count),
+//inner nodes have their two children next to each other at leftOrFirst
+struct BvhNode {
+	glm::vec3 boundsMin;
+	uint32_t leftOrFirst;
+	glm::vec3 boundsMax;
+	uint32_t count;
+};
+
+//Binned SAH build over primitive bounds, the same builder serves triangles and instances.
+//order receives the primitive indices in leaf order. The tree is at most CPU_BVH_STACK_SIZE - 1 levels deep.
+void BuildBvh(const std::vector<Aabb>& bounds, std::vector<BvhNode>& nodes, std::vector<uint32_t>& order);
+
+struct CpuRay {
+	glm::vec3 origin;
+	float tMin;
+	glm::vec3 direction;
+	float tMax;
+};
+
+//u and v are the barycentrics of the second and third vertex, like BuiltInTriangleIntersectionAttributes
+struct CpuHit {
+	float t = 0.0f;
+	float u = 0.0f;
+	float v = 0.0f;
+	uint32_t instanceId = CPU_INVALID_ID;
+	uint32_t primitiveId = CPU_INVALID_ID;
+};
+
+struct CpuClosestPoint {
+	glm::vec3 position;
+	float distance;
+	uint32_t instanceId = CPU_INVALID_ID;
+	uint32_t primitiveId = CPU_INVALID_ID;
+};
+
+struct CpuOverlap {
+	uint32_t instanceId;
+	uint32_t primitiveId;
+};
+
+//world space volume of an overlap query, extent is the half size of a box or the radius of a sphere in x
+struct CpuOverlapVolume {
+	enum Type {
+		BOX,
+		SPHERE
+	};
+	Type type;
+	glm::vec3 center;
+	glm::vec3 extent;
+
+	Aabb GetBounds() const;
+	//exact, not only against the triangle's bounds
+	bool Overlaps(const glm::vec3* triangle) const;
+	bool OverlapsSphere(const glm::vec3& sphereCenter, float radius) const;
+};
+
+//planes face inwards, a point p is inside when dot(plane.xyz, p) + plane.w >= 0 for all six
+struct CpuFrustum {
+	glm::vec4 planes[6];
+
+	//from a view projection matrix with d3d's 0 to 1 clip depth
+	static CpuFrustum FromMatrix(const glm::mat4& viewProjection);
+	//conservative, boxes straddling a corner outside two planes may still pass
+	bool Intersects(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const;
+};
+
+//ray with the reciprocal direction the slab tests need
+struct CpuTraversalRay {
+	glm::vec3 origin;
+	glm::vec3 direction;
+	glm::vec3 invDirection;
+	float tMin;
+	CpuTraversalRay(const glm::vec3& o, const glm::vec3& d, float t) : origin(o), direction(d), invDirection(1.0f / d.x, 1.0f / d.y, 1.0f / d.z), tMin(t) {}
+};
+
+//distance at which the ray enters the box, FLT_MAX if it misses it before tMax
+float IntersectAabb(const CpuTraversalRay& ray, const glm::vec3& boundsMin, const glm::vec3& boundsMax, float tMax);
+
+//Custom intersection of a procedural primitive, the cpu side of an hlsl intersection shader.
+//Called for object space rays that hit the primitive's box. Like ReportHit it only accepts t in [ray.tMin, hit.t),
+//writes t and its two attributes to hit.t, hit.u and hit.v and returns whether it did. May run on many threads at once.
+typedef bool (*CpuIntersectFunc)(void* userData, uint32_t primitiveId, const CpuTraversalRay& ray, CpuHit& hit);
+
+//Bottom level structure of an unindexed triangle list, vertices laid out like the gpu blas input,
+//or of procedural primitives given by their boxes like D3D12_RAYTRACING_GEOMETRY_TYPE_PROCEDURAL_PRIMITIVE_AABBS.
+class CpuBLAS {
+public:
+	CpuBLAS(){}
+	~CpuBLAS(){}
+
+	void Build(const glm::vec3* vertices, uint32_t vertexCount);
+	//spheres as center and radius, intersected analytically, hits leave u and v at 0
+	void BuildSpheres(const glm::vec4* spheres, uint32_t count);
+	void BuildProcedural(const Aabb* bounds, uint32_t count, CpuIntersectFunc intersect, void* userData);
+	//hit.t is the closest hit so far and is only replaced by a closer one, returns whether it was
+	bool Intersect(const CpuTraversalRay& ray, uint32_t flags, CpuHit& hit) const;
+	//searches in object space, distances are measured after transform, minScale is the transform's smallest
+	//singular value so object space bounds can be culled against world distances. result.distance is the best so far
+	bool FindClosestPoint(const glm::vec3& localPoint, const glm::vec3& worldPoint, const glm::mat4& transform, float minScale, CpuClosestPoint& result) const;
+	//custom procedural primitives overlap by their boxes, spheres by the sphere itself: exactly under rotation and uniform scale,
+	//by the sphere of radius * maxScale around the ellipsoid otherwise. maxScale is the transform's largest singular value,
+	//localBounds must contain the volume taken to object space
+	void Overlap(const CpuOverlapVolume& volume, const Aabb& localBounds, const glm::mat4& transform, float maxScale, uint32_t instanceId, std::vector<CpuOverlap>& results) const;
+	const Aabb& GetBounds() const { return m_Bounds; }
+	uint32_t GetPrimitiveCount() const { return (uint32_t)m_PrimitiveIds.size(); }
+	bool IsProcedural() const { return m_Triangles.empty() && !m_PrimitiveIds.empty(); }
+private:
+	void BuildPrimitives(std::vector<Aabb>& bounds);
+	void GetWorldTriangle(uint32_t index, const glm::mat4& transform, glm::vec3* world) const;
+	//closest point on a procedural primitive in object space
+	glm::vec3 ClosestPointOnPrimitive(uint32_t index, const glm::vec3& localPoint) const;
+
+	//first vertex and the two edges from it, in leaf order
+	struct Triangle {
+		glm::vec3 v0;
+		glm::vec3 e1;
+		glm::vec3 e2;
+	};
+	std::vector<BvhNode> m_Nodes;
+	std::vector<Triangle> m_Triangles;
+	//procedural boxes and spheres, in leaf order
+	std::vector<Aabb> m_PrimitiveBounds;
+	std::vector<glm::vec4> m_Spheres;
+	//null for spheres
+	CpuIntersectFunc m_Intersect = nullptr;
+	void* m_UserData = nullptr;
+	std::vector<uint32_t> m_PrimitiveIds;
+	Aabb m_Bounds;
+};
+
+struct CpuInstance {
+	glm::mat4 transform;
+	glm::mat4 inverse;
+	uint32_t geometry;
+	Aabb worldBounds;
+	//smallest singular value of the transform, how much it may shrink a distance
+	float minScale;
+	//largest singular value, how much it may stretch one
+	float maxScale;
+};
+
+//Instances of bottom level structures under a top level bvh, mirrors the tlas the gpu traces.
+//Traversal is read only, so any number of threads can trace at once as long as nothing is edited meanwhile.
+class CpuScene {
+public:
+	CpuScene(){}
+	~CpuScene(){}
+
+	//returns the geometry index
+	uint32_t AddTriangles(const glm::vec3* vertices, uint32_t vertexCount);
+	uint32_t AddSpheres(const glm::vec4* spheres, uint32_t count);
+	//userData must outlive the scene
+	uint32_t AddProcedural(const Aabb* bounds, uint32_t count, CpuIntersectFunc intersect, void* userData);
+	//returns the instance id hits report
+	uint32_t AddInstance(uint32_t geometry, const glm::mat4& transform);
+	void SetInstanceTransform(uint32_t instance, const glm::mat4& transform);
+	//rebuilds the top level after instances were added or moved
+	void Build();
+
+	//misses leave hit.t at ray.tMax and both ids at CPU_INVALID_ID
+	bool Intersect(const CpuRay& ray, uint32_t flags, CpuHit& hit) const;
+	//closest surface point within maxDistance, misses leave the distance at maxDistance and both ids at CPU_INVALID_ID
+	bool FindClosestPoint(const glm::vec3& point, float maxDistance, CpuClosestPoint& result) const;
+	//appends every triangle overlapping the volume
+	void Overlap(const CpuOverlapVolume& volume, std::vector<CpuOverlap>& results) const;
+	//appends the instances whose world bounds intersect the frustum
+	void CullFrustum(const CpuFrustum& frustum, std::vector<uint32_t>& instances) const;
+	uint32_t GetInstanceCount() const { return (uint32_t)m_Instances.size(); }
+	const CpuInstance& GetInstance(uint32_t instance) const { return m_Instances[instance]; }
+	const CpuBLAS& GetGeometry(uint32_t geometry) const { return m_Geometries[geometry]; }
+private:
+	std::vector<CpuBLAS> m_Geometries;
+	std::vector<CpuInstance> m_Instances;
+	std::vector<BvhNode> m_Nodes;
+	std::vector<uint32_t> m_InstanceOrder;
+};
@@ -0,0 +1,24 @@
+#include "d3d12commandlists.h"
+
+void D3D12CommandLists::Init(ID3D12Device* device, ID3D12RaytracingFallbackDevice* rtDevice, D3D12_COMMAND_LIST_TYPE type) {
+	m_Device = device;
+	m_RTDevice = rtDevice;
+	m_Type = type;
+}
+
+void D3D12CommandLists::Create(PooledCommandList& cmd) {
+	//new lists start open
+	HR(m_Device->CreateCommandAllocator(m_Type, IID_PPV_ARGS(&cmd.allocator)), "CreateCommandAllocator");
+	HR(m_Device->CreateCommandList(0, m_Type, cmd.allocator.Get(), nullptr, IID_PPV_ARGS(&cmd.list)), "CreateCommandList");
+	if (m_RTDevice)
+		m_RTDevice->QueryRaytracingCommandList(cmd.list.Get(), IID_PPV_ARGS(&cmd.rtList));
+}
+
+void D3D12CommandLists::Reset(PooledCommandList& cmd) {
+	cmd.allocator->Reset();
+	HR(cmd.list->Reset(cmd.allocator.Get(), nullptr), "Reset pooled command list");
+}
+
+void D3D12CommandLists::Close(PooledCommandList& cmd) {
+	HR(cmd.list->Close(), "Closing pooled command list");
+}
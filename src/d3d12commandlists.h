@@ -0,0 +1,33 @@
+#pragma once
+#include <dx/d3d12_1.h>
+#include <dx/D3D12RaytracingFallback.h>
+#include <wrl/client.h>
+#include "commandlistpool.h"
+using Microsoft::WRL::ComPtr;
+#define HR(x, s) if(x != S_OK) {MessageBoxA(nullptr, s, "Failure", MB_OK);}
+
+//a command list with an allocator of its own, so one thread can record it without locking
+struct PooledCommandList {
+	ComPtr<ID3D12CommandAllocator> allocator;
+	ComPtr<ID3D12GraphicsCommandList> list;
+	ComPtr<ID3D12RaytracingFallbackCommandList> rtList;
+};
+
+//CommandListPool backend for D3D12 lists of one type, rtDevice may be null for lists that never trace
+class D3D12CommandLists {
+public:
+	typedef PooledCommandList List;
+
+	D3D12CommandLists(){}
+	~D3D12CommandLists(){}
+
+	void Init(ID3D12Device* device, ID3D12RaytracingFallbackDevice* rtDevice, D3D12_COMMAND_LIST_TYPE type);
+	void Create(PooledCommandList& cmd);
+	void Reset(PooledCommandList& cmd);
+	void Close(PooledCommandList& cmd);
+private:
+	ID3D12Device* m_Device = nullptr;
+	ID3D12RaytracingFallbackDevice* m_RTDevice = nullptr;
+	D3D12_COMMAND_LIST_TYPE m_Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+};
+typedef CommandListPool<D3D12CommandLists> D3D12CommandListPool;
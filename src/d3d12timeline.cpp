@@ -0,0 +1,63 @@
+#include "d3d12timeline.h"
+#include <vector>
+
+D3D12Timeline::~D3D12Timeline() {
+	if (m_Event)
+		CloseHandle(m_Event);
+}
+
+void D3D12Timeline::Init(ID3D12Device* device) {
+	Reset();
+	HR(device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_Fence)), "CreateFence");
+	m_Event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+}
+
+uint64_t D3D12Timeline::Signal(ID3D12CommandQueue* queue) {
+	uint64_t value = m_NextValue++;
+	HR(queue->Signal(m_Fence.Get(), value), "Signal fence");
+	return value;
+}
+
+void D3D12Timeline::GpuWait(ID3D12CommandQueue* queue, uint64_t value) {
+	if (!IsComplete(value))
+		HR(queue->Wait(m_Fence.Get(), value), "Wait fence");
+}
+
+void D3D12Timeline::Wait(uint64_t value) {
+	if (IsComplete(value))
+		return;
+	HR(m_Fence->SetEventOnCompletion(value, m_Event), "Set event");
+	WaitForSingleObjectEx(m_Event, INFINITE, FALSE);
+	GetCompletedValue();
+}
+
+uint64_t D3D12Timeline::PollCompleted() {
+	uint64_t completed = m_Fence->GetCompletedValue();
+	//a removed device reports UINT64_MAX, keep the last good value
+	return completed == UINT64_MAX ? m_CompletedValue : completed;
+}
+
+void D3D12Timeline::WaitAll(ID3D12Device1* device, D3D12Timeline* const* timelines, const uint64_t* values, uint32_t count) {
+	std::vector<ID3D12Fence*> fences;
+	std::vector<uint64_t> fenceValues;
+	for (uint32_t i = 0; i < count; ++i) {
+		if (timelines[i]->IsComplete(values[i]))
+			continue;
+		fences.push_back(timelines[i]->m_Fence.Get());
+		fenceValues.push_back(values[i]);
+	}
+	if (fences.empty())
+		return;
+	if (fences.size() == 1) {
+		for (uint32_t i = 0; i < count; ++i)
+			if (timelines[i]->m_Fence.Get() == fences[0])
+				timelines[i]->Wait(fenceValues[0]);
+		return;
+	}
+	HANDLE event = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	HR(device->SetEventOnMultipleFenceCompletion(fences.data(), fenceValues.data(), (UINT)fences.size(), D3D12_MULTIPLE_FENCE_WAIT_FLAG_ALL, event), "Set event on multiple fences");
+	WaitForSingleObjectEx(event, INFINITE, FALSE);
+	CloseHandle(event);
+	for (uint32_t i = 0; i < count; ++i)
+		timelines[i]->GetCompletedValue();
+}
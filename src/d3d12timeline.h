@@ -0,0 +1,30 @@
+#pragma once
+#include <dx/d3d12_1.h>
+#include <wrl/client.h>
+#include <stdint.h>
+#include "timeline.h"
+using Microsoft::WRL::ComPtr;
+#define HR(x, s) if(x != S_OK) {MessageBoxA(nullptr, s, "Failure", MB_OK);}
+
+//Timeline of a D3D12 queue, backed by a fence and an event to block on.
+class D3D12Timeline : public Timeline {
+public:
+	D3D12Timeline(){}
+	~D3D12Timeline();
+
+	void Init(ID3D12Device* device);
+	//signals the next point from queue and returns it
+	uint64_t Signal(ID3D12CommandQueue* queue);
+	//makes queue wait on the gpu until value is reached, the cpu does not block
+	void GpuWait(ID3D12CommandQueue* queue, uint64_t value);
+	void Wait(uint64_t value) override;
+	ID3D12Fence* GetFence() const { return m_Fence.Get(); }
+
+	//blocks until every timeline has reached its value with a single wait
+	static void WaitAll(ID3D12Device1* device, D3D12Timeline* const* timelines, const uint64_t* values, uint32_t count);
+protected:
+	uint64_t PollCompleted() override;
+private:
+	ComPtr<ID3D12Fence> m_Fence;
+	HANDLE m_Event = nullptr;
+};
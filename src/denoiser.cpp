@@ -0,0 +1,201 @@
+#include "denoiser.h"
+#include <emmintrin.h>
+#include <math.h>
+#include <string.h>
+#include <future>
+
+//B3 spline, the a-trous kernel in each direction
+static const float s_Kernel[5] = { 1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f };
+//albedo below this is treated as white so demodulation never divides by zero
+static const float s_MinAlbedo = 1e-3f;
+//lets pixels without a variance estimate still filter with near equal neighbours
+static const float s_MinSigma = 1e-2f;
+
+static inline __m128 Abs(__m128 x) {
+	return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+}
+
+static inline __m128 Luminance(__m128 r, __m128 g, __m128 b) {
+	return _mm_add_ps(_mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(0.2126f)), _mm_mul_ps(g, _mm_set1_ps(0.7152f))), _mm_mul_ps(b, _mm_set1_ps(0.0722f)));
+}
+
+//e^x for x <= 0: 2^(x log2 e) with the integer part in the exponent bits and the fraction as a polynomial
+static inline __m128 ExpNegative(__m128 x) {
+	__m128 t = _mm_mul_ps(_mm_max_ps(x, _mm_set1_ps(-80.0f)), _mm_set1_ps(1.44269504f));
+	__m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(t));
+	//truncation rounds negative values up, step back one where it did
+	__m128 whole = _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, t), _mm_set1_ps(1.0f)));
+	__m128 f = _mm_sub_ps(t, whole);
+	__m128 p = _mm_add_ps(_mm_mul_ps(f, _mm_set1_ps(0.0096181f)), _mm_set1_ps(0.0555041f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.2402265f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(0.6931472f));
+	p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.0f));
+	__m128i exponent = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(whole), _mm_set1_epi32(127)), 23);
+	return _mm_mul_ps(p, _mm_castsi128_ps(exponent));
+}
+
+void Denoiser::Init(ThreadPool* pool, uint32_t iterations) {
+	m_Pool = pool;
+	m_Iterations = iterations < DENOISE_MAX_ITERATIONS ? iterations : DENOISE_MAX_ITERATIONS;
+}
+
+void Denoiser::SetWeights(float sigmaColor, uint32_t normalPower, float sigmaDepth) {
+	m_SigmaColor = sigmaColor;
+	m_NormalPower = normalPower;
+	m_SigmaDepth = sigmaDepth;
+}
+
+void Denoiser::Resize(uint32_t width, uint32_t height) {
+	//the widest pass reads two steps of 2^(iterations - 1) away, rows are rounded up to whole quads
+	m_Padding = 1 << m_Iterations;
+	m_Width = width;
+	m_Height = height;
+	m_Stride = (width + 2 * m_Padding + 4 + 3) & ~3u;
+	size_t size = (size_t)m_Stride * (height + 2 * m_Padding);
+	for (auto& plane : m_Planes)
+		plane.resize(size);
+}
+
+void Denoiser::PadPlane(uint32_t plane) {
+	//clamp to edge, the filter never has to test coordinates
+	for (int32_t y = 0; y < (int32_t)m_Height; ++y) {
+		float* row = Row(plane, y);
+		for (int32_t x = -m_Padding; x < 0; ++x)
+			row[x] = row[0];
+		for (int32_t x = m_Width; x < (int32_t)(m_Stride - m_Padding); ++x)
+			row[x] = row[m_Width - 1];
+	}
+	size_t rowBytes = m_Stride * sizeof(float);
+	for (int32_t y = 1; y <= m_Padding; ++y) {
+		memcpy(Row(plane, -y) - m_Padding, Row(plane, 0) - m_Padding, rowBytes);
+		memcpy(Row(plane, m_Height - 1 + y) - m_Padding, Row(plane, m_Height - 1) - m_Padding, rowBytes);
+	}
+}
+
+void Denoiser::FilterRows(uint32_t source, uint32_t target, int32_t step, uint32_t firstRow, uint32_t lastRow) {
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 depthScale = _mm_set1_ps(-1.0f / (m_SigmaDepth * step));
+	//every edge-stopping weight is one at the center
+	const __m128 centerWeight = _mm_set1_ps(s_Kernel[2] * s_Kernel[2]);
+	for (uint32_t y = firstRow; y < lastRow; ++y) {
+		const float* rowR = Row(source + 0, y);
+		const float* rowG = Row(source + 1, y);
+		const float* rowB = Row(source + 2, y);
+		const float* rowNX = Row(PLANE_NX, y);
+		const float* rowNY = Row(PLANE_NY, y);
+		const float* rowNZ = Row(PLANE_NZ, y);
+		const float* rowDepth = Row(PLANE_DEPTH, y);
+		const float* rowSigma = Row(PLANE_SIGMA, y);
+		float* outR = Row(target + 0, y);
+		float* outG = Row(target + 1, y);
+		float* outB = Row(target + 2, y);
+		for (uint32_t x = 0; x < m_Width; x += 4) {
+			__m128 r = _mm_loadu_ps(rowR + x);
+			__m128 g = _mm_loadu_ps(rowG + x);
+			__m128 b = _mm_loadu_ps(rowB + x);
+			__m128 luminance = Luminance(r, g, b);
+			__m128 nx = _mm_loadu_ps(rowNX + x);
+			__m128 ny = _mm_loadu_ps(rowNY + x);
+			__m128 nz = _mm_loadu_ps(rowNZ + x);
+			__m128 depth = _mm_loadu_ps(rowDepth + x);
+			__m128 colorScale = _mm_div_ps(_mm_set1_ps(-1.0f), _mm_loadu_ps(rowSigma + x));
+
+			__m128 sumWeight = centerWeight;
+			__m128 sumR = _mm_mul_ps(r, centerWeight);
+			__m128 sumG = _mm_mul_ps(g, centerWeight);
+			__m128 sumB = _mm_mul_ps(b, centerWeight);
+			for (int32_t dy = -2; dy <= 2; ++dy) {
+				int32_t qy = (int32_t)y + dy * step;
+				const float* qRowR = Row(source + 0, qy);
+				const float* qRowG = Row(source + 1, qy);
+				const float* qRowB = Row(source + 2, qy);
+				const float* qRowNX = Row(PLANE_NX, qy);
+				const float* qRowNY = Row(PLANE_NY, qy);
+				const float* qRowNZ = Row(PLANE_NZ, qy);
+				const float* qRowDepth = Row(PLANE_DEPTH, qy);
+				for (int32_t dx = -2; dx <= 2; ++dx) {
+					if (dx == 0 && dy == 0)
+						continue;
+					int32_t qx = (int32_t)x + dx * step;
+					__m128 qr = _mm_loadu_ps(qRowR + qx);
+					__m128 qg = _mm_loadu_ps(qRowG + qx);
+					__m128 qb = _mm_loadu_ps(qRowB + qx);
+					__m128 exponent = _mm_add_ps(_mm_mul_ps(Abs(_mm_sub_ps(Luminance(qr, qg, qb), luminance)), colorScale),
+						_mm_mul_ps(Abs(_mm_sub_ps(_mm_loadu_ps(qRowDepth + qx), depth)), depthScale));
+					__m128 normalWeight = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_loadu_ps(qRowNX + qx)), _mm_mul_ps(ny, _mm_loadu_ps(qRowNY + qx))), _mm_mul_ps(nz, _mm_loadu_ps(qRowNZ + qx)));
+					normalWeight = _mm_max_ps(normalWeight, zero);
+					for (uint32_t i = 0; i < m_NormalPower; ++i)
+						normalWeight = _mm_mul_ps(normalWeight, normalWeight);
+					__m128 weight = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(s_Kernel[dx + 2] * s_Kernel[dy + 2]), ExpNegative(exponent)), normalWeight);
+					sumWeight = _mm_add_ps(sumWeight, weight);
+					sumR = _mm_add_ps(sumR, _mm_mul_ps(qr, weight));
+					sumG = _mm_add_ps(sumG, _mm_mul_ps(qg, weight));
+					sumB = _mm_add_ps(sumB, _mm_mul_ps(qb, weight));
+				}
+			}
+			__m128 invWeight = _mm_div_ps(_mm_set1_ps(1.0f), sumWeight);
+			_mm_storeu_ps(outR + x, _mm_mul_ps(sumR, invWeight));
+			_mm_storeu_ps(outG + x, _mm_mul_ps(sumG, invWeight));
+			_mm_storeu_ps(outB + x, _mm_mul_ps(sumB, invWeight));
+		}
+	}
+}
+
+void Denoiser::Denoise(uint32_t width, uint32_t height, const DenoiseChannel& color, const DenoiseChannel& variance,
+	const DenoiseChannel& normal, const DenoiseChannel& depth, const DenoiseChannel& albedo, float* output) {
+	Resize(width, height);
+	//demodulate and split into planes
+	for (uint32_t y = 0; y < height; ++y) {
+		for (uint32_t x = 0; x < width; ++x) {
+			size_t i = (size_t)y * width + x;
+			const float* c = color.data + i * color.stride;
+			const float* a = albedo.data + i * albedo.stride;
+			const float* n = normal.data + i * normal.stride;
+			for (uint32_t k = 0; k < 3; ++k) {
+				Row(PLANE_R + k, y)[x] = c[k] / (a[k] > s_MinAlbedo ? a[k] : 1.0f);
+				Row(PLANE_NX + k, y)[x] = n[k];
+			}
+			Row(PLANE_DEPTH, y)[x] = depth.data[i * depth.stride];
+			float v = variance.data[i * variance.stride];
+			Row(PLANE_SIGMA, y)[x] = m_SigmaColor * sqrtf(v > 0.0f ? v : 0.0f) + s_MinSigma;
+		}
+	}
+	for (uint32_t plane = 0; plane < PLANE_COUNT; ++plane)
+		if (plane < PLANE_FILTERED_R || plane > PLANE_FILTERED_B)
+			PadPlane(plane);
+
+	uint32_t bandCount = m_Pool ? m_Pool->GetThreadCount() * 2 : 1;
+	uint32_t bandRows = (height + bandCount - 1) / bandCount;
+	uint32_t source = PLANE_R;
+	uint32_t target = PLANE_FILTERED_R;
+	for (uint32_t iteration = 0; iteration < m_Iterations; ++iteration) {
+		int32_t step = 1 << iteration;
+		if (m_Pool) {
+			std::vector<std::future<void>> bands;
+			for (uint32_t first = 0; first < height; first += bandRows) {
+				uint32_t last = first + bandRows < height ? first + bandRows : height;
+				bands.push_back(m_Pool->Submit([this, source, target, step, first, last]() { FilterRows(source, target, step, first, last); }));
+			}
+			for (auto& band : bands)
+				band.get();
+		}
+		else {
+			FilterRows(source, target, step, 0, height);
+		}
+		for (uint32_t k = 0; k < 3; ++k)
+			PadPlane(target + k);
+		uint32_t previous = source;
+		source = target;
+		target = previous;
+	}
+
+	//remodulate
+	for (uint32_t y = 0; y < height; ++y) {
+		for (uint32_t x = 0; x < width; ++x) {
+			size_t i = (size_t)y * width + x;
+			const float* a = albedo.data + i * albedo.stride;
+			for (uint32_t k = 0; k < 3; ++k)
+				output[i * 3 + k] = Row(source + k, y)[x] * (a[k] > s_MinAlbedo ? a[k] : 1.0f);
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "threadpool.h"
+#define DENOISE_ITERATIONS 5
+//the padding around the planes is 2^iterations pixels
+#define DENOISE_MAX_ITERATIONS 8
+
+//a per pixel input, stride floats apart, components consecutive
+struct DenoiseChannel {
+	const float* data = nullptr;
+	uint32_t stride = 0;
+};
+
+//Edge-avoiding a-trous wavelet filter on the cpu (Dammertz et al. 2010, with SVGF's variance-guided luminance weight).
+//Color is divided by albedo before filtering and multiplied back after, so only lighting is smoothed;
+//normal and depth stop the filter at geometric edges. Every pass widens the 5x5 kernel's step by two.
+//Channels are kept in separate padded planes so SSE filters four pixels at once, row bands run on the pool.
+class Denoiser {
+public:
+	Denoiser(){}
+	~Denoiser(){}
+
+	//iterations are clamped to DENOISE_MAX_ITERATIONS
+	void Init(ThreadPool* pool, uint32_t iterations);
+	//sigmaColor scales the luminance standard deviation, normalPower is log2 of the normal weight's exponent
+	void SetWeights(float sigmaColor, uint32_t normalPower, float sigmaDepth);
+	//color, normal and albedo have 3 components, depth and variance 1, variance is the color's luminance variance
+	//output is rgb, width * height * 3 floats, blocks until the pool has filtered every pass
+	//so it must not be called from a job on that pool
+	void Denoise(uint32_t width, uint32_t height, const DenoiseChannel& color, const DenoiseChannel& variance,
+		const DenoiseChannel& normal, const DenoiseChannel& depth, const DenoiseChannel& albedo, float* output);
+private:
+	enum PlaneIndex {
+		PLANE_R, PLANE_G, PLANE_B,
+		PLANE_FILTERED_R, PLANE_FILTERED_G, PLANE_FILTERED_B,
+		PLANE_NX, PLANE_NY, PLANE_NZ,
+		PLANE_DEPTH, PLANE_SIGMA,
+		PLANE_COUNT
+	};
+	float* Row(uint32_t plane, int32_t y) { return m_Planes[plane].data() + (size_t)(y + m_Padding) * m_Stride + m_Padding; }
+	void Resize(uint32_t width, uint32_t height);
+	void PadPlane(uint32_t plane);
+	void FilterRows(uint32_t source, uint32_t target, int32_t step, uint32_t firstRow, uint32_t lastRow);
+
+	ThreadPool* m_Pool = nullptr;
+	uint32_t m_Iterations = DENOISE_ITERATIONS;
+	float m_SigmaColor = 4.0f;
+	uint32_t m_NormalPower = 7;
+	float m_SigmaDepth = 1.0f;
+	uint32_t m_Width = 0;
+	uint32_t m_Height = 0;
+	uint32_t m_Stride = 0;
+	int32_t m_Padding = 0;
+	std::vector<float> m_Planes[PLANE_COUNT];
+};
@@ -0,0 +1,90 @@
+#include "descriptorallocator.h"
+#include <dx/d3dx12.h>
+
+void DescriptorAllocator::Init(ID3D12Device* device, uint32_t pageSize) {
+	m_Device = device;
+	m_DescSize = m_Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	m_PageSize = pageSize;
+	AddStagingPage();
+	Flush(0);
+}
+
+void DescriptorAllocator::AddStagingPage() {
+	D3D12_DESCRIPTOR_HEAP_DESC descHeapDesc = {};
+	descHeapDesc.NodeMask = 0;
+	descHeapDesc.NumDescriptors = m_PageSize;
+	descHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+	descHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
+	ComPtr<ID3D12DescriptorHeap> page;
+	HR(m_Device->CreateDescriptorHeap(&descHeapDesc, IID_PPV_ARGS(&page)), "CreateDescriptorHeap");
+	m_StagingPages.push_back(page);
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE DescriptorAllocator::GetStagingHandle(uint32_t index) const {
+	ID3D12DescriptorHeap* page = m_StagingPages[index / m_PageSize].Get();
+	return CD3DX12_CPU_DESCRIPTOR_HANDLE(page->GetCPUDescriptorHandleForHeapStart(), index % m_PageSize, m_DescSize);
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE DescriptorAllocator::GetGPUHandle(uint32_t index) const {
+	return CD3DX12_GPU_DESCRIPTOR_HANDLE(m_Heap->GetGPUDescriptorHandleForHeapStart(), index, m_DescSize);
+}
+
+uint32_t DescriptorAllocator::AllocatePersistent(D3D12_CPU_DESCRIPTOR_HANDLE* stagingHandle) {
+	uint32_t index;
+	if (!m_FreeList.empty()) {
+		index = m_FreeList.back();
+		m_FreeList.pop_back();
+	} else {
+		if (m_PersistentCount == m_StagingPages.size() * m_PageSize)
+			AddStagingPage();
+		index = m_PersistentCount++;
+	}
+	*stagingHandle = GetStagingHandle(index);
+	m_Dirty.push_back(index);
+	return index;
+}
+
+void DescriptorAllocator::FreePersistent(uint32_t index, uint64_t fenceValue) {
+	if (index == INVALID_INDEX)
+		return;
+	m_DeferredFrees.push_back({ fenceValue, index });
+}
+
+void DescriptorAllocator::Reclaim(uint64_t completedFenceValue) {
+	while (!m_DeferredFrees.empty() && m_DeferredFrees.front().fenceValue <= completedFenceValue) {
+		m_FreeList.push_back(m_DeferredFrees.front().index);
+		m_DeferredFrees.pop_front();
+	}
+	while (!m_RetiredHeaps.empty() && m_RetiredHeaps.front().fenceValue <= completedFenceValue) {
+		m_RetiredHeaps.pop_front();
+	}
+}
+
+void DescriptorAllocator::Flush(uint64_t fenceValue) {
+	uint32_t required = (uint32_t)m_StagingPages.size() * m_PageSize;
+	if (m_Capacity < required) {
+		D3D12_DESCRIPTOR_HEAP_DESC descHeapDesc = {};
+		descHeapDesc.NodeMask = 0;
+		descHeapDesc.NumDescriptors = required;
+		descHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
+		descHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
+		ComPtr<ID3D12DescriptorHeap> heap;
+		HR(m_Device->CreateDescriptorHeap(&descHeapDesc, IID_PPV_ARGS(&heap)), "CreateDescriptorHeap");
+		if (m_Heap)
+			m_RetiredHeaps.push_back({ fenceValue, m_Heap });
+		m_Heap = heap;
+		m_Capacity = required;
+		//a new heap gets every descriptor, the staging pages are the only source of truth
+		for (uint32_t p = 0; p < m_StagingPages.size(); ++p) {
+			CD3DX12_CPU_DESCRIPTOR_HANDLE dst(m_Heap->GetCPUDescriptorHandleForHeapStart(), p * m_PageSize, m_DescSize);
+			m_Device->CopyDescriptorsSimple(m_PageSize, dst, m_StagingPages[p]->GetCPUDescriptorHandleForHeapStart(), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+		}
+		m_Dirty.clear();
+		return;
+	}
+	for (uint32_t index : m_Dirty) {
+		CD3DX12_CPU_DESCRIPTOR_HANDLE dst(m_Heap->GetCPUDescriptorHandleForHeapStart(), index, m_DescSize);
+		m_Device->CopyDescriptorsSimple(1, dst, GetStagingHandle(index), D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	}
+	m_Dirty.clear();
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <dx/d3d12_1.h>
+#include <wrl/client.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+using Microsoft::WRL::ComPtr;
+#define HR(x, s) if(x != S_OK) {MessageBoxA(nullptr, s, "Failure", MB_OK);}
+
+//Shader visible CBV/SRV/UAV heap with free-list allocation, freed descriptors are recycled by fence.
+//Descriptors are written to cpu only staging pages and copied to the shader visible heap on Flush,
+//which lets the heap grow a page at a time while keeping every index stable.
+class DescriptorAllocator {
+public:
+	static const uint32_t INVALID_INDEX = ~0u;
+
+	DescriptorAllocator(){}
+	~DescriptorAllocator(){}
+
+	void Init(ID3D12Device* device, uint32_t pageSize);
+
+	//returns the index in the shader visible heap, the view should be created at stagingHandle
+	uint32_t AllocatePersistent(D3D12_CPU_DESCRIPTOR_HANDLE* stagingHandle);
+	void FreePersistent(uint32_t index, uint64_t fenceValue);
+
+	void Reclaim(uint64_t completedFenceValue);
+
+	//grows the shader visible heap if needed and publishes new descriptors. call before binding the heap,
+	//when the heap was recreated the old one is kept alive until fenceValue has completed
+	void Flush(uint64_t fenceValue);
+
+	ID3D12DescriptorHeap* GetHeap() const { return m_Heap.Get(); }
+	D3D12_GPU_DESCRIPTOR_HANDLE GetGPUHandle(uint32_t index) const;
+private:
+	D3D12_CPU_DESCRIPTOR_HANDLE GetStagingHandle(uint32_t index) const;
+	void AddStagingPage();
+
+	struct DeferredFree {
+		uint64_t fenceValue;
+		uint32_t index;
+	};
+	struct RetiredHeap {
+		uint64_t fenceValue;
+		ComPtr<ID3D12DescriptorHeap> heap;
+	};
+	ID3D12Device* m_Device = nullptr;
+	ComPtr<ID3D12DescriptorHeap> m_Heap;
+	std::vector<ComPtr<ID3D12DescriptorHeap>> m_StagingPages;
+	uint32_t m_DescSize = 0;
+	uint32_t m_PageSize = 0;
+	uint32_t m_Capacity = 0;
+	uint32_t m_PersistentCount = 0; //high water mark
+	std::vector<uint32_t> m_FreeList;
+	std::vector<uint32_t> m_Dirty;
+	std::deque<DeferredFree> m_DeferredFrees;
+	std::deque<RetiredHeap> m_RetiredHeaps;
+};
@@ -0,0 +1,63 @@
+#include "dirtyregion.h"
+#include <algorithm>
+#include <math.h>
+
+//a sample may sit anywhere in its pixel once jittered, so edges grow by a pixel
+static const int32_t s_Margin = 1;
+
+//pixel range a world interval maps to along one axis, empty if min > max
+static void ProjectAxis(float boundsMin, float boundsMax, float viewMin, float viewMax, uint32_t size, int32_t* pixelMin, int32_t* pixelMax) {
+	float extent = viewMax - viewMin;
+	if (extent == 0.0f) {
+		//every pixel sees the same coordinate
+		bool inside = boundsMin <= viewMin && viewMin <= boundsMax;
+		*pixelMin = inside ? 0 : 1;
+		*pixelMax = inside ? (int32_t)size : 0;
+		return;
+	}
+	float u0 = (boundsMin - viewMin) / extent;
+	float u1 = (boundsMax - viewMin) / extent;
+	if (u0 > u1)
+		std::swap(u0, u1);
+	*pixelMin = (int32_t)floorf(std::max(u0, -1.0f) * size) - s_Margin;
+	*pixelMax = (int32_t)ceilf(std::min(u1, 2.0f) * size) + s_Margin;
+}
+
+void DirtyRegion::Init(uint32_t width, uint32_t height, uint32_t tileSize) {
+	m_Width = width;
+	m_Height = height;
+	m_TileSize = tileSize;
+	m_TilesX = (width + tileSize - 1) / tileSize;
+	m_TilesY = (height + tileSize - 1) / tileSize;
+	m_Mask.assign(m_TilesX * m_TilesY, 0);
+	m_DirtyTiles = 0;
+}
+
+void DirtyRegion::AddWorldBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec4& viewport) {
+	//rays run along z, depth never moves a box on screen
+	ScreenRect rect;
+	ProjectAxis(boundsMin.x, boundsMax.x, viewport.x, viewport.z, m_Width, &rect.minX, &rect.maxX);
+	ProjectAxis(boundsMin.y, boundsMax.y, viewport.y, viewport.w, m_Height, &rect.minY, &rect.maxY);
+	AddRect(rect);
+}
+
+void DirtyRegion::AddRect(const ScreenRect& rect) {
+	int32_t minX = std::max(rect.minX, 0);
+	int32_t minY = std::max(rect.minY, 0);
+	int32_t maxX = std::min(rect.maxX, (int32_t)m_Width);
+	int32_t maxY = std::min(rect.maxY, (int32_t)m_Height);
+	if (minX >= maxX || minY >= maxY)
+		return;
+	for (uint32_t ty = minY / m_TileSize; ty <= (uint32_t)(maxY - 1) / m_TileSize; ++ty) {
+		for (uint32_t tx = minX / m_TileSize; tx <= (uint32_t)(maxX - 1) / m_TileSize; ++tx) {
+			uint32_t& tile = m_Mask[ty * m_TilesX + tx];
+			m_DirtyTiles += tile ? 0 : 1;
+			tile = 1;
+		}
+	}
+}
+
+void DirtyRegion::Clear() {
+	std::fill(m_Mask.begin(), m_Mask.end(), 0u);
+	m_DirtyTiles = 0;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+//pixel rectangle, max exclusive
+struct ScreenRect {
+	int32_t minX = 0;
+	int32_t minY = 0;
+	int32_t maxX = 0;
+	int32_t maxY = 0;
+};
+
+//Screen tiles that changed since the last traced frame.
+//World bounds are projected through the raygen's orthographic viewport, which maps pixel u in [0, 1]
+//to viewport.x + (viewport.z - viewport.x) * u, so a box covers the pixels its x and y range maps back to.
+//Only valid for pipelines whose pixels depend on primary visibility alone, secondary rays reach outside the box.
+class DirtyRegion {
+public:
+	DirtyRegion(){}
+	~DirtyRegion(){}
+
+	void Init(uint32_t width, uint32_t height, uint32_t tileSize);
+	//viewport is the raygen's topLeft and bottomRight as x, y, z, w
+	void AddWorldBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::vec4& viewport);
+	void AddRect(const ScreenRect& rect);
+	void Clear();
+
+	bool IsEmpty() const { return m_DirtyTiles == 0; }
+	uint32_t GetDirtyTileCount() const { return m_DirtyTiles; }
+	uint32_t GetTileCount() const { return (uint32_t)m_Mask.size(); }
+	//one uint per tile, non-zero is dirty, laid out like AdaptiveSampler's mask
+	const std::vector<uint32_t>& GetTileMask() const { return m_Mask; }
+private:
+	uint32_t m_Width = 0;
+	uint32_t m_Height = 0;
+	uint32_t m_TileSize = 1;
+	uint32_t m_TilesX = 0;
+	uint32_t m_TilesY = 0;
+	uint32_t m_DirtyTiles = 0;
+	std::vector<uint32_t> m_Mask;
+};
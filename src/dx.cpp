@@ -2,48 +2,29 @@
 #include <glm\glm.hpp>
 #define PAR_SHAPES_IMPLEMENTATION
 #include <par_shapes.h>
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <memory>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
 #include <vector>
-static const D3D12_HEAP_PROPERTIES uploadHeapProps = {
-	D3D12_HEAP_TYPE_UPLOAD,
-	D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
-	D3D12_MEMORY_POOL_UNKNOWN,
-	0,
-	0,
-};
-
-static const D3D12_HEAP_PROPERTIES defaultHeapProps = {
-	D3D12_HEAP_TYPE_DEFAULT,
-	D3D12_CPU_PAGE_PROPERTY_UNKNOWN,
-	D3D12_MEMORY_POOL_UNKNOWN,
-	0,
-	0,
-};
-
-void CreateBuffer(ID3D12Device* device, uint64_t size, D3D12_RESOURCE_FLAGS flags, D3D12_RESOURCE_STATES state, D3D12_HEAP_PROPERTIES heap, ComPtr<ID3D12Resource>& resourceOut) {
-	D3D12_RESOURCE_DESC bufDesc = {};
-	bufDesc.Alignment = 0;
-	bufDesc.DepthOrArraySize = 1;
-	bufDesc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-	bufDesc.Flags = flags;
-	bufDesc.Format = DXGI_FORMAT_UNKNOWN;
-	bufDesc.Height = 1;
-	bufDesc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-	bufDesc.MipLevels = 1;
-	bufDesc.SampleDesc.Count = 1;
-	bufDesc.SampleDesc.Quality = 0;
-	bufDesc.Width = size;
-	HR(device->CreateCommittedResource(&heap, D3D12_HEAP_FLAG_NONE, &bufDesc, state, nullptr, IID_PPV_ARGS(&resourceOut)), "Create Commited resource");
-}
 
 UINT DXEngine::AllocateDescriptor(D3D12_CPU_DESCRIPTOR_HANDLE* cpuDescriptor)
 {
-	auto descriptorHeapCpuBase = m_CBVSRVUAVHeap->GetCPUDescriptorHandleForHeapStart();
-	UINT index = m_AllocatedDescriptors++;
-	*cpuDescriptor = CD3DX12_CPU_DESCRIPTOR_HANDLE(descriptorHeapCpuBase, index, m_DescSize);
-	return index;
+	return m_Descriptors.AllocatePersistent(cpuDescriptor);
+}
+
+void DXEngine::FreeASBuffer(ASBuffer& buffer) {
+	if (buffer.result.resource)
+		m_ASPool.Free(buffer.result, m_FrameTimeline.GetNextValue());
+	buffer.result = PooledBuffer();
+	m_Descriptors.FreePersistent(buffer.descriptor, m_FrameTimeline.GetNextValue());
+	buffer.descriptor = DescriptorAllocator::INVALID_INDEX;
 }
 
-WRAPPED_GPU_POINTER DXEngine::CreateWrappedPointer(ID3D12RaytracingFallbackDevice* rtdevice,  ID3D12Resource* resource, UINT bufferNumElements)
+WRAPPED_GPU_POINTER DXEngine::CreateWrappedPointer(ID3D12RaytracingFallbackDevice* rtdevice,  ID3D12Resource* resource, UINT bufferNumElements, uint32_t* descriptorIndex)
 {
 
 	D3D12_UNORDERED_ACCESS_VIEW_DESC rawBufferUavDesc = {};
@@ -60,6 +41,7 @@ WRAPPED_GPU_POINTER DXEngine::CreateWrappedPointer(ID3D12RaytracingFallbackDevic
 	{
 		descriptorHeapIndex = AllocateDescriptor(&bottomLevelDescriptor);
 		m_Device->CreateUnorderedAccessView(resource, nullptr, &rawBufferUavDesc, bottomLevelDescriptor);
+		*descriptorIndex = descriptorHeapIndex;
 	}
 	WRAPPED_GPU_POINTER gpu_pointer = rtdevice->GetWrappedPointerSimple(descriptorHeapIndex, resource->GetGPUVirtualAddress());
 	return gpu_pointer;
@@ -72,26 +54,264 @@ void DXEngine::ExecuteCommandList() {
 }
 
 void DXEngine::WaitForGPU() {
-	if (m_CmdQueue && m_SwapFence)
+	if (!m_CmdQueue)
+		return;
+	uint64_t fenceValue = m_FrameTimeline.GetNextValue();
+	m_UploadRing.Retire(fenceValue);
+	m_FrameTimeline.Signal(m_CmdQueue.Get());
+	m_FrameTimeline.Wait(fenceValue);
+	ReclaimCompleted(fenceValue);
+}
+
+void DXEngine::ReclaimCompleted(uint64_t completedFenceValue) {
+	m_UploadRing.Reclaim(completedFenceValue);
+	m_ASPool.Reclaim(completedFenceValue);
+	m_Descriptors.Reclaim(completedFenceValue);
+	m_ShaderTable.Reclaim(completedFenceValue);
+	m_Pipelines.Reclaim(completedFenceValue);
+	m_DirectLists.Reclaim(completedFenceValue);
+}
+
+void DXEngine::BeginFrame() {
+	m_FrameIndex = (m_FrameIndex + 1) % m_FrameCount;
+	FrameContext& frame = m_Frames[m_FrameIndex];
+	//only stalls once the cpu is m_FrameCount frames ahead of the gpu
+	auto waitStart = std::chrono::high_resolution_clock::now();
 	{
-		// Schedule a Signal command in the GPU queue.
-		UINT64 fenceValue = m_SwapFenceValue[m_CurrentFrame];
-		if (SUCCEEDED(m_CmdQueue->Signal(m_SwapFence.Get(), fenceValue)))
-		{
-			// Wait until the Signal has been processed.
-			if (SUCCEEDED(m_SwapFence->SetEventOnCompletion(fenceValue, m_SwapEvent)))
-			{
-				WaitForSingleObjectEx(m_SwapEvent, INFINITE, FALSE);
-
-				// Increment the fence value for the current frame.
-				m_SwapFenceValue[m_CurrentFrame]++;
+		PROFILE_SCOPE("WaitForFrame");
+		m_FrameTimeline.Wait(frame.fenceValue);
+	}
+	auto waitEnd = std::chrono::high_resolution_clock::now();
+	m_Stats.waitMs += std::chrono::duration<double, std::milli>(waitEnd - waitStart).count();
+	ReclaimCompleted(m_FrameTimeline.GetCompletedValue());
+	CompleteFrame(m_FrameIndex);
+
+	frame.allocator->Reset();
+	HR(m_CmdList->Reset(frame.allocator.Get(), nullptr), "Reset Command list");
+}
+
+void DXEngine::CompleteFrame(uint32_t frameIndex) {
+	FrameContext& frame = m_Frames[frameIndex];
+	if (!frame.pending)
+		return;
+	frame.pending = false;
+	ReadFrameTimings(frameIndex);
+	m_GpuProfiler.Collect(frameIndex);
+	if (frame.metricsFrame)
+		ReadTraceRateMetrics(frameIndex);
+	if (frame.tileReadback && m_Sampler.IsEnabled()) {
+		D3D12_RANGE readRange = { 0, frame.tileMask.size() * sizeof(uint32_t) };
+		D3D12_RANGE writeRange = { 0, 0 };
+		uint32_t* tileErrors;
+		if (SUCCEEDED(frame.tileReadback->Map(0, &readRange, (void**)&tileErrors))) {
+			m_Sampler.ReadErrors(frame.tileMask, frame.samplerEpoch, tileErrors);
+			frame.tileReadback->Unmap(0, &writeRange);
+		}
+	}
+	if (frame.writeImage)
+		WriteImage(frameIndex);
+}
+
+void DXEngine::RecordReadbackCopies(ID3D12GraphicsCommandList* cmdList, uint32_t frameIndex) {
+	FrameContext& frame = m_Frames[frameIndex];
+	D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_OutputTarget.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+	cmdList->ResourceBarrier(1, &barrier);
+	CD3DX12_TEXTURE_COPY_LOCATION dst(frame.readback.Get(), m_ReadbackFootprint);
+	CD3DX12_TEXTURE_COPY_LOCATION src(m_OutputTarget.Get(), 0);
+	cmdList->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+	barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_OutputTarget.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	cmdList->ResourceBarrier(1, &barrier);
+	if (frame.denoiseReadback) {
+		D3D12_RESOURCE_BARRIER barriers[2];
+		barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(m_Accumulation.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+		barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(m_Auxiliary.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+		cmdList->ResourceBarrier(2, barriers);
+		uint64_t accumSize = (uint64_t)m_Width * m_Height * ACCUM_PIXEL_STRIDE;
+		cmdList->CopyBufferRegion(frame.denoiseReadback.Get(), 0, m_Accumulation.Get(), 0, accumSize);
+		cmdList->CopyBufferRegion(frame.denoiseReadback.Get(), accumSize, m_Auxiliary.Get(), 0, (uint64_t)m_Width * m_Height * AUX_PIXEL_STRIDE);
+		barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(m_Accumulation.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(m_Auxiliary.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		cmdList->ResourceBarrier(2, barriers);
+	}
+}
+
+void DXEngine::WriteImage(uint32_t frameIndex) {
+	FrameContext& frame = m_Frames[frameIndex];
+	if (frame.denoiseReadback) {
+		WriteDenoisedImage(frameIndex);
+	}
+	else {
+		D3D12_RANGE readRange = { 0, (SIZE_T)(m_ReadbackFootprint.Offset + m_ReadbackFootprint.Footprint.RowPitch * m_Height) };
+		D3D12_RANGE writeRange = { 0, 0 };
+		uint8_t* pixels;
+		if (SUCCEEDED(frame.readback->Map(0, &readRange, (void**)&pixels))) {
+			m_ImageWriter.Write(frame.frameNumber, m_Width, m_Height, m_ReadbackFootprint.Footprint.RowPitch, pixels + m_ReadbackFootprint.Offset);
+			frame.readback->Unmap(0, &writeRange);
+		}
+	}
+}
+
+void DXEngine::WriteDenoisedImage(uint32_t frameIndex) {
+	FrameContext& frame = m_Frames[frameIndex];
+	size_t pixelCount = (size_t)m_Width * m_Height;
+	D3D12_RANGE readRange = { 0, pixelCount * (ACCUM_PIXEL_STRIDE + AUX_PIXEL_STRIDE) };
+	D3D12_RANGE writeRange = { 0, 0 };
+	float* data;
+	if (FAILED(frame.denoiseReadback->Map(0, &readRange, (void**)&data)))
+		return;
+	//the readback is reused by a later frame, the job filters a copy
+	std::shared_ptr<std::vector<float>> copy = std::make_shared<std::vector<float>>(data, data + readRange.End / sizeof(float));
+	frame.denoiseReadback->Unmap(0, &writeRange);
+
+	//drop finished jobs, wait for the oldest if the denoiser can not keep up
+	for (size_t i = 0; i < m_PendingDenoise.size();) {
+		if (m_PendingDenoise[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+			m_PendingDenoise[i].get();
+			m_PendingDenoise.erase(m_PendingDenoise.begin() + i);
+		}
+		else {
+			++i;
+		}
+	}
+	if (m_PendingDenoise.size() >= DENOISE_MAX_PENDING) {
+		m_PendingDenoise.front().get();
+		m_PendingDenoise.erase(m_PendingDenoise.begin());
+	}
+	uint64_t frameNumber = frame.frameNumber;
+	uint32_t width = m_Width;
+	uint32_t height = m_Height;
+	m_PendingDenoise.push_back(m_DenoisePool.Submit([this, frameNumber, width, height, copy]() { DenoiseImage(frameNumber, width, height, *copy); }));
+}
+
+void DXEngine::DenoiseImage(uint64_t frameNumber, uint32_t width, uint32_t height, const std::vector<float>& data) {
+	PROFILE_SCOPE("Denoise");
+	size_t pixelCount = (size_t)width * height;
+	//accumulation holds sums, the denoiser takes the mean and the variance of the mean
+	const uint32_t accumStride = ACCUM_PIXEL_STRIDE / sizeof(float);
+	std::vector<float> color(pixelCount * 3);
+	std::vector<float> variance(pixelCount);
+	for (size_t i = 0; i < pixelCount; ++i) {
+		const float* accum = data.data() + i * accumStride;
+		float count = accum[3] > 0.0f ? accum[3] : 1.0f;
+		for (uint32_t k = 0; k < 3; ++k)
+			color[i * 3 + k] = accum[k] / count;
+		float luminance = 0.2126f * color[i * 3 + 0] + 0.7152f * color[i * 3 + 1] + 0.0722f * color[i * 3 + 2];
+		variance[i] = std::max(0.0f, accum[4] / count - luminance * luminance) / count;
+	}
+	const float* aux = data.data() + pixelCount * accumStride;
+	const uint32_t auxStride = AUX_PIXEL_STRIDE / sizeof(float);
+	DenoiseChannel colorChannel = { color.data(), 3 };
+	DenoiseChannel varianceChannel = { variance.data(), 1 };
+	DenoiseChannel normalChannel = { aux, auxStride };
+	DenoiseChannel depthChannel = { aux + 3, auxStride };
+	DenoiseChannel albedoChannel = { aux + 4, auxStride };
+	std::vector<float> filtered(pixelCount * 3);
+	m_Denoiser.Denoise(width, height, colorChannel, varianceChannel, normalChannel, depthChannel, albedoChannel, filtered.data());
+
+	std::vector<uint8_t> pixels(pixelCount * 4);
+	for (size_t i = 0; i < pixelCount; ++i) {
+		for (uint32_t k = 0; k < 3; ++k)
+			pixels[i * 4 + k] = (uint8_t)(std::min(std::max(filtered[i * 3 + k], 0.0f), 1.0f) * 255.0f + 0.5f);
+		pixels[i * 4 + 3] = 255;
+	}
+	m_ImageWriter.Write(frameNumber, width, height, width * 4, pixels.data());
+}
+
+void DXEngine::FlushDenoise() {
+	for (auto& pending : m_PendingDenoise)
+		pending.get();
+	m_PendingDenoise.clear();
+}
+
+void DXEngine::ReadTraceRateMetrics(uint32_t frameIndex) {
+	FrameContext& frame = m_Frames[frameIndex];
+	D3D12_RANGE readRange = { 0, (SIZE_T)(m_ReadbackSize * 2 + sizeof(uint32_t)) };
+	D3D12_RANGE writeRange = { 0, 0 };
+	uint8_t* data;
+	if (FAILED(frame.metricsReadback->Map(0, &readRange, (void**)&data)))
+		return;
+	uint32_t rowPitch = m_ReadbackFootprint.Footprint.RowPitch;
+	const uint8_t* reconstructed = data + m_ReadbackFootprint.Offset;
+	const uint8_t* reference = data + m_ReadbackSize + m_ReadbackFootprint.Offset;
+	uint32_t tracedPixels = *(const uint32_t*)(data + m_ReadbackSize * 2);
+	double squaredError = 0.0;
+	uint64_t wrongPixels = 0;
+	for (uint32_t y = 0; y < m_Height; ++y) {
+		const uint8_t* a = reconstructed + (size_t)y * rowPitch;
+		const uint8_t* b = reference + (size_t)y * rowPitch;
+		for (uint32_t x = 0; x < m_Width; ++x) {
+			int32_t largest = 0;
+			for (uint32_t k = 0; k < 3; ++k) {
+				int32_t d = (int32_t)a[x * 4 + k] - (int32_t)b[x * 4 + k];
+				squaredError += d * d;
+				largest = std::max(largest, abs(d));
 			}
+			wrongPixels += largest > TRACE_RATE_ERROR_THRESHOLD ? 1 : 0;
 		}
 	}
+	frame.metricsReadback->Unmap(0, &writeRange);
+	double pixelCount = (double)m_Width * m_Height;
+	double mse = squaredError / (pixelCount * 3.0);
+	double psnr = mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+	printf("Trace rate %s: %.1f%% of pixels traced, PSNR %.2f dB against full rate, %.2f%% of pixels off by more than %u/255\n",
+		m_TraceRate == TRACE_RATE_CHECKERBOARD ? "checkerboard" : "variable", tracedPixels * 100.0 / pixelCount, psnr, wrongPixels * 100.0 / pixelCount, TRACE_RATE_ERROR_THRESHOLD);
 }
 
-void DXEngine::InitDXR() {
-	//create vbo
+void DXEngine::ReadFrameTimings(uint32_t frameIndex) {
+	FrameContext& frame = m_Frames[frameIndex];
+	//the context's previous frame has completed, so its timestamps are resolved
+	//the dispatch timestamps were only written and resolved if the frame traced
+	uint32_t queryCount = frame.traced ? FRAME_TIMESTAMP_COUNT : 2;
+	D3D12_RANGE readRange = { frame.queryIndex * sizeof(uint64_t), (frame.queryIndex + queryCount) * sizeof(uint64_t) };
+	D3D12_RANGE writeRange = { 0, 0 };
+	uint64_t* timestamps;
+	double frameGpuMs = 0.0;
+	if (SUCCEEDED(m_TimestampReadback->Map(0, &readRange, (void**)&timestamps))) {
+		uint64_t begin = timestamps[frame.queryIndex];
+		uint64_t end = timestamps[frame.queryIndex + 1];
+		uint64_t dispatchBegin = frame.traced ? timestamps[frame.queryIndex + 2] : 0;
+		uint64_t dispatchEnd = frame.traced ? timestamps[frame.queryIndex + 3] : 0;
+		m_TimestampReadback->Unmap(0, &writeRange);
+		if (end > begin) {
+			frameGpuMs = (double)(end - begin) * 1000.0 / (double)m_TimestampFrequency;
+			m_Stats.gpuMs += frameGpuMs;
+			m_Stats.gpuFrames++;
+		}
+		if (dispatchEnd > dispatchBegin) {
+			double dispatchMs = (double)(dispatchEnd - dispatchBegin) * 1000.0 / (double)m_TimestampFrequency;
+			m_Stats.dispatchMs += dispatchMs;
+			m_Stats.dispatchFrames++;
+			m_Resolution.Update(dispatchMs, frame.traceWidth, frame.traceHeight);
+		}
+	}
+	if (m_TimingLog)
+		fprintf(m_TimingLog, "%llu,%.3f,%.3f\n", (unsigned long long)frame.frameNumber, frame.cpuMs, frameGpuMs);
+	m_Stats.cpuMs += frame.cpuMs;
+	m_Stats.frames++;
+
+	if (m_Stats.frames < FRAME_STATS_INTERVAL)
+		return;
+	double frames = (double)m_Stats.frames;
+	double frameMs = m_Stats.frameMs / frames;
+	double gpuMs = m_Stats.gpuFrames > 0 ? m_Stats.gpuMs / m_Stats.gpuFrames : 0.0;
+	double busyMs = frameMs - m_Stats.waitMs / frames;
+	//share of the frame where the cpu and the gpu were both busy
+	double overlap = frameMs > 0.0 ? std::max(0.0, busyMs + gpuMs - frameMs) / frameMs : 0.0;
+	printf("Frames in flight %u: frame %.2f ms, cpu record %.2f ms, cpu stalled %.2f ms, gpu %.2f ms, overlap %.0f%%\n",
+		m_FrameCount, frameMs, m_Stats.cpuMs / frames, m_Stats.waitMs / frames, gpuMs, std::min(overlap, 1.0) * 100.0);
+	if (m_Stats.reusedFrames > 0)
+		printf("Scene unchanged for %u frames, the last traced frame was reused\n", m_Stats.reusedFrames);
+	if (m_Stats.incrementalFrames > 0)
+		printf("Instance edits: %u frames retraced %.1f%% of their tiles on average\n", m_Stats.incrementalFrames,
+			m_Stats.incrementalTiles * 100.0 / ((double)m_Stats.incrementalFrames * m_DirtyRegion.GetTileCount()));
+	if (m_Resolution.IsEnabled() && m_Stats.dispatchFrames > 0)
+		printf("Dynamic resolution: dispatch %.2f ms of %.2f ms budget, tracing %ux%u (%.0f%%)\n",
+			m_Stats.dispatchMs / m_Stats.dispatchFrames, m_FrameBudgetMs, m_Resolution.GetWidth(), m_Resolution.GetHeight(), m_Resolution.GetScale() * 100.0f);
+	m_Stats = FrameStats();
+}
+
+static std::vector<glm::vec3> CreateSphereVertices() {
+	PROFILE_SCOPE("CreateSphereVertices");
 	par_shapes_mesh* sphereMesh = par_shapes_create_subdivided_sphere(3);
 	std::vector<glm::vec3> vertices;
 	for (int t = 0; t < sphereMesh->ntriangles * 3; t += 3) {
@@ -101,140 +321,372 @@ void DXEngine::InitDXR() {
 			vertices.push_back(v);
 		}
 	}
+	par_shapes_free_mesh(sphereMesh);
+	return vertices;
+}
 
-	CreateBuffer(m_Device.Get(), sizeof(glm::vec3) * vertices.size(), D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, uploadHeapProps, m_VBO);
-	uint8_t* pData;
-	m_VBO->Map(0, nullptr, (void**)&pData);
-	memcpy(pData, vertices.data(), sizeof(glm::vec3) * vertices.size());
-	m_VBO->Unmap(0, nullptr);
+//deterministic so runs and their images compare
+static std::vector<glm::vec4> CreateSpheres(uint32_t count) {
+	PROFILE_SCOPE("CreateSpheres");
+	std::vector<glm::vec4> spheres(1, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	for (uint32_t i = 1; i < count; ++i)
+		spheres.push_back(glm::vec4(unit(rng), unit(rng), unit(rng) * 1.5f, 0.03f + 0.02f * unit(rng)));
+	return spheres;
+}
 
-	D3D12CreateRaytracingFallbackDevice(m_Device.Get(), CreateRaytracingFallbackDeviceFlags::None, 0, IID_PPV_ARGS(&m_RTDevice));
-	m_RTDevice->QueryRaytracingCommandList(m_CmdList.Get(), IID_PPV_ARGS(&m_RTCmdList));
-	ID3D12DescriptorHeap *pDescriptorHeaps[] = { m_CBVSRVUAVHeap.Get() };
-	m_RTCmdList->SetDescriptorHeaps(1, pDescriptorHeaps);
-	uint32_t numBuffer = 0;
-	//create blas
-	{
-		D3D12_RAYTRACING_GEOMETRY_DESC geomDesc = {};
-		geomDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
-		geomDesc.Triangles.VertexBuffer.StartAddress = m_VBO->GetGPUVirtualAddress();
-		geomDesc.Triangles.VertexBuffer.StrideInBytes = sizeof(glm::vec3);
-		geomDesc.Triangles.VertexCount = vertices.size();
-		geomDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
-		geomDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
+void DXEngine::Instance::GetWorldBounds(const glm::mat4& m, glm::vec3& worldMin, glm::vec3& worldMax) const {
+	worldMin = glm::vec3(FLT_MAX);
+	worldMax = glm::vec3(-FLT_MAX);
+	for (uint32_t corner = 0; corner < 8; ++corner) {
+		glm::vec3 local((corner & 1) ? boundsMax.x : boundsMin.x, (corner & 2) ? boundsMax.y : boundsMin.y, (corner & 4) ? boundsMax.z : boundsMin.z);
+		glm::vec3 world = glm::vec3(m * glm::vec4(local, 1.0f));
+		worldMin = glm::min(worldMin, world);
+		worldMax = glm::max(worldMax, world);
+	}
+}
 
-		D3D12_GET_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO_DESC prebuildDesc = {};
-		prebuildDesc.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-		prebuildDesc.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
-		prebuildDesc.NumDescs = 1;
-		prebuildDesc.pGeometryDescs = &geomDesc;
-		prebuildDesc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
+void DXEngine::BuildTLAS(ID3D12GraphicsCommandList* cmdList, ID3D12RaytracingFallbackCommandList* rtCmdList) {
+	std::vector<TLASBuild> builds = PrepareTLASBuilds();
+	//publish the wrapped pointers' descriptors before the builds read them
+	m_Descriptors.Flush(m_FrameTimeline.GetNextValue());
+	RecordTLASBuilds(cmdList, rtCmdList, builds);
+}
+
+std::vector<DXEngine::TLASBuild> DXEngine::PrepareTLASBuilds() {
+	PROFILE_SCOPE("PrepareTLASBuilds");
+	std::vector<TLASBuild> builds;
+	std::vector<uint32_t> kept;
+	kept.reserve(m_Instances.size());
+	for (uint32_t tlas = 0; tlas < SCENE_TLAS_COUNT; ++tlas) {
+		FilteredTLAS& target = m_TLAS[tlas];
+		if (!target.enabled)
+			continue;
+		glm::vec3 regionMin = target.filter.regionMin;
+		glm::vec3 regionMax = target.filter.regionMax;
+		//primary rays start on the viewport at z = 0 and travel along +z, nothing outside that box is ever hit
+		if (tlas == SCENE_TLAS_PRIMARY && m_ViewCulling && m_PrimaryVisibilityOnly) {
+			const glm::vec4& viewport = m_RayGenConstants.viewport;
+			regionMin = glm::max(regionMin, glm::vec3(std::min(viewport.x, viewport.z), std::min(viewport.y, viewport.w), 0.0f));
+			regionMax = glm::min(regionMax, glm::vec3(std::max(viewport.x, viewport.z), std::max(viewport.y, viewport.w), PRIMARY_RAY_T_MAX));
+		}
+		kept.clear();
+		for (uint32_t i = 0; i < (uint32_t)m_Instances.size(); ++i) {
+			const Instance& instance = m_Instances[i];
+			if (!(instance.mask & target.filter.includeMask))
+				continue;
+			glm::vec3 worldMin, worldMax;
+			instance.GetWorldBounds(instance.transform, worldMin, worldMax);
+			if (glm::any(glm::lessThan(worldMax, regionMin)) || glm::any(glm::greaterThan(worldMin, regionMax)))
+				continue;
+			kept.push_back(i);
+		}
 
-		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info;
-		m_RTDevice->GetRaytracingAccelerationStructurePrebuildInfo(&prebuildDesc, &info);
-		numBuffer = static_cast<uint32_t>(info.ResultDataMaxSizeInBytes) / sizeof(uint32_t);
-
-		CreateBuffer(m_Device.Get(), info.ScratchDataSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, defaultHeapProps, m_BLAS.scratch);
-		CreateBuffer(m_Device.Get(), info.ResultDataMaxSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, m_RTDevice->GetAccelerationStructureResourceState(), defaultHeapProps, m_BLAS.result);
-
-		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC blasDesc = {};
-		blasDesc.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-		blasDesc.pGeometryDescs = &geomDesc;
-		blasDesc.DestAccelerationStructureData.StartAddress = m_BLAS.result->GetGPUVirtualAddress();
-		blasDesc.DestAccelerationStructureData.SizeInBytes = info.ResultDataMaxSizeInBytes;
-		blasDesc.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
-		blasDesc.NumDescs = 1;
-		blasDesc.ScratchAccelerationStructureData.StartAddress = m_BLAS.scratch->GetGPUVirtualAddress();
-		blasDesc.ScratchAccelerationStructureData.SizeInBytes = info.ScratchDataSizeInBytes;
-		blasDesc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL;
-		
-		m_RTCmdList->BuildRaytracingAccelerationStructure(&blasDesc);
-		m_CmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::UAV(m_BLAS.result.Get()));
-	}
-	//create tlas
-	{
 		D3D12_GET_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO_DESC prebuildDesc = {};
 		prebuildDesc.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
 		prebuildDesc.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
-		prebuildDesc.NumDescs = 1;
+		prebuildDesc.NumDescs = (UINT)kept.size();
 		prebuildDesc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
 
 		D3D12_RAYTRACING_ACCELERATION_STRUCTURE_PREBUILD_INFO info;
 		m_RTDevice->GetRaytracingAccelerationStructurePrebuildInfo(&prebuildDesc, &info);
 
-		CreateBuffer(m_Device.Get(), info.ScratchDataSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, defaultHeapProps, m_TLAS.scratch);
-		CreateBuffer(m_Device.Get(), info.ResultDataMaxSizeInBytes, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, m_RTDevice->GetAccelerationStructureResourceState(), defaultHeapProps, m_TLAS.result);
-		CreateBuffer(m_Device.Get(), sizeof(D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC), D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_GENERIC_READ, uploadHeapProps, m_TLAS.instanceDesc);
-		
-		D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC* instanceDesc;
-		m_TLAS.instanceDesc->Map(0, nullptr, (void**)&instanceDesc);
-		instanceDesc->InstanceID = 0;
-		instanceDesc->InstanceContributionToHitGroupIndex = 0;
-		instanceDesc->Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
-		glm::mat4 m(1);
-		memcpy(instanceDesc->Transform, &m, sizeof(instanceDesc->Transform));
-		WRAPPED_GPU_POINTER gpu_pointer = CreateWrappedPointer(m_RTDevice.Get(), m_BLAS.result.Get(), numBuffer);
-		instanceDesc->AccelerationStructure = gpu_pointer;
-		instanceDesc->InstanceMask = 0xFF;
-		m_TLAS.instanceDesc->Unmap(0, nullptr);
-
-		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC tlasDesc = {};
+		//frames in flight may still trace the old tlas
+		FreeASBuffer(target.buffer);
+		PooledBuffer scratch = m_ASPool.Allocate(info.ScratchDataSizeInBytes, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+		target.buffer.result = m_ASPool.Allocate(info.ResultDataMaxSizeInBytes, m_RTDevice->GetAccelerationStructureResourceState());
+		//an empty tlas is valid, it still gets a desc's worth of upload space
+		UploadAllocation instanceAlloc = m_UploadRing.Allocate(sizeof(D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC) * std::max<size_t>(kept.size(), 1), D3D12_RAYTRACING_INSTANCE_DESCS_BYTE_ALIGNMENT);
+		D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC* instanceDescs = (D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC*)instanceAlloc.cpuAddress;
+		for (uint32_t k = 0; k < (uint32_t)kept.size(); ++k) {
+			const Instance& instance = m_Instances[kept[k]];
+			D3D12_RAYTRACING_FALLBACK_INSTANCE_DESC& instanceDesc = instanceDescs[k];
+			//InstanceID() stays the index into m_Instances whichever instances were dropped
+			instanceDesc.InstanceID = kept[k];
+			instanceDesc.InstanceContributionToHitGroupIndex = instance.hitGroup * m_ShaderTable.GetRayTypeCount();
+			instanceDesc.Flags = D3D12_RAYTRACING_INSTANCE_FLAG_NONE;
+			//3x4 row major, glm is column major
+			glm::mat4 transposed = glm::transpose(instance.transform);
+			memcpy(instanceDesc.Transform, &transposed, sizeof(instanceDesc.Transform));
+			instanceDesc.AccelerationStructure = m_BLASPointer;
+			instanceDesc.InstanceMask = instance.mask;
+		}
+
+		TLASBuild build;
+		build.scratch = scratch.resource;
+		build.result = target.buffer.result.resource;
+		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC& tlasDesc = build.desc;
+		tlasDesc = {};
 		tlasDesc.DescsLayout = D3D12_ELEMENTS_LAYOUT_ARRAY;
-		tlasDesc.InstanceDescs = m_TLAS.instanceDesc->GetGPUVirtualAddress();
-		tlasDesc.DestAccelerationStructureData.StartAddress = m_TLAS.result->GetGPUVirtualAddress();
+		tlasDesc.InstanceDescs = instanceAlloc.gpuAddress;
+		tlasDesc.DestAccelerationStructureData.StartAddress = target.buffer.result.resource->GetGPUVirtualAddress();
 		tlasDesc.DestAccelerationStructureData.SizeInBytes = info.ResultDataMaxSizeInBytes;
 		tlasDesc.Flags = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE;
-		tlasDesc.NumDescs = 1;
-		tlasDesc.ScratchAccelerationStructureData.StartAddress = m_TLAS.scratch->GetGPUVirtualAddress();
+		tlasDesc.NumDescs = (UINT)kept.size();
+		tlasDesc.ScratchAccelerationStructureData.StartAddress = scratch.resource->GetGPUVirtualAddress();
 		tlasDesc.ScratchAccelerationStructureData.SizeInBytes = info.ScratchDataSizeInBytes;
 		tlasDesc.Type = D3D12_RAYTRACING_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL;
+		builds.push_back(build);
 
-		m_RTCmdList->BuildRaytracingAccelerationStructure(&tlasDesc);
+		//the next build's scratch may go on the same memory, RecordTLASBuilds puts an aliasing barrier before each build
+		m_ASPool.FreeAliased(scratch, m_FrameTimeline.GetNextValue());
+		target.pointer = CreateWrappedPointer(m_RTDevice.Get(), target.buffer.result.resource.Get(), static_cast<uint32_t>(info.ResultDataMaxSizeInBytes) / sizeof(uint32_t), &target.buffer.descriptor);
+		target.instanceCount = (uint32_t)kept.size();
 	}
+	m_TLASDirty = false;
+	return builds;
+}
 
-	ExecuteCommandList();
-	WaitForGPU();
+void DXEngine::RecordTLASBuilds(ID3D12GraphicsCommandList* cmdList, ID3D12RaytracingFallbackCommandList* rtCmdList, const std::vector<TLASBuild>& builds) {
+	PROFILE_SCOPE("RecordTLASBuilds");
+	ID3D12DescriptorHeap *pDescriptorHeaps[] = { m_Descriptors.GetHeap() };
+	rtCmdList->SetDescriptorHeaps(1, pDescriptorHeaps);
+	for (const TLASBuild& build : builds) {
+		//either buffer may be placed on memory a previous build's scratch was aliased on
+		D3D12_RESOURCE_BARRIER aliasing[] = { CD3DX12_RESOURCE_BARRIER::Aliasing(nullptr, build.scratch.Get()), CD3DX12_RESOURCE_BARRIER::Aliasing(nullptr, build.result.Get()) };
+		cmdList->ResourceBarrier(ARRAYSIZE(aliasing), aliasing);
+		rtCmdList->BuildRaytracingAccelerationStructure(&build.desc);
+		//the trace reading it may be recorded on another list of the same queue
+		D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::UAV(build.result.Get());
+		cmdList->ResourceBarrier(1, &barrier);
+	}
+}
 
-	m_CmdAllocator[m_CurrentFrame]->Reset();
-	HR(m_CmdList->Reset(m_CmdAllocator[m_CurrentFrame].Get(), nullptr), "Reset Command list");
+void DXEngine::SetInstanceTransform(uint32_t instance, const glm::mat4& transform) {
+	if (instance >= m_Instances.size())
+		return;
+	Instance& target = m_Instances[instance];
+	//the tiles it leaves and the tiles it enters
+	glm::vec3 worldMin, worldMax;
+	target.GetWorldBounds(target.transform, worldMin, worldMax);
+	m_DirtyRegion.AddWorldBounds(worldMin, worldMax, m_RayGenConstants.viewport);
+	target.GetWorldBounds(transform, worldMin, worldMax);
+	m_DirtyRegion.AddWorldBounds(worldMin, worldMax, m_RayGenConstants.viewport);
+	target.transform = transform;
+	m_TLASDirty = true;
+	m_CpuScene.SetInstanceTransform(instance, transform);
+	m_CpuSceneDirty = true;
+	m_Scene.Bump(SCENE_INSTANCES);
+}
 
-	//create pipeline
-	m_PipelineState = CompileRTPipeline( m_RTDevice.Get(), L"shader/raytracing.hlsl");
-	//create shader table
-	m_ShaderTable = CompileShaderTable(m_Device.Get(), m_RTDevice.Get(), m_PipelineState);
+void DXEngine::SetInstanceMask(uint32_t instance, uint8_t mask) {
+	if (instance >= m_Instances.size() || m_Instances[instance].mask == mask)
+		return;
+	Instance& target = m_Instances[instance];
+	//it may enter or leave the primary tlas, either way only its own tiles change
+	glm::vec3 worldMin, worldMax;
+	target.GetWorldBounds(target.transform, worldMin, worldMax);
+	m_DirtyRegion.AddWorldBounds(worldMin, worldMax, m_RayGenConstants.viewport);
+	target.mask = mask;
+	m_TLASDirty = true;
+	m_Scene.Bump(SCENE_INSTANCES);
 }
 
-void DXEngine::Init(HWND hWnd, int w, int h) {
-	//Create Device
-	//currently only fallback will work since we do not have a DXR compatible device
-	UUID experimentalFeaturesSMandDXR[] = { D3D12ExperimentalShaderModels /*,D3D12RaytracingPrototype*/ };
-	HRESULT hr = D3D12EnableExperimentalFeatures(1, experimentalFeaturesSMandDXR, nullptr, nullptr);
+void DXEngine::SetTLASFilter(SceneTLAS tlas, const TLASFilter& filter) {
+	m_TLAS[tlas].filter = filter;
+	m_TLAS[tlas].enabled = true;
+	m_TLASDirty = true;
+	//a new region may drop or restore any instance, the whole frame retraces
+	m_Scene.Bump(SCENE_GEOMETRY);
+}
 
-	if (SUCCEEDED(D3D12GetDebugInterface(IID_PPV_ARGS(&m_Debug)))) {
-		//m_Debug->EnableDebugLayer();
+const CpuScene& DXEngine::GetCpuScene() {
+	if (m_CpuSceneDirty) {
+		m_CpuScene.Build();
+		m_CpuSceneDirty = false;
 	}
+	return m_CpuScene;
+}
 
-	HR(D3D12CreateDevice(nullptr, D3D_FEATURE_LEVEL_12_0, IID_PPV_ARGS(&m_Device)), "CreateDevice");
-	//Create command queue
-	D3D12_COMMAND_QUEUE_DESC cqDesc = {};
-	cqDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
-	cqDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
-	HR(m_Device->CreateCommandQueue(&cqDesc, IID_PPV_ARGS(&m_CmdQueue)), "CreateCommandQueue");
-	//create command allocator
-	for (int i = 0; i < BUFFER_COUNT; ++i) {
-		HR(m_Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_CmdAllocator[i])), "CreateCommandAllocator");
+void DXEngine::TraceBatch(const RayBatch& rays, const HitBatch& hits, uint32_t flags) {
+	::TraceBatch(GetCpuScene(), rays, hits, flags, &m_ThreadPool);
+}
+
+void DXEngine::FindClosestPoints(const PointBatch& points, const ClosestPointResults& results) {
+	::FindClosestPoints(GetCpuScene(), points, results, &m_ThreadPool);
+}
+
+void DXEngine::OverlapBatch(const CpuOverlapVolume* volumes, uint32_t count, std::vector<std::vector<CpuOverlap>>& results) {
+	::OverlapBatch(GetCpuScene(), volumes, count, results, &m_ThreadPool);
+}
+
+void DXEngine::CullFrustumBatch(const CpuFrustum* frustums, uint32_t count, std::vector<std::vector<uint32_t>>& visible) {
+	::CullFrustumBatch(GetCpuScene(), frustums, count, visible, &m_ThreadPool);
+}
+
+void DXEngine::BuildAccelerationStructures(const std::vector<glm::vec3>& vertices, const std::vector<glm::vec4>& spheres) {
+	PROFILE_SCOPE("BuildAccelerationStructures");
+	ID3D12DescriptorHeap *pDescriptorHeaps[] = { m_Descriptors.GetHeap() };
+	m_RTComputeList->SetDescriptorHeaps(1, pDescriptorHeaps);
+	Instance instance;
+	//create blas
+	{
+		//the inputs are only read by the blas build, so they live in the upload ring,
+		//or for large scenes (a million spheres are 24MB of boxes) in a dedicated upload buffer released once the build completed
+		D3D12_RAYTRACING_GEOMETRY_DESC geomDesc = {};
+		geomDesc.Flags = D3D12_RAYTRACING_GEOMETRY_FLAG_OPAQUE;
+		if (spheres.empty()) {
+			UploadAllocation vbo = m_UploadRing.Upload(vertices.data(), sizeof(glm::vec3) * vertices.size());
+			geomDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
+			geomDesc.Triangles.VertexBuffer.StartAddress = vbo.gpuAddress;
+			geomDesc.Triangles.VertexBuffer.StrideInBytes = sizeof(glm::vec3);
+			geomDesc.Triangles.VertexCount = vertices.size();
+			geomDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+			instance.boundsMin = instance.boundsMax = vertices[0];
+			for (const glm::vec3& v : vertices) {
+				instance.boundsMin = glm::min(instance.boundsMin, v);
+				instance.boundsMax = glm::max(instance.boundsMax, v);
+			}
+		} else {
+			//written straight to upload memory, there is no second copy of the boxes on the cpu
+			UploadAllocation aabbs = m_UploadRing.Allocate(sizeof(D3D12_RAYTRACING_AABB) * spheres.size());
+			D3D12_RAYTRACING_AABB* boxes = (D3D12_RAYTRACING_AABB*)aabbs.cpuAddress;
+			instance.boundsMin = glm::vec3(FLT_MAX);
+			instance.boundsMax = glm::vec3(-FLT_MAX);
+			for (size_t i = 0; i < spheres.size(); ++i) {
+				glm::vec3 boxMin = glm::vec3(spheres[i]) - spheres[i].w;
+				glm::vec3 boxMax = glm::vec3(spheres[i]) + spheres[i].w;
+				boxes[i] = { boxMin.x, boxMin.y, boxMin.z, boxMax.x, boxMax.y, boxMax.z };
+				instance.boundsMin = glm::min(instance.boundsMin, boxMin);
+				instance.boundsMax = glm::max(instance.boundsMax, boxMax);
+			}
+			geomDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_PROCEDURAL_PRIMITIVE_AABBS;
+			geomDesc.AABBs.AABBCount = spheres.size();
+			geomDesc.AABBs.AABBs.StartAddress = aabbs.gpuAddress;
+			geomDesc.AABBs.AABBs.StrideInBytes = sizeof(D3D12_RAYTRACING_AABB);
+			instance.hitGroup = SCENE_HIT_GROUP_SPHERES;
+
+			//the intersection shader reads them every frame, so they get a default heap copy
+			UploadAllocation sphereData = m_UploadRing.Upload(spheres.data(), SPHERE_STRIDE * spheres.size());
+			const auto defaultHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+			auto sphereDesc = CD3DX12_RESOURCE_DESC::Buffer(SPHERE_STRIDE * spheres.size());
+			HR(m_Device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &sphereDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&m_Spheres)), "Create sphere buffer");
+			m_ComputeList->CopyBufferRegion(m_Spheres.Get(), 0, sphereData.resource, sphereData.offset, SPHERE_STRIDE * spheres.size());
+			D3D12_RESOURCE_BARRIER toShader = CD3DX12_RESOURCE_BARRIER::Transition(m_Spheres.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE);
+			m_ComputeList->ResourceBarrier(1, &toShader);
+		}
+
+		uint32_t blas = m_BLASBuilder.Add(&geomDesc, 1, D3D12_RAYTRACING_ACCELERATION_STRUCTURE_BUILD_FLAG_NONE);
+		//the direct queue waits for these builds before its first signal, so its fence values cover them
+		std::vector<PooledBuffer> results = m_BLASBuilder.Build(m_ComputeList.Get(), m_RTComputeList.Get(), m_FrameTimeline.GetNextValue());
+		FreeASBuffer(m_BLAS);
+		m_BLAS.result = results[blas];
 	}
-	HR(m_Device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_CmdAllocator[0].Get(), nullptr, IID_PPV_ARGS(&m_CmdList)), "CreateGraphicsCommandList");
-	//m_CmdList->Close();//cmdlists start in open mode
+	//create tlas
+	{
+		m_BLASPointer = CreateWrappedPointer(m_RTDevice.Get(), m_BLAS.result.resource.Get(), static_cast<uint32_t>(m_BLAS.result.size) / sizeof(uint32_t), &m_BLAS.descriptor);
+		m_Instances.assign(1, instance);
+		m_TLAS[SCENE_TLAS_PRIMARY].enabled = true;
+		BuildTLAS(m_ComputeList.Get(), m_RTComputeList.Get());
+	}
+
+	//built on the compute queue, the direct queue only waits on the gpu before it first reads them
+	HR(m_ComputeList->Close(), "Closing compute CmdList");
+	ID3D12CommandList *commandLists[] = { m_ComputeList.Get() };
+	m_ComputeQueue->ExecuteCommandLists(ARRAYSIZE(commandLists), commandLists);
+	m_ComputeTimeline.GpuWait(m_CmdQueue.Get(), m_ComputeTimeline.Signal(m_ComputeQueue.Get()));
+	//built while the gpu builds its own
+	uint32_t geometry = spheres.empty() ? m_CpuScene.AddTriangles(vertices.data(), (uint32_t)vertices.size()) : m_CpuScene.AddSpheres(spheres.data(), (uint32_t)spheres.size());
+	m_CpuScene.AddInstance(geometry, m_Instances[0].transform);
+	m_CpuScene.Build();
+	m_ASPool.PrintStats("AS pool");
+	m_Scene.Bump(SCENE_GEOMETRY);
+	m_Scene.Bump(SCENE_INSTANCES);
+}
+
+//Init runs as a small dependency graph: the pipeline compiles and the geometry is generated on the pool
+//while the acceleration structures build on the compute queue. Everything is joined before the first DispatchRays.
+void DXEngine::InitDXR() {
+	PROFILE_SCOPE("InitDXR");
+	D3D12CreateRaytracingFallbackDevice(m_Device.Get(), CreateRaytracingFallbackDeviceFlags::None, 0, IID_PPV_ARGS(&m_RTDevice));
+	m_RTDevice->QueryRaytracingCommandList(m_CmdList.Get(), IID_PPV_ARGS(&m_RTCmdList));
+	m_RTDevice->QueryRaytracingCommandList(m_ComputeList.Get(), IID_PPV_ARGS(&m_RTComputeList));
+	m_DirectLists.GetBackend().Init(m_Device.Get(), m_RTDevice.Get(), D3D12_COMMAND_LIST_TYPE_DIRECT);
+	m_BLASBuilder.Init(m_RTDevice.Get(), &m_ASPool, BLAS_SCRATCH_BUDGET);
+
+	//queued first so it does not wait behind the shader compiles
+	std::future<std::vector<glm::vec3>> vertices;
+	std::future<std::vector<glm::vec4>> spheres;
+	if (m_SphereCount > 0)
+		spheres = m_ThreadPool.Submit([this]() { return CreateSpheres(m_SphereCount); });
+	else
+		vertices = m_ThreadPool.Submit([]() { return CreateSphereVertices(); });
+	//only needed once the trace resolution drops below the output's
+	std::future<void> upsampler;
+	if (m_Resolution.IsEnabled())
+		upsampler = m_ThreadPool.Submit([this]() { m_Upsampler.Init(m_Device.Get(), &m_ShaderCompiler); });
+	std::future<void> reconstructor;
+	if (m_TraceRate != TRACE_RATE_FULL)
+		reconstructor = m_ThreadPool.Submit([this]() { m_Reconstructor.Init(m_Device.Get(), &m_ShaderCompiler); });
+
+	//create pipeline, the first frame waits for it
+	std::vector<ShaderLibrary> libraries = { { L"shader/raytracing.hlsl", { rayGenStr, missStr, chsStr, sphereIntersectionStr, sphereChsStr },
+		{ { hitGroupStr, chsStr, L"", L"" }, { sphereHitGroupStr, sphereChsStr, L"", sphereIntersectionStr } } } };
+	m_Pipelines.Init(&m_ThreadPool, m_RTDevice.Get(), &m_ShaderCompiler, L"shader", libraries);
+	m_ShaderTable.Init(m_Device.Get(), m_RTDevice->GetShaderIdentifierSize());
+
+	//create output target, copied to the back buffer every frame
+	{
+		const auto defaultHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+		auto texDesc = CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, m_Width, m_Height, 1, 1, 1, 0, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+		HR(m_Device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &texDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&m_OutputTarget)), "Create output target");
+		D3D12_CPU_DESCRIPTOR_HANDLE uavDescriptor;
+		m_OutputUAV = AllocateDescriptor(&uavDescriptor);
+		D3D12_UNORDERED_ACCESS_VIEW_DESC uavDesc = {};
+		uavDesc.ViewDimension = D3D12_UAV_DIMENSION_TEXTURE2D;
+		m_Device->CreateUnorderedAccessView(m_OutputTarget.Get(), nullptr, &uavDesc, uavDescriptor);
+	}
+	//create accumulation and tile error buffers, bound as root uavs
+	{
+		const auto defaultHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+		auto accumDesc = CD3DX12_RESOURCE_DESC::Buffer((uint64_t)m_Width * m_Height * ACCUM_PIXEL_STRIDE, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+		HR(m_Device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &accumDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&m_Accumulation)), "Create accumulation buffer");
+		uint64_t tileErrorSize = m_Sampler.GetTileCount() * sizeof(uint32_t);
+		auto tileErrorDesc = CD3DX12_RESOURCE_DESC::Buffer(tileErrorSize, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+		HR(m_Device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &tileErrorDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&m_TileErrors)), "Create tile error buffer");
+		auto auxDesc = CD3DX12_RESOURCE_DESC::Buffer((uint64_t)m_Width * m_Height * AUX_PIXEL_STRIDE, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+		HR(m_Device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &auxDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&m_Auxiliary)), "Create auxiliary buffer");
+		//two halves of block rates and the traced pixel counter, starts zeroed which reads as full rate
+		auto blockRateDesc = CD3DX12_RESOURCE_DESC::Buffer(((uint64_t)m_BlockCount * 2 + 1) * sizeof(uint32_t), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+		HR(m_Device->CreateCommittedResource(&defaultHeapProperties, D3D12_HEAP_FLAG_NONE, &blockRateDesc, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, nullptr, IID_PPV_ARGS(&m_BlockRates)), "Create block rate buffer");
+		if (m_Sampler.IsEnabled()) {
+			const auto readbackHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK);
+			auto tileReadbackDesc = CD3DX12_RESOURCE_DESC::Buffer(tileErrorSize);
+			for (uint32_t i = 0; i < m_FrameCount; ++i)
+				HR(m_Device->CreateCommittedResource(&readbackHeapProperties, D3D12_HEAP_FLAG_NONE, &tileReadbackDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&m_Frames[i].tileReadback)), "Create tile error readback");
+		}
+	}
+
+	BuildAccelerationStructures(vertices.valid() ? vertices.get() : std::vector<glm::vec3>(), spheres.valid() ? spheres.get() : std::vector<glm::vec4>());
+	if (upsampler.valid()) {
+		upsampler.get();
+		if (!m_Upsampler.IsReady()) {
+			printf("DXEngine: No upsampler, tracing at full resolution\n");
+			m_Resolution.Init(m_Width, m_Height, 0.0f, DYNAMIC_RESOLUTION_MIN_SCALE);
+		}
+	}
+	if (reconstructor.valid()) {
+		reconstructor.get();
+		if (!m_Reconstructor.IsReady()) {
+			printf("DXEngine: No reconstruction pass, tracing every pixel\n");
+			m_TraceRate = TRACE_RATE_FULL;
+		}
+	}
+}
+
+void DXEngine::CreateSwapchain(HWND hWnd) {
 	//Create swapchain
 	IDXGIFactory2* dxgiFact;
 	HR(CreateDXGIFactory2(0, __uuidof(IDXGIFactory2), (void**)&dxgiFact),"CreateDXGIFactory");
 	HR(dxgiFact->QueryInterface(IID_PPV_ARGS(&m_DXGIFactory)), "QueryFactory");
 	IDXGISwapChain1* tempSC;
 	DXGI_SWAP_CHAIN_DESC1 swapChainDesc = {};
-	swapChainDesc.BufferCount = BUFFER_COUNT;
-	swapChainDesc.Width = w;
-	swapChainDesc.Height = h;
+	//a swap buffer per frame in flight so present does not become the limit
+	m_SwapBufferCount = std::max(2u, m_FrameCount);
+	swapChainDesc.BufferCount = m_SwapBufferCount;
+	swapChainDesc.Width = m_Width;
+	swapChainDesc.Height = m_Height;
 	swapChainDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
 	swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
 	swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
@@ -244,14 +696,14 @@ void DXEngine::Init(HWND hWnd, int w, int h) {
 	//Create RTV Descriptor heap
 	D3D12_DESCRIPTOR_HEAP_DESC descHeapDesc = {};
 	descHeapDesc.NodeMask = 0;
-	descHeapDesc.NumDescriptors = 2;
+	descHeapDesc.NumDescriptors = m_SwapBufferCount;
 	descHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
 	descHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_NONE;
 	HR(m_Device->CreateDescriptorHeap(&descHeapDesc, IID_PPV_ARGS(&m_RTVHeap)), "CreateDescriptorHeap");
 	m_RTVDescSize = m_Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 	
 	//Create RTVs
-	for (int i = 0; i < BUFFER_COUNT; ++i) {
+	for (uint32_t i = 0; i < m_SwapBufferCount; ++i) {
 		m_Swapchain->GetBuffer(i, IID_PPV_ARGS(&m_SwapBuffers[i]));
 		D3D12_RENDER_TARGET_VIEW_DESC rtvDesc;
 		rtvDesc.Texture2D.MipSlice = 0;
@@ -260,63 +712,456 @@ void DXEngine::Init(HWND hWnd, int w, int h) {
 		rtvDesc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
 		m_Device->CreateRenderTargetView(m_SwapBuffers[i].Get(), &rtvDesc, CD3DX12_CPU_DESCRIPTOR_HANDLE(m_RTVHeap->GetCPUDescriptorHandleForHeapStart(), i * m_RTVDescSize));
 	}
+}
 
-	//create CBV/SRV/UAV heap
-	descHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-	descHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
-	descHeapDesc.NumDescriptors = 100000;
-	HR(m_Device->CreateDescriptorHeap(&descHeapDesc, IID_PPV_ARGS(&m_CBVSRVUAVHeap)), "CreateDescriptorHeap");
-	m_DescSize = m_Device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+void DXEngine::Init(HWND hWnd, int w, int h, uint32_t framesInFlight) {
+	m_InitStart = std::chrono::high_resolution_clock::now();
+	//Create Device
+	//currently only fallback will work since we do not have a DXR compatible device
+	UUID experimentalFeaturesSMandDXR[] = { D3D12ExperimentalShaderModels /*,D3D12RaytracingPrototype*/ };
+	HRESULT hr = D3D12EnableExperimentalFeatures(1, experimentalFeaturesSMandDXR, nullptr, nullptr);
 
-	//Create fence
-	HR(m_Device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_SwapFence)),"CreateFence");
-	HR(m_Device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&m_InitFence)), "CreateFence");
-	m_SwapEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
-	m_CurrentFrame = m_Swapchain->GetCurrentBackBufferIndex();
+	if (SUCCEEDED(D3D12GetDebugInterface(IID_PPV_ARGS(&m_Debug)))) {
+		//m_Debug->EnableDebugLayer();
+	}
+
+	m_Width = w;
+	m_Height = h;
+	HR(D3D12CreateDevice(nullptr, D3D_FEATURE_LEVEL_12_0, IID_PPV_ARGS(&m_Device)), "CreateDevice");
+	//Create command queue
+	D3D12_COMMAND_QUEUE_DESC cqDesc = {};
+	cqDesc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	cqDesc.Type = D3D12_COMMAND_LIST_TYPE_DIRECT;
+	HR(m_Device->CreateCommandQueue(&cqDesc, IID_PPV_ARGS(&m_CmdQueue)), "CreateCommandQueue");
+	//acceleration structures are built on their own queue
+	cqDesc.Type = D3D12_COMMAND_LIST_TYPE_COMPUTE;
+	HR(m_Device->CreateCommandQueue(&cqDesc, IID_PPV_ARGS(&m_ComputeQueue)), "CreateCommandQueue");
+	HR(m_Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COMPUTE, IID_PPV_ARGS(&m_ComputeAllocator)), "CreateCommandAllocator");
+	HR(m_Device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COMPUTE, m_ComputeAllocator.Get(), nullptr, IID_PPV_ARGS(&m_ComputeList)), "CreateComputeCommandList");
+	//create frame contexts
+	m_FrameCount = std::max(1u, std::min(framesInFlight, (uint32_t)MAX_FRAMES_IN_FLIGHT));
+	m_FrameIndex = 0;
+	for (uint32_t i = 0; i < m_FrameCount; ++i) {
+		HR(m_Device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&m_Frames[i].allocator)), "CreateCommandAllocator");
+		m_Frames[i].queryIndex = i * FRAME_TIMESTAMP_COUNT;
+	}
+	HR(m_Device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_Frames[0].allocator.Get(), nullptr, IID_PPV_ARGS(&m_CmdList)), "CreateGraphicsCommandList");
+	//gpu timings, FRAME_TIMESTAMP_COUNT timestamps per frame context
+	D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+	queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	queryHeapDesc.Count = MAX_FRAMES_IN_FLIGHT * FRAME_TIMESTAMP_COUNT;
+	HR(m_Device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&m_TimestampHeap)), "CreateQueryHeap");
+	const auto readbackHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK);
+	auto readbackDesc = CD3DX12_RESOURCE_DESC::Buffer(MAX_FRAMES_IN_FLIGHT * FRAME_TIMESTAMP_COUNT * sizeof(uint64_t));
+	HR(m_Device->CreateCommittedResource(&readbackHeapProperties, D3D12_HEAP_FLAG_NONE, &readbackDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&m_TimestampReadback)), "Create timestamp readback");
+	m_CmdQueue->GetTimestampFrequency(&m_TimestampFrequency);
+	m_GpuProfiler.Init(m_Device.Get(), m_CmdQueue.Get());
+	//m_CmdList->Close();//cmdlists start in open mode
+	if (!m_Headless)
+		CreateSwapchain(hWnd);
+
+	//create CBV/SRV/UAV heap, grows a page at a time
+	m_Descriptors.Init(m_Device.Get(), DESCRIPTOR_PAGE_SIZE);
+
+	//Create timelines
+	m_FrameTimeline.Init(m_Device.Get());
+	m_ComputeTimeline.Init(m_Device.Get());
+
+	m_UploadRing.Init(m_Device.Get(), UPLOAD_RING_SIZE);
+	m_ASPool.Init(m_Device.Get(), AS_POOL_HEAP_SIZE);
+	m_ThreadPool.Init(0);
+	m_RecordPool.Init(0);
+	if (m_DenoiseEnabled)
+		m_DenoisePool.Init(1);
+	m_ShaderCompiler.Init(L"shader/cache");
+	m_Sampler.Init(m_Width, m_Height, ADAPTIVE_TILE_SIZE, m_TargetError, m_MaxSamples);
+	//progressive and the denoiser read the accumulation at output resolution, frames traced smaller would not line up
+	if (m_FrameBudgetMs > 0.0f && (m_Sampler.IsEnabled() || m_DenoiseEnabled)) {
+		printf("DXEngine: Dynamic resolution is not supported with progressive sampling or the denoiser, tracing at full resolution\n");
+		m_FrameBudgetMs = 0.0f;
+	}
+	m_Resolution.Init(m_Width, m_Height, m_FrameBudgetMs, DYNAMIC_RESOLUTION_MIN_SCALE);
+	//reconstruction reuses the accumulation as history, so it needs it unaccumulated and at output resolution
+	if (m_TraceRate != TRACE_RATE_FULL && (m_Sampler.IsEnabled() || m_Resolution.IsEnabled())) {
+		printf("DXEngine: Reduced trace rates are not supported with progressive sampling or dynamic resolution, tracing every pixel\n");
+		m_TraceRate = TRACE_RATE_FULL;
+	}
+	m_DirtyRegion.Init(m_Width, m_Height, ADAPTIVE_TILE_SIZE);
+	m_BlockCountX = (m_Width + 1) / 2;
+	m_BlockCount = m_BlockCountX * ((m_Height + 1) / 2);
 
 	InitDXR();
+	//a readback per frame context, so reading a completed frame never waits on the one being recorded
+	D3D12_RESOURCE_DESC outputDesc = m_OutputTarget->GetDesc();
+	m_Device->GetCopyableFootprints(&outputDesc, 0, 1, 0, &m_ReadbackFootprint, nullptr, nullptr, &m_ReadbackSize);
+	//so a second image can be placed right after the first
+	m_ReadbackSize = (m_ReadbackSize + D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1) & ~(uint64_t)(D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT - 1);
+	if (m_TraceRate != TRACE_RATE_FULL) {
+		auto metricsReadbackDesc = CD3DX12_RESOURCE_DESC::Buffer(m_ReadbackSize * 2 + sizeof(uint32_t));
+		for (uint32_t i = 0; i < m_FrameCount; ++i)
+			HR(m_Device->CreateCommittedResource(&readbackHeapProperties, D3D12_HEAP_FLAG_NONE, &metricsReadbackDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&m_Frames[i].metricsReadback)), "Create trace rate metrics readback");
+	}
+	if (m_Headless) {
+		auto imageReadbackDesc = CD3DX12_RESOURCE_DESC::Buffer(m_ReadbackSize);
+		for (uint32_t i = 0; i < m_FrameCount; ++i)
+			HR(m_Device->CreateCommittedResource(&readbackHeapProperties, D3D12_HEAP_FLAG_NONE, &imageReadbackDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&m_Frames[i].readback)), "Create image readback");
+		if (m_DenoiseEnabled) {
+			auto denoiseReadbackDesc = CD3DX12_RESOURCE_DESC::Buffer((uint64_t)m_Width * m_Height * (ACCUM_PIXEL_STRIDE + AUX_PIXEL_STRIDE));
+			for (uint32_t i = 0; i < m_FrameCount; ++i)
+				HR(m_Device->CreateCommittedResource(&readbackHeapProperties, D3D12_HEAP_FLAG_NONE, &denoiseReadbackDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&m_Frames[i].denoiseReadback)), "Create denoise readback");
+		}
+	}
+	m_FrameStart = std::chrono::high_resolution_clock::now();
+}
+
+void DXEngine::EnableProgressive(float targetError, uint32_t maxSamples) {
+	m_TargetError = targetError;
+	m_MaxSamples = maxSamples;
+}
+
+void DXEngine::EnableDenoiser(uint32_t iterations) {
+	m_DenoiseEnabled = true;
+	//the padding grows with 2^iterations, more passes than this only blur
+	if (iterations > DENOISE_MAX_ITERATIONS) {
+		printf("DXEngine: The denoiser runs at most %u passes\n", DENOISE_MAX_ITERATIONS);
+		iterations = DENOISE_MAX_ITERATIONS;
+	}
+	//the row bands share the pool with compiles and image writes
+	m_Denoiser.Init(&m_ThreadPool, iterations);
+}
+
+void DXEngine::EnableDynamicResolution(float budgetMs) {
+	m_FrameBudgetMs = budgetMs;
+}
+
+void DXEngine::EnableTraceRate(TraceRate mode, float gradientThreshold) {
+	m_TraceRate = mode;
+	m_RateThreshold = gradientThreshold;
 }
 
-void DXEngine::Render() {
-	//set swapbuffer state to render target
-	D3D12_RESOURCE_BARRIER barrier = {};
-	barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-	barrier.Transition.pResource = m_SwapBuffers[m_CurrentFrame].Get();
-	barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_PRESENT;
-	barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_RENDER_TARGET;
-	barrier.Transition.Subresource = 0;
-	barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-	m_CmdList->ResourceBarrier(1, &barrier);
-	//clear
-	const float clearColor[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
-	m_CmdList->ClearRenderTargetView(CD3DX12_CPU_DESCRIPTOR_HANDLE(m_RTVHeap->GetCPUDescriptorHandleForHeapStart(), m_CurrentFrame * m_RTVDescSize), clearColor, 0, nullptr);
-	//Raytrace!
-	D3D12_FALLBACK_DISPATCH_RAYS_DESC dispatchDesc = {};
-	m_RTCmdList->SetDescriptorHeaps(1, m_CBVSRVUAVHeap.GetAddressOf());
-	m_CmdList->SetComputeRootDescriptorTable(0, m_CBVSRVUAVHeap->GetGPUDescriptorHandleForHeapStart());
-
-	//set state to present
-	barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
-	barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
-	m_CmdList->ResourceBarrier(1, &barrier);
-	//submit cmdlist
-	ExecuteCommandList();
+void DXEngine::InitHeadless(int w, int h, uint32_t framesInFlight, const char* outputPrefix, ImageFormat format) {
+	m_Headless = true;
+	m_ImageWriter.Init(&m_ThreadPool, outputPrefix, format);
+	std::string logName = std::string(outputPrefix) + "_timings.csv";
+	m_TimingLog = fopen(logName.c_str(), "w");
+	if (m_TimingLog)
+		fprintf(m_TimingLog, "frame,cpu_record_ms,gpu_ms\n");
+	else
+		printf("DXEngine: Could not open %s\n", logName.c_str());
+	Init(nullptr, w, h, framesInFlight);
+}
+
+void DXEngine::Finish() {
+	WaitForGPU();
+	//oldest first, so images and log lines come out in frame order
+	for (uint32_t i = 1; i <= m_FrameCount; ++i)
+		CompleteFrame((m_FrameIndex + i) % m_FrameCount);
+	//the output holds the accumulation of every traced frame, converged or cut off by the frame count
+	if (m_Headless && m_Sampler.IsEnabled() && m_FrameNumber > 0) {
+		FrameContext& frame = m_Frames[m_FrameIndex];
+		frame.frameNumber = m_FrameNumber - 1;
+		RecordReadbackCopies(m_CmdList.Get(), m_FrameIndex);
+		ExecuteCommandList();
+		WaitForGPU();
+		WriteImage(m_FrameIndex);
+	}
+	//the gpu is idle, nothing reads the acceleration structures anymore
+	FreeASBuffer(m_BLAS);
+	for (FilteredTLAS& tlas : m_TLAS)
+		FreeASBuffer(tlas.buffer);
+	//denoised frames reach the image writer from m_DenoisePool
+	FlushDenoise();
+	uint32_t failed = m_ImageWriter.Flush();
+	if (failed > 0)
+		printf("DXEngine: %u images could not be written\n", failed);
+	if (m_TimingLog) {
+		fclose(m_TimingLog);
+		m_TimingLog = nullptr;
+	}
+}
+
+bool DXEngine::CanReuseOutput() const {
+	//headless runs write every frame they are asked for, captures want every frame traced
+	if (m_Headless || Profiler::IsCapturing())
+		return false;
+	if (m_TracedScene.GetVersion() != m_Scene.GetVersion() || m_TracedWidth != m_Resolution.GetWidth() || m_TracedHeight != m_Resolution.GetHeight())
+		return false;
+	//progressive keeps sampling until it converged, reduced rates until every pixel was traced since the change
+	if (m_Sampler.IsEnabled())
+		return m_Sampler.IsConverged();
+	return m_SettledFrames >= (m_TraceRate == TRACE_RATE_FULL ? 1u : TRACE_RATE_SETTLE_FRAMES);
+}
+
+bool DXEngine::CanTraceIncrementally() const {
+	//the tiles outside the dirty region must hold a final full resolution image of the scene before the edits
+	if (!m_PrimaryVisibilityOnly || m_Sampler.IsEnabled() || m_TraceRate != TRACE_RATE_FULL || m_SettledFrames == 0)
+		return false;
+	if (m_TracedWidth != m_Width || m_TracedHeight != m_Height || m_Resolution.GetWidth() != m_Width || m_Resolution.GetHeight() != m_Height)
+		return false;
+	return m_Scene.OnlyChanged(SCENE_INSTANCES, m_TracedScene);
+}
+
+bool DXEngine::Render() {
+	PROFILE_SCOPE("Render");
+	//shader edits are picked up between frames
+	m_Pipelines.Update();
+	if (m_Pipelines.SwapPipeline(m_FrameTimeline.GetNextValue())) {
+		m_ShaderTableReady = false;
+		//samples of the old shaders must not blend into the new ones
+		m_Sampler.Reset();
+		m_ConvergedReported = false;
+		m_RateHistoryValid = false;
+		m_Scene.Bump(SCENE_PIPELINE);
+	}
+	//joins the initial pipeline compile on the first frame
+	RaytracingPipeline& pipeline = m_Pipelines.GetPipeline();
+	if (pipeline.pipelineState && !m_ShaderTableReady) {
+		CompileShaderTable(pipeline, m_ShaderTable, m_RayGenConstants);
+		m_ShaderTableReady = true;
+	}
+	m_Scene.Observe(SCENE_CAMERA, m_ShaderTable.GetVersion(), &m_ShaderTableVersion);
+	//the swapchain still shows the last traced frame, present nothing and record nothing
+	if (CanReuseOutput()) {
+		m_Stats.reusedFrames++;
+		//idle time is not frame time
+		m_FrameStart = std::chrono::high_resolution_clock::now();
+		return false;
+	}
+
+	FrameContext& frame = m_Frames[m_FrameIndex];
+	frame.frameNumber = m_FrameNumber++;
+	auto recordStart = std::chrono::high_resolution_clock::now();
+	m_Stats.frameMs += std::chrono::duration<double, std::milli>(recordStart - m_FrameStart).count();
+	m_FrameStart = recordStart;
+	m_CmdList->EndQuery(m_TimestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, frame.queryIndex);
+
+	//instance edits are applied before the frame traces, the builds are recorded with the rest of the frame
+	std::vector<TLASBuild> tlasBuilds;
+	if (m_TLASDirty)
+		tlasBuilds = PrepareTLASBuilds();
+	m_Descriptors.Flush(m_FrameTimeline.GetNextValue());
+	//copy changed shader records
+	m_ShaderTable.Upload(m_CmdList.Get(), m_UploadRing, m_FrameTimeline.GetNextValue());
+	//pick the tiles to trace from the errors read back so far
+	frame.tileMask = m_Sampler.BeginFrame();
+	//after instance edits only the tiles their bounds covered are retraced, the rest keep the last frame
+	if (CanTraceIncrementally()) {
+		frame.tileMask = m_DirtyRegion.GetTileMask();
+		m_Stats.incrementalFrames++;
+		m_Stats.incrementalTiles += m_DirtyRegion.GetDirtyTileCount();
+	}
+	frame.samplerEpoch = m_Sampler.GetEpoch();
+	UploadAllocation tileMask = m_UploadRing.Upload(frame.tileMask.data(), frame.tileMask.size() * sizeof(uint32_t));
+	//the first frame after a reset traces every pixel, later ones fill skipped pixels from it
+	TraceRate rateMode = m_RateHistoryValid ? m_TraceRate : TRACE_RATE_FULL;
+	SampleConstants sampleConstants = { m_Sampler.GetSampleIndex(), m_Sampler.GetTileSize(), m_Sampler.GetTileCountX(), m_Sampler.NeedsReset() ? 1u : 0u,
+		(uint32_t)rateMode, (uint32_t)frame.frameNumber, m_BlockCountX, m_BlockCount };
+	frame.metricsFrame = frame.metricsReadback && rateMode != TRACE_RATE_FULL && frame.frameNumber % TRACE_RATE_METRICS_INTERVAL == 0;
+	//zeros for the buffers the passes below accumulate into, the upload ring is only touched on this thread
+	UploadAllocation rateCounterZero, tileErrorZeros;
+	uint64_t tileErrorBytes = frame.tileMask.size() * sizeof(uint32_t);
+	if (frame.metricsFrame) {
+		//the reconstruction pass counts the pixels it finds traced
+		rateCounterZero = m_UploadRing.Allocate(sizeof(uint32_t));
+		memset(rateCounterZero.cpuAddress, 0, sizeof(uint32_t));
+	}
+	if (m_Sampler.IsEnabled()) {
+		//the raygen only ever raises tile errors, so they start from zero every frame
+		tileErrorZeros = m_UploadRing.Allocate(tileErrorBytes);
+		memset(tileErrorZeros.cpuAddress, 0, tileErrorBytes);
+		if (m_Sampler.IsConverged() && !m_ConvergedReported) {
+			printf("Progressive: converged after %u frames, %.1f samples per pixel on average\n", m_Sampler.GetSampleIndex() + 1, m_Sampler.GetAverageSamples());
+			m_ConvergedReported = true;
+		}
+	}
+	//tlas builds, clears, the dispatch and the present copy are recorded in parallel on pooled lists and run in that order
+	uint32_t backBuffer = m_Headless ? 0 : m_Swapchain->GetCurrentBackBufferIndex();
+	std::vector<D3D12CommandListPool::RecordJob> jobs;
+	if (!tlasBuilds.empty()) {
+		jobs.push_back([this, &tlasBuilds](PooledCommandList& cmd) {
+			uint32_t scope = m_GpuProfiler.Begin(cmd.list.Get(), m_FrameIndex, "BuildTLAS");
+			RecordTLASBuilds(cmd.list.Get(), cmd.rtList.Get(), tlasBuilds);
+			m_GpuProfiler.End(cmd.list.Get(), m_FrameIndex, scope);
+		});
+	}
+	if (rateCounterZero.resource || tileErrorZeros.resource) {
+		jobs.push_back([this, rateCounterZero, tileErrorZeros, tileErrorBytes](PooledCommandList& cmd) {
+			PROFILE_SCOPE("RecordClears");
+			if (rateCounterZero.resource) {
+				D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_BlockRates.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST);
+				cmd.list->ResourceBarrier(1, &barrier);
+				cmd.list->CopyBufferRegion(m_BlockRates.Get(), (uint64_t)m_BlockCount * 2 * sizeof(uint32_t), rateCounterZero.resource, rateCounterZero.offset, sizeof(uint32_t));
+				barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_BlockRates.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+				cmd.list->ResourceBarrier(1, &barrier);
+			}
+			if (tileErrorZeros.resource) {
+				D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_TileErrors.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST);
+				cmd.list->ResourceBarrier(1, &barrier);
+				cmd.list->CopyBufferRegion(m_TileErrors.Get(), 0, tileErrorZeros.resource, tileErrorZeros.offset, tileErrorBytes);
+				barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_TileErrors.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+				cmd.list->ResourceBarrier(1, &barrier);
+			}
+		});
+	}
+	//Raytrace! nothing to trace with until a pipeline has built, nothing left to trace once converged
+	frame.traced = pipeline.pipelineState && !m_Sampler.IsConverged();
+	//a progressive run only writes its final image, Finish reads it back once the last frame completed
+	frame.writeImage = m_Headless && !m_Sampler.IsEnabled();
+	//resolution picked from the dispatch times of completed frames
+	frame.traceWidth = m_Resolution.GetWidth();
+	frame.traceHeight = m_Resolution.GetHeight();
+	if (frame.traced) {
+		jobs.push_back([this, &frame, &pipeline, tileMask, sampleConstants](PooledCommandList& cmd) {
+			PROFILE_SCOPE("RecordDispatch");
+			uint32_t scope = m_GpuProfiler.Begin(cmd.list.Get(), m_FrameIndex, "DispatchRays");
+			D3D12_FALLBACK_DISPATCH_RAYS_DESC dispatchDesc = {};
+			m_ShaderTable.FillDispatchDesc(&dispatchDesc);
+			dispatchDesc.Width = frame.traceWidth;
+			dispatchDesc.Height = frame.traceHeight;
+			ID3D12DescriptorHeap *pDescriptorHeaps[] = { m_Descriptors.GetHeap() };
+			cmd.rtList->SetDescriptorHeaps(1, pDescriptorHeaps);
+			auto bindGlobals = [&](const SampleConstants& constants) {
+				cmd.list->SetComputeRootSignature(pipeline.globalRootSig.Get());
+				cmd.list->SetComputeRootDescriptorTable(GLOBAL_ROOT_OUTPUT, m_Descriptors.GetGPUHandle(m_OutputUAV));
+				cmd.rtList->SetTopLevelAccelerationStructure(GLOBAL_ROOT_SCENE, m_TLAS[SCENE_TLAS_PRIMARY].pointer);
+				const FilteredTLAS& shadow = m_TLAS[SCENE_TLAS_SHADOW].enabled ? m_TLAS[SCENE_TLAS_SHADOW] : m_TLAS[SCENE_TLAS_PRIMARY];
+				cmd.rtList->SetTopLevelAccelerationStructure(GLOBAL_ROOT_SHADOW_SCENE, shadow.pointer);
+				cmd.list->SetComputeRootUnorderedAccessView(GLOBAL_ROOT_ACCUMULATION, m_Accumulation->GetGPUVirtualAddress());
+				cmd.list->SetComputeRootUnorderedAccessView(GLOBAL_ROOT_TILE_ERRORS, m_TileErrors->GetGPUVirtualAddress());
+				cmd.list->SetComputeRootShaderResourceView(GLOBAL_ROOT_TILE_MASK, tileMask.gpuAddress);
+				cmd.list->SetComputeRootUnorderedAccessView(GLOBAL_ROOT_AUXILIARY, m_Auxiliary->GetGPUVirtualAddress());
+				cmd.list->SetComputeRoot32BitConstants(GLOBAL_ROOT_SAMPLE_CONSTANTS, sizeof(constants) / sizeof(uint32_t), &constants, 0);
+				cmd.list->SetComputeRootUnorderedAccessView(GLOBAL_ROOT_BLOCK_RATES, m_BlockRates->GetGPUVirtualAddress());
+				//left unbound without spheres, only their intersection shader reads it
+				if (m_Spheres)
+					cmd.list->SetComputeRootShaderResourceView(GLOBAL_ROOT_SPHERES, m_Spheres->GetGPUVirtualAddress());
+			};
+			bindGlobals(sampleConstants);
+			cmd.list->EndQuery(m_TimestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, frame.queryIndex + 2);
+			cmd.rtList->DispatchRays(pipeline.pipelineState.Get(), &dispatchDesc);
+			cmd.list->EndQuery(m_TimestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, frame.queryIndex + 3);
+			m_GpuProfiler.End(cmd.list.Get(), m_FrameIndex, scope);
+			if (frame.traceWidth != m_Width || frame.traceHeight != m_Height) {
+				uint32_t upsampleScope = m_GpuProfiler.Begin(cmd.list.Get(), m_FrameIndex, "Upsample");
+				//the raygen's accumulation and auxiliary writes must land before they are read
+				D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::UAV(nullptr);
+				cmd.list->ResourceBarrier(1, &barrier);
+				UpsampleConstants upsampleConstants = { frame.traceWidth, frame.traceHeight, m_Width, m_Height };
+				m_Upsampler.Record(cmd.list.Get(), m_Descriptors.GetGPUHandle(m_OutputUAV), m_Accumulation->GetGPUVirtualAddress(), m_Auxiliary->GetGPUVirtualAddress(), upsampleConstants);
+				m_GpuProfiler.End(cmd.list.Get(), m_FrameIndex, upsampleScope);
+			}
+			if (m_TraceRate != TRACE_RATE_FULL) {
+				uint32_t reconstructScope = m_GpuProfiler.Begin(cmd.list.Get(), m_FrameIndex, "Reconstruct");
+				D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::UAV(nullptr);
+				cmd.list->ResourceBarrier(1, &barrier);
+				ReconstructConstants reconstructConstants = { m_Width, m_Height, sampleConstants.rateMode, sampleConstants.frameIndex, m_BlockCountX, m_BlockCount, m_RateThreshold, m_TraceRate == TRACE_RATE_VARIABLE ? 1u : 0u };
+				m_Reconstructor.Record(cmd.list.Get(), m_Descriptors.GetGPUHandle(m_OutputUAV), m_Accumulation->GetGPUVirtualAddress(), m_BlockRates->GetGPUVirtualAddress(), reconstructConstants);
+				m_GpuProfiler.End(cmd.list.Get(), m_FrameIndex, reconstructScope);
+			}
+			if (frame.metricsFrame) {
+				//keep the reconstructed image, then trace every pixel of the same frame as the reference
+				uint32_t metricsScope = m_GpuProfiler.Begin(cmd.list.Get(), m_FrameIndex, "TraceRateMetrics");
+				D3D12_RESOURCE_BARRIER barriers[2];
+				barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(m_OutputTarget.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+				barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(m_BlockRates.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+				cmd.list->ResourceBarrier(2, barriers);
+				CD3DX12_TEXTURE_COPY_LOCATION dst(frame.metricsReadback.Get(), m_ReadbackFootprint);
+				CD3DX12_TEXTURE_COPY_LOCATION src(m_OutputTarget.Get(), 0);
+				cmd.list->CopyTextureRegion(&dst, 0, 0, 0, &src, nullptr);
+				cmd.list->CopyBufferRegion(frame.metricsReadback.Get(), m_ReadbackSize * 2, m_BlockRates.Get(), (uint64_t)m_BlockCount * 2 * sizeof(uint32_t), sizeof(uint32_t));
+				barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(m_OutputTarget.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+				barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(m_BlockRates.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+				cmd.list->ResourceBarrier(2, barriers);
+				//the reconstruction pass reads the accumulation the reference trace overwrites
+				barriers[0] = CD3DX12_RESOURCE_BARRIER::UAV(m_Accumulation.Get());
+				cmd.list->ResourceBarrier(1, barriers);
+				SampleConstants fullRate = sampleConstants;
+				fullRate.rateMode = TRACE_RATE_FULL;
+				bindGlobals(fullRate);
+				cmd.rtList->DispatchRays(pipeline.pipelineState.Get(), &dispatchDesc);
+				barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(m_OutputTarget.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+				cmd.list->ResourceBarrier(1, barriers);
+				D3D12_PLACED_SUBRESOURCE_FOOTPRINT referenceFootprint = m_ReadbackFootprint;
+				referenceFootprint.Offset += m_ReadbackSize;
+				CD3DX12_TEXTURE_COPY_LOCATION referenceDst(frame.metricsReadback.Get(), referenceFootprint);
+				cmd.list->CopyTextureRegion(&referenceDst, 0, 0, 0, &src, nullptr);
+				barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(m_OutputTarget.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+				cmd.list->ResourceBarrier(1, barriers);
+				m_GpuProfiler.End(cmd.list.Get(), m_FrameIndex, metricsScope);
+			}
+		});
+	}
+	//copy output to the swapbuffer, or to the frame's readback when headless
+	jobs.push_back([this, &frame, backBuffer](PooledCommandList& cmd) {
+		PROFILE_SCOPE("RecordPresentCopy");
+		uint32_t scope = m_GpuProfiler.Begin(cmd.list.Get(), m_FrameIndex, m_Headless ? "ReadbackCopy" : "PresentCopy");
+		if (m_Headless) {
+			if (frame.writeImage)
+				RecordReadbackCopies(cmd.list.Get(), m_FrameIndex);
+		}
+		else {
+			D3D12_RESOURCE_BARRIER barriers[2];
+			barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(m_OutputTarget.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+			barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(m_SwapBuffers[backBuffer].Get(), D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_COPY_DEST);
+			cmd.list->ResourceBarrier(2, barriers);
+			cmd.list->CopyResource(m_SwapBuffers[backBuffer].Get(), m_OutputTarget.Get());
+			//set state to present
+			barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(m_OutputTarget.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+			barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(m_SwapBuffers[backBuffer].Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PRESENT);
+			cmd.list->ResourceBarrier(2, barriers);
+		}
+		if (frame.tileReadback) {
+			D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_TileErrors.Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_SOURCE);
+			cmd.list->ResourceBarrier(1, &barrier);
+			cmd.list->CopyBufferRegion(frame.tileReadback.Get(), 0, m_TileErrors.Get(), 0, frame.tileMask.size() * sizeof(uint32_t));
+			barrier = CD3DX12_RESOURCE_BARRIER::Transition(m_TileErrors.Get(), D3D12_RESOURCE_STATE_COPY_SOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+			cmd.list->ResourceBarrier(1, &barrier);
+		}
+		m_GpuProfiler.End(cmd.list.Get(), m_FrameIndex, scope);
+		cmd.list->EndQuery(m_TimestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, frame.queryIndex + 1);
+		cmd.list->ResolveQueryData(m_TimestampHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, frame.queryIndex, frame.traced ? FRAME_TIMESTAMP_COUNT : 2, m_TimestampReadback.Get(), frame.queryIndex * sizeof(uint64_t));
+	});
+	std::vector<PooledCommandList*> lists = m_DirectLists.Record(m_RecordPool, jobs);
+	m_RateHistoryValid |= frame.traced;
+	if (frame.traced) {
+		bool unchanged = m_SettledFrames > 0 && m_TracedScene.GetVersion() == m_Scene.GetVersion() && m_TracedWidth == frame.traceWidth && m_TracedHeight == frame.traceHeight;
+		m_SettledFrames = unchanged ? m_SettledFrames + 1 : 1;
+		m_TracedScene = m_Scene;
+		m_DirtyRegion.Clear();
+		m_TracedWidth = frame.traceWidth;
+		m_TracedHeight = frame.traceHeight;
+	}
+	//profiler timestamps are resolved after every list that wrote them
+	if (m_GpuProfiler.HasScopes(m_FrameIndex)) {
+		PooledCommandList* resolve = m_DirectLists.Acquire();
+		m_GpuProfiler.Resolve(resolve->list.Get(), m_FrameIndex);
+		HR(resolve->list->Close(), "Closing profiler CmdList");
+		lists.push_back(resolve);
+	}
+
+	//submit the frame list with the uploads first, then the pooled lists in job order
+	HR(m_CmdList->Close(), "Closing CmdList");
+	std::vector<ID3D12CommandList*> commandLists = { m_CmdList.Get() };
+	for (PooledCommandList* cmd : lists)
+		commandLists.push_back(cmd->list.Get());
+	m_CmdQueue->ExecuteCommandLists((UINT)commandLists.size(), commandLists.data());
+	frame.cpuMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - recordStart).count();
 	//present
-	HRESULT hr = m_Swapchain->Present(1, 0);
+	if (!m_Headless)
+		m_Swapchain->Present(1, 0);
+	if (!m_FirstFramePresented) {
+		printf("Time to first frame: %.2f ms\n", std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_InitStart).count());
+		m_FirstFramePresented = true;
+	}
 
 	// Schedule a Signal command in the queue.
-	const UINT64 currentFenceValue = m_SwapFenceValue[m_CurrentFrame];
-	HR(m_CmdQueue->Signal(m_SwapFence.Get(), currentFenceValue), "Signal fence");
-	// Update the back buffer index.
-	m_CurrentFrame = m_Swapchain->GetCurrentBackBufferIndex();
-	// If the next frame is not ready to be rendered yet, wait until it is ready.
-	if (m_SwapFence->GetCompletedValue() < m_SwapFenceValue[m_CurrentFrame]){
-		HR(m_SwapFence->SetEventOnCompletion(m_SwapFenceValue[m_CurrentFrame], m_SwapEvent), "Set event");
-		WaitForSingleObjectEx(m_SwapEvent, INFINITE, FALSE);
-	}
-	// Set the fence value for the next frame.
-	m_SwapFenceValue[m_CurrentFrame] = currentFenceValue + 1;
-
-	m_CmdAllocator[m_CurrentFrame]->Reset();
-	HR(m_CmdList->Reset(m_CmdAllocator[m_CurrentFrame].Get(), nullptr), "Reset Command list");
+	const UINT64 currentFenceValue = m_FrameTimeline.Signal(m_CmdQueue.Get());
+	frame.fenceValue = currentFenceValue;
+	frame.pending = true;
+	m_UploadRing.Retire(currentFenceValue);
+	m_DirectLists.Retire(lists, currentFenceValue);
+	//a captured frame's gpu scopes are collected once its context comes round again
+	Profiler::EndFrame(m_FrameCount);
+	BeginFrame();
+	return true;
 }
\ No newline at end of file
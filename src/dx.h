@@ -6,54 +6,318 @@
 #include <dx/D3D12RaytracingFallback.h>
 #include <wrl/client.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
 #include "dxshader.h"
+#include "uploadring.h"
+#include "resourcepool.h"
+#include "descriptorallocator.h"
+#include "pipelinemanager.h"
+#include "d3d12commandlists.h"
+#include "blasbuilder.h"
+#include "d3d12timeline.h"
+#include "profiler.h"
+#include "imagewriter.h"
+#include "adaptivesampler.h"
+#include "denoiser.h"
+#include "resolutioncontroller.h"
+#include "upsampler.h"
+#include "reconstructor.h"
+#include "sceneversion.h"
+#include "dirtyregion.h"
+#include "raybatch.h"
 using Microsoft::WRL::ComPtr;
 #define HR(x, s) if(x != S_OK) {MessageBoxA(nullptr, s, "Failure", MB_OK);}
-#define BUFFER_COUNT 2
+#define MAX_FRAMES_IN_FLIGHT 4
+#define FRAME_STATS_INTERVAL 240
+#define UPLOAD_RING_SIZE (16 * 1024 * 1024)
+#define AS_POOL_HEAP_SIZE (64 * 1024 * 1024)
+#define BLAS_SCRATCH_BUDGET (32 * 1024 * 1024)
+#define DESCRIPTOR_PAGE_SIZE 1024
+#define PROGRESSIVE_MAX_SAMPLES 1024
+//frames copied out for the denoiser and not yet filtered, each holds its accumulation and auxiliary buffer
+#define DENOISE_MAX_PENDING 2
+//frame begin and end, then DispatchRays begin and end
+#define FRAME_TIMESTAMP_COUNT 4
+#define DYNAMIC_RESOLUTION_MIN_SCALE 0.5f
+//luminance step between neighbours below which a 2x2 block is traced at 1/2, below half of it at 1/4
+#define TRACE_RATE_GRADIENT_THRESHOLD 0.05f
+//every this many frames a reduced rate frame is compared against a full rate trace of the same frame
+#define TRACE_RATE_METRICS_INTERVAL FRAME_STATS_INTERVAL
+//in 8 bit levels, pixels differing by more count as visibly wrong
+#define TRACE_RATE_ERROR_THRESHOLD 8
+//frames traced at an unchanged scene before a reduced trace rate has refreshed every pixel
+#define TRACE_RATE_SETTLE_FRAMES 4
+//which instances go into a tlas: their mask shares a bit with includeMask and their world bounds touch the region
+struct TLASFilter {
+	uint8_t includeMask = INSTANCE_MASK_ALL;
+	glm::vec3 regionMin = glm::vec3(-FLT_MAX);
+	glm::vec3 regionMax = glm::vec3(FLT_MAX);
+};
 class DXEngine {
 public:
 	DXEngine(){}
 	~DXEngine(){}
 
-	void Init(HWND hWnd, int w, int h);
-	void Render();
+	//framesInFlight is how many frames the cpu may record ahead of the gpu, 1 to MAX_FRAMES_IN_FLIGHT
+	void Init(HWND hWnd, int w, int h, uint32_t framesInFlight = 2);
+	//no window or swapchain, every frame is read back and written to outputPrefix_NNNNN.ppm/png
+	//and its timings are logged to outputPrefix_timings.csv
+	void InitHeadless(int w, int h, uint32_t framesInFlight, const char* outputPrefix, ImageFormat format);
+	//accumulates samples across frames and only traces tiles whose relative error is above targetError, call before Init
+	void EnableProgressive(float targetError, uint32_t maxSamples = PROGRESSIVE_MAX_SAMPLES);
+	//progressive only, true once every tile reached the target error or the sample cap
+	bool IsConverged() const { return m_Sampler.IsConverged(); }
+	//headless only, written images are filtered with the cpu denoiser, call before InitHeadless
+	void EnableDenoiser(uint32_t iterations = DENOISE_ITERATIONS);
+	//scales the trace resolution so DispatchRays stays within budgetMs and upsamples to the output, call before Init
+	void EnableDynamicResolution(float budgetMs);
+	//traces only some pixels per frame and reconstructs the rest from earlier frames, call before Init
+	void EnableTraceRate(TraceRate mode, float gradientThreshold = TRACE_RATE_GRADIENT_THRESHOLD);
+	//replaces the tessellated sphere with count analytic spheres, one aabb each, call before Init
+	//the first is the unit sphere the triangles approximated, the rest are small ones scattered around it
+	void EnableAnalyticSpheres(uint32_t count) { m_SphereCount = count; }
+	//false if nothing changed since the last traced frame and it was presented again without recording any work
+	bool Render();
+	//tells the engine about a change it can not see itself, the next Render retraces
+	void InvalidateScene(SceneComponent component) { m_Scene.Bump(component); }
+	uint32_t GetInstanceCount() const { return (uint32_t)m_Instances.size(); }
+	//moves an instance, the tlas is rebuilt on the next frame which only retraces the tiles its old and new bounds cover
+	void SetInstanceTransform(uint32_t instance, const glm::mat4& transform);
+	//set false for shaders that cast secondary rays, an edit then retraces the whole frame and view culling is off
+	void SetPrimaryVisibilityOnly(bool primaryOnly) { m_PrimaryVisibilityOnly = primaryOnly; m_TLASDirty = true; }
+	//InstanceMask of an instance, INSTANCE_MASK_* bits, instances no enabled tlas asks for are left out of all of them
+	void SetInstanceMask(uint32_t instance, uint8_t mask);
+	//rebuilds that tlas with only the instances its filter passes, enabling it if it was not
+	void SetTLASFilter(SceneTLAS tlas, const TLASFilter& filter);
+	//also drops instances the primary rays can not reach from the primary tlas, as long as they are the only rays
+	void EnableViewCulling(bool enable) { m_ViewCulling = enable; m_TLASDirty = true; }
+	//instances in the last build of that tlas, 0 while it is disabled
+	uint32_t GetTLASInstanceCount(SceneTLAS tlas) const { return m_TLAS[tlas].instanceCount; }
+	//queries the cpu copy of the scene without rendering, for picking, line of sight and the like
+	void TraceBatch(const RayBatch& rays, const HitBatch& hits, uint32_t flags = CPU_TRACE_CLOSEST_HIT);
+	//proximity queries on the same cpu bvh, see raybatch.h
+	void FindClosestPoints(const PointBatch& points, const ClosestPointResults& results);
+	void OverlapBatch(const CpuOverlapVolume* volumes, uint32_t count, std::vector<std::vector<CpuOverlap>>& results);
+	void CullFrustumBatch(const CpuFrustum* frustums, uint32_t count, std::vector<std::vector<uint32_t>>& visible);
+	//waits for the frames in flight and their images, call before exiting a headless run
+	void Finish();
 private:
 	void InitDXR();
+	void CreateSwapchain(HWND hWnd);
+	//builds the scene from either the triangles or the spheres, the other is empty
+	void BuildAccelerationStructures(const std::vector<glm::vec3>& vertices, const std::vector<glm::vec4>& spheres);
+	//one tlas build, its buffers and instances were allocated up front so any thread can record it
+	struct TLASBuild {
+		D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC desc;
+		ComPtr<ID3D12Resource> scratch;
+		ComPtr<ID3D12Resource> result;
+	};
+	//builds every enabled tlas from m_Instances, the old ones are released once the frame recorded now completes
+	void BuildTLAS(ID3D12GraphicsCommandList* cmdList, ID3D12RaytracingFallbackCommandList* rtCmdList);
+	//allocates and fills in the builds and the new pointers on the calling thread, flush the descriptors before they run
+	std::vector<TLASBuild> PrepareTLASBuilds();
+	//only reads engine state, safe on a recording thread
+	void RecordTLASBuilds(ID3D12GraphicsCommandList* cmdList, ID3D12RaytracingFallbackCommandList* rtCmdList, const std::vector<TLASBuild>& builds);
 	uint32_t AllocateDescriptor(D3D12_CPU_DESCRIPTOR_HANDLE* cpuDescriptor);
-	WRAPPED_GPU_POINTER CreateWrappedPointer(ID3D12RaytracingFallbackDevice* rtdevice, ID3D12Resource* resource, UINT bufferNumElements);
+	WRAPPED_GPU_POINTER CreateWrappedPointer(ID3D12RaytracingFallbackDevice* rtdevice, ID3D12Resource* resource, UINT bufferNumElements, uint32_t* descriptorIndex);
 	void ExecuteCommandList();
 	void WaitForGPU();
+	void ReclaimCompleted(uint64_t completedFenceValue);
+	//moves to the next frame context, waiting only if the gpu still uses it
+	void BeginFrame();
+	//handles a frame whose fence has completed: timings, profiler scopes and the headless image
+	void CompleteFrame(uint32_t frameIndex);
+	void ReadFrameTimings(uint32_t frameIndex);
+	//copies the output, and the accumulation and auxiliary buffers for the denoiser, to the frame's readbacks
+	void RecordReadbackCopies(ID3D12GraphicsCommandList* cmdList, uint32_t frameIndex);
+	//writes the frame's readback, denoised if the denoiser is on
+	void WriteImage(uint32_t frameIndex);
+	//copies the frame's accumulation and auxiliary readback and queues DenoiseImage on m_DenoisePool
+	void WriteDenoisedImage(uint32_t frameIndex);
+	//filters the accumulated color with the auxiliary buffer and hands the result to the image writer, runs on m_DenoisePool
+	void DenoiseImage(uint64_t frameNumber, uint32_t width, uint32_t height, const std::vector<float>& data);
+	//blocks until every queued frame is denoised and handed to the image writer
+	void FlushDenoise();
+	//compares the frame's reconstructed image with its full rate trace and prints the result
+	void ReadTraceRateMetrics(uint32_t frameIndex);
+	//whether the output target already holds a final image of the current scene
+	bool CanReuseOutput() const;
+	//whether the next frame only needs the tiles in m_DirtyRegion retraced
+	bool CanTraceIncrementally() const;
+	//rebuilds the cpu scene's top level if instances moved since the last query
+	const CpuScene& GetCpuScene();
 private:
 	ComPtr<ID3D12Debug> m_Debug;
 	ComPtr<ID3D12Device3> m_Device;
 	ComPtr<IDXGISwapChain4> m_Swapchain;
 	ComPtr<IDXGIFactory4> m_DXGIFactory;
 	ComPtr<ID3D12CommandQueue> m_CmdQueue;
-	ComPtr<ID3D12CommandAllocator> m_CmdAllocator[BUFFER_COUNT];
 	ComPtr<ID3D12GraphicsCommandList> m_CmdList;
-	ComPtr<ID3D12Resource> m_SwapBuffers[BUFFER_COUNT];
-	ComPtr<ID3D12Fence> m_SwapFence;
-	uint64_t m_SwapFenceValue[BUFFER_COUNT];
-	HANDLE m_SwapEvent;
+	ComPtr<ID3D12Resource> m_SwapBuffers[MAX_FRAMES_IN_FLIGHT];
+	uint32_t m_SwapBufferCount;
+	//signaled by the direct queue once per frame, everything the frames use is retired on it
+	D3D12Timeline m_FrameTimeline;
 	ComPtr<ID3D12DescriptorHeap> m_RTVHeap;
 	uint32_t m_RTVDescSize;
-	uint32_t m_CurrentFrame; 
 
-	ComPtr<ID3D12DescriptorHeap> m_CBVSRVUAVHeap;
-	uint32_t m_AllocatedDescriptors = 0;
-	uint32_t m_DescSize;
+	//Everything a frame needs until the gpu is done with it.
+	//Upload and transient descriptor ranges come from the rings and are retired with the frame's fence value.
+	struct FrameContext {
+		ComPtr<ID3D12CommandAllocator> allocator;
+		uint64_t fenceValue = 0;
+		//FRAME_TIMESTAMP_COUNT timestamps, resolved to the readback buffer at the same index
+		uint32_t queryIndex = 0;
+		//whether DispatchRays was recorded and its timestamps written, and the resolution it traced at
+		bool traced = false;
+		uint32_t traceWidth = 0;
+		uint32_t traceHeight = 0;
+		double cpuMs = 0.0;
+		//headless only, the output target is copied here for the image writer
+		ComPtr<ID3D12Resource> readback;
+		//whether the output is read back and written once the frame completes
+		bool writeImage = false;
+		uint64_t frameNumber = 0;
+		//progressive only, the tiles traced by the frame and where its tile errors are copied to
+		ComPtr<ID3D12Resource> tileReadback;
+		std::vector<uint32_t> tileMask;
+		uint32_t samplerEpoch = 0;
+		//headless with the denoiser, accumulation followed by the auxiliary buffer
+		ComPtr<ID3D12Resource> denoiseReadback;
+		//reduced trace rate only, the reconstructed image, the full rate image and the count of traced pixels
+		ComPtr<ID3D12Resource> metricsReadback;
+		bool metricsFrame = false;
+		//submitted and not yet completed
+		bool pending = false;
+	};
+	FrameContext m_Frames[MAX_FRAMES_IN_FLIGHT];
+	uint32_t m_FrameCount;
+	uint32_t m_FrameIndex;
+	ComPtr<ID3D12QueryHeap> m_TimestampHeap;
+	ComPtr<ID3D12Resource> m_TimestampReadback;
+	uint64_t m_TimestampFrequency;
+	//named gpu ranges for profiler captures, slots indexed like m_Frames
+	GpuProfiler m_GpuProfiler;
+	struct FrameStats {
+		double frameMs = 0.0;
+		double cpuMs = 0.0;
+		double waitMs = 0.0;
+		double gpuMs = 0.0;
+		double dispatchMs = 0.0;
+		uint32_t frames = 0;
+		uint32_t dispatchFrames = 0;
+		uint32_t gpuFrames = 0;
+		uint32_t reusedFrames = 0;
+		uint32_t incrementalFrames = 0;
+		uint64_t incrementalTiles = 0;
+	} m_Stats;
+	std::chrono::high_resolution_clock::time_point m_FrameStart;
+	std::chrono::high_resolution_clock::time_point m_InitStart;
+	bool m_FirstFramePresented = false;
+	uint64_t m_FrameNumber = 0;
+	bool m_Headless = false;
+	D3D12_PLACED_SUBRESOURCE_FOOTPRINT m_ReadbackFootprint;
+	uint64_t m_ReadbackSize = 0;
+	ImageWriter m_ImageWriter;
+	FILE* m_TimingLog = nullptr;
+	uint32_t m_Width;
+	uint32_t m_Height;
+
+	DescriptorAllocator m_Descriptors;
 	//DXR stuff
 	struct ASBuffer {
-		ComPtr<ID3D12Resource> scratch;
-		ComPtr<ID3D12Resource> result;
-		ComPtr<ID3D12Resource> instanceDesc;
+		PooledBuffer result;
+		uint32_t descriptor = DescriptorAllocator::INVALID_INDEX;
 	};
+	//releases both once the frame recorded now completes
+	void FreeASBuffer(ASBuffer& buffer);
 	ComPtr<ID3D12RaytracingFallbackDevice> m_RTDevice;
 	ComPtr<ID3D12RaytracingFallbackCommandList> m_RTCmdList;
-	ComPtr<ID3D12Resource> m_VBO;
+	ComPtr<ID3D12CommandQueue> m_ComputeQueue;
+	ComPtr<ID3D12CommandAllocator> m_ComputeAllocator;
+	ComPtr<ID3D12GraphicsCommandList> m_ComputeList;
+	ComPtr<ID3D12RaytracingFallbackCommandList> m_RTComputeList;
+	UploadRing m_UploadRing;
+	ResourcePool m_ASPool;
+	BLASBuilder m_BLASBuilder;
 	ASBuffer m_BLAS;
-	ASBuffer m_TLAS;
-	ComPtr<ID3D12Fence> m_InitFence;
-	RaytracingPipeline m_PipelineState;
-	ShaderTable m_ShaderTable;
+	WRAPPED_GPU_POINTER m_BLASPointer;
+	uint32_t m_SphereCount = 0;
+	//center and radius per sphere, read by the intersection shader
+	ComPtr<ID3D12Resource> m_Spheres;
+	struct Instance {
+		glm::mat4 transform = glm::mat4(1);
+		//object space bounds of its blas
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		SceneHitGroup hitGroup = SCENE_HIT_GROUP_TRIANGLES;
+		uint8_t mask = INSTANCE_MASK_ALL;
+		//conservative world bounds under transform
+		void GetWorldBounds(const glm::mat4& m, glm::vec3& worldMin, glm::vec3& worldMax) const;
+	};
+	std::vector<Instance> m_Instances;
+	bool m_TLASDirty = false;
+	struct FilteredTLAS {
+		TLASFilter filter;
+		bool enabled = false;
+		uint32_t instanceCount = 0;
+		ASBuffer buffer;
+		WRAPPED_GPU_POINTER pointer;
+	};
+	FilteredTLAS m_TLAS[SCENE_TLAS_COUNT];
+	bool m_ViewCulling = false;
+	//same geometry and instances as the acceleration structures, its top level is rebuilt lazily by TraceBatch
+	CpuScene m_CpuScene;
+	bool m_CpuSceneDirty = false;
+	//signaled by the compute queue once the acceleration structures are built
+	D3D12Timeline m_ComputeTimeline;
+	ThreadPool m_ThreadPool;
+	//kept apart from m_ThreadPool so recording never queues behind shader compiles
+	ThreadPool m_RecordPool;
+	D3D12CommandListPool m_DirectLists;
+	ShaderCompiler m_ShaderCompiler;
+	PipelineManager m_Pipelines;
+	ShaderTableBuilder m_ShaderTable;
+	bool m_ShaderTableReady = false;
+	ComPtr<ID3D12Resource> m_OutputTarget;
+	uint32_t m_OutputUAV;
+	//running sums per pixel and the per tile errors the raygen writes for m_Sampler
+	ComPtr<ID3D12Resource> m_Accumulation;
+	ComPtr<ID3D12Resource> m_TileErrors;
+	ComPtr<ID3D12Resource> m_Auxiliary;
+	AdaptiveSampler m_Sampler;
+	float m_TargetError = 0.0f;
+	uint32_t m_MaxSamples = PROGRESSIVE_MAX_SAMPLES;
+	bool m_ConvergedReported = false;
+	Denoiser m_Denoiser;
+	bool m_DenoiseEnabled = false;
+	//one thread, so frames are denoised in order and m_Denoiser and m_ImageWriter are never used by two jobs at once.
+	//the row bands of each frame still go to m_ThreadPool, a job waiting on them never blocks a thread they need
+	ThreadPool m_DenoisePool;
+	std::vector<std::future<void>> m_PendingDenoise;
+	ResolutionController m_Resolution;
+	float m_FrameBudgetMs = 0.0f;
+	Upsampler m_Upsampler;
+	TraceRate m_TraceRate = TRACE_RATE_FULL;
+	float m_RateThreshold = TRACE_RATE_GRADIENT_THRESHOLD;
+	//reduced rate frames need every pixel traced once since the last reset
+	bool m_RateHistoryValid = false;
+	ComPtr<ID3D12Resource> m_BlockRates;
+	uint32_t m_BlockCountX = 0;
+	uint32_t m_BlockCount = 0;
+	Reconstructor m_Reconstructor;
+	SceneVersion m_Scene;
+	uint64_t m_ShaderTableVersion = 0;
+	//scene version and trace size of the last traced frame, and how many frames in a row were traced with them
+	SceneVersion m_TracedScene;
+	uint32_t m_TracedWidth = 0;
+	uint32_t m_TracedHeight = 0;
+	uint32_t m_SettledFrames = 0;
+	//tiles covered by instance edits since the last traced frame
+	DirtyRegion m_DirtyRegion;
+	bool m_PrimaryVisibilityOnly = true;
+	RayGenConstants m_RayGenConstants = { glm::vec4(-1, 1, -1, 1), glm::vec4(-1, 1, -1, 1) };
 };
\ No newline at end of file
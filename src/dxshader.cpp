@@ -1,42 +1,12 @@
 #include "dxshader.h"
-#include <dx/dxcapi.use.h>
+#include "profiler.h"
 #include <dx/D3D12RaytracingPrototypeHelpers.hpp>
 #include <dx/d3dx12.h>
 #include <fstream>
-#include <sstream>
+#include <string.h>
 #include <string>
 #include <vector>
 #include <glm/glm.hpp> 
-using namespace dxc;
-
-ComPtr<IDxcBlob> CompileLibrary(const wchar_t* filename) {
-	dxc::DxcDllSupport dllSupport;
-	dllSupport.Initialize();
-	IDxcCompiler* dxcCompiler;
-	IDxcLibrary* dxcLibrary;
-	dllSupport.CreateInstance(CLSID_DxcCompiler, &dxcCompiler);
-	dllSupport.CreateInstance(CLSID_DxcLibrary, &dxcLibrary);
-
-	std::ifstream file(filename);
-	std::stringstream ss;
-	ss << file.rdbuf();
-	std::string str = ss.str();
-	IDxcBlobEncoding* textBlob;
-	dxcLibrary->CreateBlobWithEncodingFromPinned((LPBYTE)str.data(), str.size(), 0, &textBlob);
-	IDxcOperationResult* result;
-	dxcCompiler->Compile(textBlob, filename, L"", L"lib_6_1", nullptr, 0, nullptr, 0, nullptr, &result);
-	HRESULT status;
-	result->GetStatus(&status);
-	if (FAILED(status)) {
-		IDxcBlobEncoding* error;
-		result->GetErrorBuffer(&error);
-		printf("ShaderCompiler: Error! \n%s\n", (char*)error->GetBufferPointer());
-	}
-
-	ComPtr<IDxcBlob> ret;
-	status = result->GetResult(&ret);
-	return ret;
-}
 
 struct DXILLib {
 	DXILLib(ID3DBlob* pblob, const WCHAR* entryPoint[], uint32_t entryPointCount) {
@@ -72,9 +42,17 @@ void CreateRootSigns(ID3D12RaytracingFallbackDevice* device, ComPtr<ID3D12RootSi
 	{
 		CD3DX12_DESCRIPTOR_RANGE UAVDescriptor;
 		UAVDescriptor.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
-		CD3DX12_ROOT_PARAMETER rootParameters[2];
-		rootParameters[0].InitAsDescriptorTable(1, &UAVDescriptor);
-		rootParameters[1].InitAsShaderResourceView(0);
+		CD3DX12_ROOT_PARAMETER rootParameters[GLOBAL_ROOT_COUNT];
+		rootParameters[GLOBAL_ROOT_OUTPUT].InitAsDescriptorTable(1, &UAVDescriptor);
+		rootParameters[GLOBAL_ROOT_SCENE].InitAsShaderResourceView(0);
+		rootParameters[GLOBAL_ROOT_ACCUMULATION].InitAsUnorderedAccessView(1);
+		rootParameters[GLOBAL_ROOT_TILE_ERRORS].InitAsUnorderedAccessView(2);
+		rootParameters[GLOBAL_ROOT_TILE_MASK].InitAsShaderResourceView(1);
+		rootParameters[GLOBAL_ROOT_AUXILIARY].InitAsUnorderedAccessView(3);
+		rootParameters[GLOBAL_ROOT_SAMPLE_CONSTANTS].InitAsConstants(sizeof(SampleConstants) / sizeof(uint32_t), 1);
+		rootParameters[GLOBAL_ROOT_BLOCK_RATES].InitAsUnorderedAccessView(4);
+		rootParameters[GLOBAL_ROOT_SPHERES].InitAsShaderResourceView(2);
+		rootParameters[GLOBAL_ROOT_SHADOW_SCENE].InitAsShaderResourceView(3);
 		CD3DX12_ROOT_SIGNATURE_DESC globalRootSignatureDesc(ARRAYSIZE(rootParameters), rootParameters);
 		ComPtr<ID3DBlob> signBlob, errorBlob;
 		HR(device->D3D12SerializeRootSignature(&globalRootSignatureDesc, D3D_ROOT_SIGNATURE_VERSION_1, &signBlob, &errorBlob), "Failed to serialize global root signature");
@@ -85,7 +63,7 @@ void CreateRootSigns(ID3D12RaytracingFallbackDevice* device, ComPtr<ID3D12RootSi
 	{
 		CD3DX12_DESCRIPTOR_RANGE UAVDescriptor;
 		CD3DX12_ROOT_PARAMETER rootParameters[1];
-		rootParameters[0].InitAsConstants(sizeof(glm::vec4) * 2, 0, 0);
+		rootParameters[0].InitAsConstants(sizeof(glm::vec4) * 2 / sizeof(uint32_t), 0, 0);
 		CD3DX12_ROOT_SIGNATURE_DESC localRootSignatureDesc(ARRAYSIZE(rootParameters), rootParameters);
 		localRootSignatureDesc.Flags = D3D12_ROOT_SIGNATURE_FLAG_LOCAL_ROOT_SIGNATURE;
 		ComPtr<ID3DBlob> signBlob, errorBlob;
@@ -94,98 +72,207 @@ void CreateRootSigns(ID3D12RaytracingFallbackDevice* device, ComPtr<ID3D12RootSi
 	}
 }
 
-RaytracingPipeline CompileRTPipeline(ID3D12RaytracingFallbackDevice* rtDevice, const wchar_t* filename) {
-	ComPtr<ID3D12RootSignature> globalRootSign;
-	ComPtr<ID3D12RootSignature> localRootSign;
+//shaders used through a hit group are reached by the hit group name, everything else directly
+static std::vector<std::wstring> GetEntryPoints(const ShaderLibrary& library) {
+	std::vector<std::wstring> entryPoints;
+	for (auto& exportName : library.exports) {
+		bool imported = false;
+		for (auto& group : library.hitGroups)
+			imported |= group.closestHit == exportName || group.anyHit == exportName || group.intersection == exportName;
+		if (!imported)
+			entryPoints.push_back(exportName);
+	}
+	for (auto& group : library.hitGroups)
+		entryPoints.push_back(group.name);
+	return entryPoints;
+}
 
-	CreateRootSigns(rtDevice, &localRootSign, &globalRootSign);
+static void ResolveShaderIdentifiers(ID3D12RaytracingFallbackDevice* rtDevice, RaytracingPipeline& rtPipe) {
+	//known exports keep their handle so tables and saved handles stay valid across rebuilds
+	uint32_t handleCount = 0;
+	for (auto& handle : rtPipe.exportHandles)
+		handleCount = handle.second + 1 > handleCount ? handle.second + 1 : handleCount;
+	for (auto& library : rtPipe.libraries)
+		for (auto& entryPoint : GetEntryPoints(library))
+			if (rtPipe.exportHandles.find(entryPoint) == rtPipe.exportHandles.end())
+				rtPipe.exportHandles[entryPoint] = handleCount++;
 
-	ComPtr<IDxcBlob> codeBlob = CompileLibrary(filename);
+	rtPipe.shaderIDSize = rtDevice->GetShaderIdentifierSize();
+	rtPipe.shaderIDs.assign((size_t)handleCount * rtPipe.shaderIDSize, 0);
+	for (auto& handle : rtPipe.exportHandles) {
+		void* id = rtPipe.pipelineState->GetShaderIdentifier(handle.first.c_str());
+		if (id)
+			memcpy(rtPipe.shaderIDs.data() + (size_t)handle.second * rtPipe.shaderIDSize, id, rtPipe.shaderIDSize);
+	}
+}
 
-	CD3D12_STATE_OBJECT_DESC stateObjectDesc{D3D12_STATE_OBJECT_TYPE_RAYTRACING_PIPELINE};
+ComPtr<ID3D12RaytracingFallbackStateObject> CreateRTCollection(ID3D12RaytracingFallbackDevice* rtDevice, const RaytracingPipeline& rtPipe, const ShaderLibrary& library, IDxcBlob* blob) {
+	PROFILE_SCOPE("CreateRTCollection");
+	CD3D12_STATE_OBJECT_DESC stateObjectDesc{D3D12_STATE_OBJECT_TYPE_COLLECTION};
 	auto lib = stateObjectDesc.CreateSubobject<CD3D12_DXIL_LIBRARY_SUBOBJECT>();
 	D3D12_SHADER_BYTECODE libDXIL{};
-	libDXIL.pShaderBytecode = codeBlob->GetBufferPointer();
-	libDXIL.BytecodeLength = codeBlob->GetBufferSize();
+	libDXIL.pShaderBytecode = blob->GetBufferPointer();
+	libDXIL.BytecodeLength = blob->GetBufferSize();
 	lib->SetDXILLibrary(&libDXIL);
-	lib->DefineExport(rayGenStr);
-	lib->DefineExport(missStr);
-	lib->DefineExport(chsStr);
+	for (auto& exportName : library.exports)
+		lib->DefineExport(exportName.c_str());
 
-	auto hitGroup = stateObjectDesc.CreateSubobject<CD3D12_HIT_GROUP_SUBOBJECT>();
-	hitGroup->SetClosestHitShaderImport(chsStr);
-	hitGroup->SetHitGroupExport(hitGroupStr);
+	std::vector<std::wstring> entryPoints = GetEntryPoints(library);
+	for (auto& group : library.hitGroups) {
+		auto hitGroup = stateObjectDesc.CreateSubobject<CD3D12_HIT_GROUP_SUBOBJECT>();
+		if (!group.closestHit.empty())
+			hitGroup->SetClosestHitShaderImport(group.closestHit.c_str());
+		if (!group.anyHit.empty())
+			hitGroup->SetAnyHitShaderImport(group.anyHit.c_str());
+		if (!group.intersection.empty())
+			hitGroup->SetIntersectionShaderImport(group.intersection.c_str());
+		hitGroup->SetHitGroupExport(group.name.c_str());
+	}
 
 	auto shaderConfig = stateObjectDesc.CreateSubobject<CD3D12_RAYTRACING_SHADER_CONFIG_SUBOBJECT>();
-	shaderConfig->Config(4, 8);
+	//payload is color, depth, normal and albedo, attributes are barycentrics or a sphere's normal
+	shaderConfig->Config(sizeof(float) * 10, sizeof(float) * 3);
 
 	auto shaderConfigAssociation = stateObjectDesc.CreateSubobject<CD3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION_SUBOBJECT>();
 	shaderConfigAssociation->SetSubobjectToAssociate(*shaderConfig);
-	shaderConfigAssociation->AddExport(rayGenStr);
-	shaderConfigAssociation->AddExport(missStr);
-	shaderConfigAssociation->AddExport(hitGroupStr);
+	for (auto& entryPoint : entryPoints)
+		shaderConfigAssociation->AddExport(entryPoint.c_str());
 
 	auto localRootSignature = stateObjectDesc.CreateSubobject<CD3D12_LOCAL_ROOT_SIGNATURE_SUBOBJECT>();
-	localRootSignature->SetRootSignature(localRootSign.Get());
+	localRootSignature->SetRootSignature(rtPipe.localRootSig.Get());
 
 	auto rootSignatureAssociation = stateObjectDesc.CreateSubobject<CD3D12_SUBOBJECT_TO_EXPORTS_ASSOCIATION_SUBOBJECT>();
 	rootSignatureAssociation->SetSubobjectToAssociate(*localRootSignature);
-	rootSignatureAssociation->AddExport(rayGenStr);
-	rootSignatureAssociation->AddExport(missStr);
-	rootSignatureAssociation->AddExport(hitGroupStr);
+	for (auto& entryPoint : entryPoints)
+		rootSignatureAssociation->AddExport(entryPoint.c_str());
+
+	auto globalRootSignature = stateObjectDesc.CreateSubobject<CD3D12_ROOT_SIGNATURE_SUBOBJECT>();
+	globalRootSignature->SetRootSignature(rtPipe.globalRootSig.Get());
+
+	auto pipelineConfig = stateObjectDesc.CreateSubobject<CD3D12_RAYTRACING_PIPELINE_CONFIG_SUBOBJECT>();
+	pipelineConfig->Config(2);
+
+	ComPtr<ID3D12RaytracingFallbackStateObject> collection;
+	HR(rtDevice->CreateStateObject(stateObjectDesc, IID_PPV_ARGS(&collection)), "Failed to create collection");
+	return collection;
+}
+
+void LinkRTPipeline(ID3D12RaytracingFallbackDevice* rtDevice, RaytracingPipeline& rtPipe) {
+	PROFILE_SCOPE("LinkRTPipeline");
+	CD3D12_STATE_OBJECT_DESC stateObjectDesc{D3D12_STATE_OBJECT_TYPE_RAYTRACING_PIPELINE};
+	for (auto& collection : rtPipe.collections) {
+		auto existing = stateObjectDesc.CreateSubobject<CD3D12_EXISTING_COLLECTION_SUBOBJECT>();
+		existing->SetExistingCollection(collection->GetStateObjectPrototype());
+	}
 
 	auto globalRootSignature = stateObjectDesc.CreateSubobject<CD3D12_ROOT_SIGNATURE_SUBOBJECT>();
-	globalRootSignature->SetRootSignature(globalRootSign.Get());
+	globalRootSignature->SetRootSignature(rtPipe.globalRootSig.Get());
 
 	auto pipelineConfig = stateObjectDesc.CreateSubobject<CD3D12_RAYTRACING_PIPELINE_CONFIG_SUBOBJECT>();
 	pipelineConfig->Config(2);
 
+	rtPipe.pipelineState.Reset();
+	HR(rtDevice->CreateStateObject(stateObjectDesc, IID_PPV_ARGS(&rtPipe.pipelineState)), "Failed to link pipeline");
+	if (rtPipe.pipelineState)
+		ResolveShaderIdentifiers(rtDevice, rtPipe);
+}
+
+std::future<RaytracingPipeline> RebuildRTPipelineAsync(ThreadPool& pool, ID3D12RaytracingFallbackDevice* rtDevice, ShaderCompiler& compiler, const RaytracingPipeline& base, const std::vector<uint32_t>& changed) {
+	auto rtPipe = std::make_shared<RaytracingPipeline>(base);
+	rtPipe->pipelineState.Reset();
+	rtPipe->collections.resize(rtPipe->libraries.size());
+
+	std::vector<std::shared_future<ComPtr<ID3D12RaytracingFallbackStateObject>>> collections;
+	for (uint32_t index : changed) {
+		collections.push_back(pool.Submit([rtDevice, &compiler, rtPipe, index]() {
+			const ShaderLibrary& library = rtPipe->libraries[index];
+			ComPtr<IDxcBlob> blob = compiler.CompileLibrary(library.filename.c_str());
+			return blob ? CreateRTCollection(rtDevice, *rtPipe, library, blob.Get()) : nullptr;
+		}).share());
+	}
+	//the pool runs jobs in order, so the collections are already being built by the time this job waits on them
+	return pool.Submit([rtDevice, rtPipe, changed, collections]() {
+		for (size_t i = 0; i < changed.size(); ++i)
+			rtPipe->collections[changed[i]] = collections[i].get();
+		//a library that failed to compile leaves the pipeline without a state object
+		for (auto& collection : rtPipe->collections)
+			if (!collection)
+				return *rtPipe;
+		LinkRTPipeline(rtDevice, *rtPipe);
+		return *rtPipe;
+	});
+}
+
+std::future<RaytracingPipeline> CompileRTPipelineAsync(ThreadPool& pool, ID3D12RaytracingFallbackDevice* rtDevice, ShaderCompiler& compiler, const std::vector<ShaderLibrary>& libraries, const ExportMap& exportHandles) {
 	RaytracingPipeline rtPipe;
-	HRESULT hr = rtDevice->CreateStateObject(stateObjectDesc, IID_PPV_ARGS(&rtPipe.pipelineState));
-	rtPipe.localRootSig = localRootSign;
-	rtPipe.globalRootSig = globalRootSign;
-	return rtPipe;
+	CreateRootSigns(rtDevice, &rtPipe.localRootSig, &rtPipe.globalRootSig);
+	rtPipe.libraries = libraries;
+	rtPipe.exportHandles = exportHandles;
+	std::vector<uint32_t> all;
+	for (uint32_t i = 0; i < (uint32_t)libraries.size(); ++i)
+		all.push_back(i);
+	return RebuildRTPipelineAsync(pool, rtDevice, compiler, rtPipe, all);
 }
-inline UINT Align(UINT size, UINT alignment)
-{
-	return (size + (alignment - 1)) & ~(alignment - 1);
+
+static const uint32_t EXPORT_MAP_MAGIC = 0x50584552; //"REXP"
+
+bool SaveExportMap(const std::wstring& filename, const ExportMap& exportHandles) {
+	std::ofstream file(filename, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+		return false;
+	uint32_t count = (uint32_t)exportHandles.size();
+	file.write((const char*)&EXPORT_MAP_MAGIC, sizeof(EXPORT_MAP_MAGIC));
+	file.write((const char*)&count, sizeof(count));
+	for (auto& handle : exportHandles) {
+		uint32_t length = (uint32_t)handle.first.size();
+		file.write((const char*)&handle.second, sizeof(handle.second));
+		file.write((const char*)&length, sizeof(length));
+		file.write((const char*)handle.first.data(), length * sizeof(wchar_t));
+	}
+	return file.good();
 }
 
-void AllocateTableToUploadBuffer(ID3D12Device* device, void* shaderID, uint32_t shaderIDSize, void* rootArgs, uint32_t rootArgsSize, ComPtr<ID3D12Resource>& resourceOut ) {
-	const auto uploadHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
-	UINT size = Align(shaderIDSize + rootArgsSize, D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT);
-	auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(size);
-	device->CreateCommittedResource(
-		&uploadHeapProperties,
-		D3D12_HEAP_FLAG_NONE,
-		&bufferDesc,
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-		nullptr,
-		IID_PPV_ARGS(&resourceOut));
-	uint8_t *pMappedData;
-	resourceOut->Map(0, nullptr, reinterpret_cast<void**>(&pMappedData));
-	memcpy(pMappedData, shaderID, shaderIDSize);
-	memcpy(pMappedData + shaderIDSize, rootArgs, rootArgsSize);
-	resourceOut->Unmap(0, nullptr);
+bool LoadExportMap(const std::wstring& filename, ExportMap& exportHandles) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open())
+		return false;
+	uint32_t magic = 0, count = 0;
+	file.read((char*)&magic, sizeof(magic));
+	file.read((char*)&count, sizeof(count));
+	if (!file || magic != EXPORT_MAP_MAGIC)
+		return false;
+	ExportMap loaded;
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t handle = 0, length = 0;
+		file.read((char*)&handle, sizeof(handle));
+		file.read((char*)&length, sizeof(length));
+		if (!file || length > 4096)
+			return false;
+		std::wstring name(length, L'\0');
+		file.read((char*)&name[0], length * sizeof(wchar_t));
+		if (!file)
+			return false;
+		loaded[name] = handle;
+	}
+	exportHandles.swap(loaded);
+	return true;
 }
 
+void CompileShaderTable(RaytracingPipeline& rtPipe, ShaderTableBuilder& table, const RayGenConstants& rootArgs) {
+	//names are looked up once per build, records are written from the resolved identifiers
+	const void* rayGenID = rtPipe.GetShaderIdentifier(rtPipe.GetExportHandle(rayGenStr));
+	const void* missID = rtPipe.GetShaderIdentifier(rtPipe.GetExportHandle(missStr));
+	const wchar_t* hitGroupNames[SCENE_HIT_GROUP_COUNT] = { hitGroupStr, sphereHitGroupStr };
 
-ShaderTable CompileShaderTable(ID3D12Device* device, ID3D12RaytracingFallbackDevice* rtDevice, RaytracingPipeline& rtPipe) {
-	void* rayGenID = rtPipe.pipelineState->GetShaderIdentifier(rayGenStr);
-	void* missID = rtPipe.pipelineState->GetShaderIdentifier(missStr);
-	void* hitGroupID = rtPipe.pipelineState->GetShaderIdentifier(hitGroupStr);
-	uint32_t shaderIDSize = rtDevice->GetShaderIdentifierSize();
-
-	struct RootArgs {
-		glm::vec4 viewport;
-		glm::vec4 stencil;
-	} rootArgs;
-	rootArgs.viewport = { -1, 1, -1, 1 };
-	rootArgs.stencil = rootArgs.viewport;
-
-	ShaderTable table;
-	AllocateTableToUploadBuffer(device, rayGenID, shaderIDSize, &rootArgs, sizeof(rootArgs), table.rayGenTable);
-	AllocateTableToUploadBuffer(device, missID, shaderIDSize, &rootArgs, sizeof(rootArgs), table.missTable);
-	AllocateTableToUploadBuffer(device, hitGroupID, shaderIDSize, &rootArgs, sizeof(rootArgs), table.hitGroupTable);
-	return table;
+	table.SetSectionLayout(SHADER_TABLE_RAYGEN, 1, sizeof(rootArgs));
+	table.SetSectionLayout(SHADER_TABLE_MISS, 1, sizeof(rootArgs));
+	table.SetSectionLayout(SHADER_TABLE_HITGROUP, 0, sizeof(rootArgs));
+	table.SetRecord(SHADER_TABLE_RAYGEN, 0, rayGenID, &rootArgs, sizeof(rootArgs));
+	table.SetRecord(SHADER_TABLE_MISS, 0, missID, &rootArgs, sizeof(rootArgs));
+	//a range of a single geometry per kind of instance
+	for (uint32_t group = 0; group < SCENE_HIT_GROUP_COUNT; ++group) {
+		uint32_t hitGroupBase = table.AllocateHitGroupRange(1);
+		const void* hitGroupID = rtPipe.GetShaderIdentifier(rtPipe.GetExportHandle(hitGroupNames[group]));
+		table.SetRecord(SHADER_TABLE_HITGROUP, table.HitGroupRecordIndex(hitGroupBase, 0, 0), hitGroupID, &rootArgs, sizeof(rootArgs));
+	}
 }
\ No newline at end of file
@@ -2,25 +2,145 @@
 #include <dx/d3d12_1.h>
 #include <wrl/client.h>
 #include <dx/D3D12RaytracingFallback.h>
+#include <stdint.h>
+#include "shadertable.h"
+#include "shadercompiler.h"
+#include "threadpool.h"
+#include <future>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <glm/glm.hpp>
 using Microsoft::WRL::ComPtr;
 #define HR(x, s) if(x != S_OK) {MessageBoxA(nullptr, s, "Failure", MB_OK);}
 
+struct HitGroup {
+	std::wstring name;
+	std::wstring closestHit;
+	std::wstring anyHit;
+	std::wstring intersection;
+};
+
+//a dxil library, the exports the pipeline takes from it and the hit groups built from those exports
+struct ShaderLibrary {
+	std::wstring filename;
+	std::vector<std::wstring> exports;
+	std::vector<HitGroup> hitGroups;
+};
+
+//export name to the index of its shader identifier
+typedef std::unordered_map<std::wstring, uint32_t> ExportMap;
+static const uint32_t INVALID_EXPORT_HANDLE = ~0u;
+
+//every library is compiled into its own collection, the pipeline state links them.
+//shader identifiers are resolved once at link time, shader tables only index them by handle.
 struct RaytracingPipeline {
 	ComPtr<ID3D12RaytracingFallbackStateObject> pipelineState;
 	ComPtr<ID3D12RootSignature> localRootSig;
 	ComPtr<ID3D12RootSignature> globalRootSig;
+	std::vector<ShaderLibrary> libraries;
+	std::vector<ComPtr<ID3D12RaytracingFallbackStateObject>> collections;
+	ExportMap exportHandles;
+	std::vector<uint8_t> shaderIDs;
+	uint32_t shaderIDSize = 0;
+
+	uint32_t GetExportHandle(const std::wstring& name) const {
+		auto it = exportHandles.find(name);
+		return it == exportHandles.end() ? INVALID_EXPORT_HANDLE : it->second;
+	}
+	const void* GetShaderIdentifier(uint32_t handle) const {
+		return shaderIDSize > 0 && handle < shaderIDs.size() / shaderIDSize ? shaderIDs.data() + (size_t)handle * shaderIDSize : nullptr;
+	}
+};
+
+//global root signature slots, mirrored by the registers in raytracing.hlsl
+enum GlobalRootParameter {
+	GLOBAL_ROOT_OUTPUT,
+	GLOBAL_ROOT_SCENE,
+	GLOBAL_ROOT_ACCUMULATION,
+	GLOBAL_ROOT_TILE_ERRORS,
+	GLOBAL_ROOT_TILE_MASK,
+	GLOBAL_ROOT_AUXILIARY,
+	GLOBAL_ROOT_SAMPLE_CONSTANTS,
+	GLOBAL_ROOT_BLOCK_RATES,
+	GLOBAL_ROOT_SPHERES,
+	GLOBAL_ROOT_SHADOW_SCENE,
+	GLOBAL_ROOT_COUNT
 };
 
-struct ShaderTable {
-	ComPtr<ID3D12Resource> rayGenTable;
-	ComPtr<ID3D12Resource> missTable;
-	ComPtr<ID3D12Resource> hitGroupTable;
+//SampleConstants in raytracing.hlsl
+struct SampleConstants {
+	uint32_t sampleIndex;
+	uint32_t tileSize;
+	uint32_t tileCountX;
+	uint32_t resetAccumulation;
+	uint32_t rateMode;
+	uint32_t frameIndex;
+	uint32_t blockCountX;
+	uint32_t blockCount;
+};
+//which pixels get a primary ray each frame, TRACE_RATE_* in tracerate.hlsli
+enum TraceRate {
+	TRACE_RATE_FULL,
+	//half the pixels, alternating every frame
+	TRACE_RATE_CHECKERBOARD,
+	//one ray per 1, 2 or 4 pixels of each 2x2 block, fewer where the last frame was flat
+	TRACE_RATE_VARIABLE
 };
+//RayGenConstantBuffer in raytracing.hlsl, the local root arguments of every record
+//viewport is the orthographic camera, topLeft and bottomRight as x, y, z, w
+struct RayGenConstants {
+	glm::vec4 viewport;
+	glm::vec4 stencil;
+};
+//StructuredBuffer<float4> Spheres stride: center and radius
+#define SPHERE_STRIDE (sizeof(float) * 4)
+//RWStructuredBuffer<AccumPixel> stride
+#define ACCUM_PIXEL_STRIDE (sizeof(float) * 5)
+//RWStructuredBuffer<AuxPixel> stride: normal, depth, albedo
+#define AUX_PIXEL_STRIDE (sizeof(float) * 7)
 
 static wchar_t* rayGenStr = L"MyRaygenShader";
 static wchar_t* missStr = L"MyMissShader";
 static wchar_t* chsStr = L"MyClosestHitShader";
 static wchar_t* hitGroupStr = L"MyHitGroup";
+static wchar_t* sphereIntersectionStr = L"MySphereIntersectionShader";
+static wchar_t* sphereChsStr = L"MySphereClosestHitShader";
+static wchar_t* sphereHitGroupStr = L"MySphereHitGroup";
+
+//hit group ranges of the shader table, one geometry each, in this order
+//instances pick theirs with InstanceContributionToHitGroupIndex = group * ray type count
+enum SceneHitGroup {
+	SCENE_HIT_GROUP_TRIANGLES,
+	//procedural aabbs of the Spheres buffer in raytracing.hlsl
+	SCENE_HIT_GROUP_SPHERES,
+	SCENE_HIT_GROUP_COUNT
+};
+//InstanceMask bits, INSTANCE_MASK_* in raytracing.hlsl, a ray only visits instances sharing a bit with its mask
+enum InstanceMaskBits {
+	INSTANCE_MASK_VISIBLE = 1 << 0,
+	INSTANCE_MASK_SHADOW_CASTER = 1 << 1,
+	INSTANCE_MASK_ALL = 0xFF
+};
+//top level structures built from the same instances, each keeps only those its filter passes
+enum SceneTLAS {
+	//Scene in raytracing.hlsl, traced by the primary rays
+	SCENE_TLAS_PRIMARY,
+	//ShadowScene in raytracing.hlsl, the primary one is bound in its place until it is enabled
+	SCENE_TLAS_SHADOW,
+	SCENE_TLAS_COUNT
+};
+//tMax of the primary rays in raytracing.hlsl
+#define PRIMARY_RAY_T_MAX 10000.0f
 
-RaytracingPipeline CompileRTPipeline(ID3D12RaytracingFallbackDevice* rtDevice, const wchar_t* filename);
-ShaderTable CompileShaderTable(ID3D12Device* device, ID3D12RaytracingFallbackDevice* rtDevice,RaytracingPipeline& rtPipe);
+void CreateRootSigns(ID3D12RaytracingFallbackDevice* device, ComPtr<ID3D12RootSignature>* localRootSign, ComPtr<ID3D12RootSignature>* globalRootSign);
+ComPtr<ID3D12RaytracingFallbackStateObject> CreateRTCollection(ID3D12RaytracingFallbackDevice* rtDevice, const RaytracingPipeline& rtPipe, const ShaderLibrary& library, IDxcBlob* blob);
+void LinkRTPipeline(ID3D12RaytracingFallbackDevice* rtDevice, RaytracingPipeline& rtPipe);
+//compiles every library into a collection on the pool and links the pipeline as soon as the last one is done
+//exportHandles are handles from an earlier run, exports found in it keep their handle
+std::future<RaytracingPipeline> CompileRTPipelineAsync(ThreadPool& pool, ID3D12RaytracingFallbackDevice* rtDevice, ShaderCompiler& compiler, const std::vector<ShaderLibrary>& libraries, const ExportMap& exportHandles);
+//recompiles the changed libraries of base into new collections and relinks them with the untouched ones
+std::future<RaytracingPipeline> RebuildRTPipelineAsync(ThreadPool& pool, ID3D12RaytracingFallbackDevice* rtDevice, ShaderCompiler& compiler, const RaytracingPipeline& base, const std::vector<uint32_t>& changed);
+bool SaveExportMap(const std::wstring& filename, const ExportMap& exportHandles);
+bool LoadExportMap(const std::wstring& filename, ExportMap& exportHandles);
+void CompileShaderTable(RaytracingPipeline& rtPipe, ShaderTableBuilder& table, const RayGenConstants& rootArgs);
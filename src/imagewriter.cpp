@@ -0,0 +1,152 @@
+#include "imagewriter.h"
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+
+ImageWriter::~ImageWriter() {
+	Flush();
+}
+
+void ImageWriter::Init(ThreadPool* pool, const std::string& prefix, ImageFormat format) {
+	m_Pool = pool;
+	m_Prefix = prefix;
+	m_Format = format;
+}
+
+void ImageWriter::Write(uint64_t frameNumber, uint32_t width, uint32_t height, uint32_t rowPitch, const uint8_t* pixels) {
+	//drop finished writes, wait for the oldest if the disk can not keep up
+	for (size_t i = 0; i < m_Pending.size();) {
+		if (m_Pending[i].wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+			m_Failed += m_Pending[i].get() ? 0 : 1;
+			m_Pending.erase(m_Pending.begin() + i);
+		}
+		else {
+			++i;
+		}
+	}
+	if (m_Pending.size() >= IMAGE_WRITER_MAX_PENDING) {
+		m_Failed += m_Pending.front().get() ? 0 : 1;
+		m_Pending.erase(m_Pending.begin());
+	}
+
+	std::shared_ptr<std::vector<uint8_t>> rgb = std::make_shared<std::vector<uint8_t>>((size_t)width * height * 3);
+	for (uint32_t y = 0; y < height; ++y) {
+		const uint8_t* src = pixels + (size_t)y * rowPitch;
+		uint8_t* dst = rgb->data() + (size_t)y * width * 3;
+		for (uint32_t x = 0; x < width; ++x) {
+			dst[x * 3 + 0] = src[x * 4 + 0];
+			dst[x * 3 + 1] = src[x * 4 + 1];
+			dst[x * 3 + 2] = src[x * 4 + 2];
+		}
+	}
+	char filename[512];
+	snprintf(filename, sizeof(filename), "%s_%05llu.%s", m_Prefix.c_str(), (unsigned long long)frameNumber, m_Format == IMAGE_FORMAT_PNG ? "png" : "ppm");
+	std::string name = filename;
+	ImageFormat format = m_Format;
+	m_Pending.push_back(m_Pool->Submit([rgb, name, width, height, format]() {
+		bool written = format == IMAGE_FORMAT_PNG ? WritePNG(name.c_str(), width, height, rgb->data()) : WritePPM(name.c_str(), width, height, rgb->data());
+		if (!written)
+			printf("ImageWriter: Could not write %s\n", name.c_str());
+		return written;
+	}));
+}
+
+uint32_t ImageWriter::Flush() {
+	for (auto& pending : m_Pending)
+		m_Failed += pending.get() ? 0 : 1;
+	m_Pending.clear();
+	uint32_t failed = m_Failed;
+	m_Failed = 0;
+	return failed;
+}
+
+bool ImageWriter::WritePPM(const char* filename, uint32_t width, uint32_t height, const uint8_t* rgb) {
+	FILE* file = fopen(filename, "wb");
+	if (!file)
+		return false;
+	fprintf(file, "P6\n%u %u\n255\n", width, height);
+	size_t size = (size_t)width * height * 3;
+	bool written = fwrite(rgb, 1, size, file) == size;
+	return fclose(file) == 0 && written;
+}
+
+struct CrcTable {
+	CrcTable() {
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; ++k)
+				c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			values[i] = c;
+		}
+	}
+	uint32_t values[256];
+};
+
+static uint32_t Crc32(uint32_t crc, const uint8_t* data, size_t size) {
+	static const CrcTable table;
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i)
+		crc = table.values[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void PutBE32(std::vector<uint8_t>& out, uint32_t v) {
+	out.push_back((uint8_t)(v >> 24));
+	out.push_back((uint8_t)(v >> 16));
+	out.push_back((uint8_t)(v >> 8));
+	out.push_back((uint8_t)v);
+}
+
+static void PutChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data) {
+	PutBE32(out, (uint32_t)data.size());
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	PutBE32(out, Crc32(0, out.data() + start, out.size() - start));
+}
+
+//no compression, stored deflate blocks keep the writer free of dependencies and fast enough for a farm
+bool ImageWriter::WritePNG(const char* filename, uint32_t width, uint32_t height, const uint8_t* rgb) {
+	std::vector<uint8_t> raw;
+	raw.reserve(((size_t)width * 3 + 1) * height);
+	for (uint32_t y = 0; y < height; ++y) {
+		raw.push_back(0);
+		raw.insert(raw.end(), rgb + (size_t)y * width * 3, rgb + (size_t)(y + 1) * width * 3);
+	}
+
+	std::vector<uint8_t> zlib = { 0x78, 0x01 };
+	zlib.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+	uint32_t a = 1, b = 0;
+	for (size_t offset = 0; offset < raw.size();) {
+		size_t size = raw.size() - offset < 65535 ? raw.size() - offset : 65535;
+		zlib.push_back(offset + size == raw.size() ? 1 : 0);
+		zlib.push_back((uint8_t)size);
+		zlib.push_back((uint8_t)(size >> 8));
+		zlib.push_back((uint8_t)~size);
+		zlib.push_back((uint8_t)(~size >> 8));
+		zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + size);
+		for (size_t i = offset; i < offset + size; ++i) {
+			a = (a + raw[i]) % 65521;
+			b = (b + a) % 65521;
+		}
+		offset += size;
+	}
+	PutBE32(zlib, (b << 16) | a);
+
+	std::vector<uint8_t> header;
+	PutBE32(header, width);
+	PutBE32(header, height);
+	//8 bit rgb, deflate, adaptive filtering, no interlace
+	header.insert(header.end(), { 8, 2, 0, 0, 0 });
+
+	std::vector<uint8_t> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	PutChunk(png, "IHDR", header);
+	PutChunk(png, "IDAT", zlib);
+	PutChunk(png, "IEND", std::vector<uint8_t>());
+
+	FILE* file = fopen(filename, "wb");
+	if (!file)
+		return false;
+	bool written = fwrite(png.data(), 1, png.size(), file) == png.size();
+	return fclose(file) == 0 && written;
+}
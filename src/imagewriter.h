@@ -0,0 +1,38 @@
+#pragma once
+#include <stdint.h>
+#include <future>
+#include <string>
+#include <vector>
+#include "threadpool.h"
+#define IMAGE_WRITER_MAX_PENDING 8
+
+enum ImageFormat {
+	IMAGE_FORMAT_PPM,
+	IMAGE_FORMAT_PNG
+};
+
+//Writes rendered frames to disk on a thread pool, several images are encoded at once.
+//The pixels are copied on Write, so the caller may reuse its buffer right away.
+class ImageWriter {
+public:
+	ImageWriter(){}
+	~ImageWriter();
+
+	//images are named prefix_00000.ppm and so on
+	void Init(ThreadPool* pool, const std::string& prefix, ImageFormat format);
+	//rgba8 rows rowPitch bytes apart, alpha is dropped
+	//blocks only when IMAGE_WRITER_MAX_PENDING images are still being written
+	void Write(uint64_t frameNumber, uint32_t width, uint32_t height, uint32_t rowPitch, const uint8_t* pixels);
+	//blocks until every image is on disk, returns how many failed
+	uint32_t Flush();
+
+	//rgb8, tightly packed
+	static bool WritePPM(const char* filename, uint32_t width, uint32_t height, const uint8_t* rgb);
+	static bool WritePNG(const char* filename, uint32_t width, uint32_t height, const uint8_t* rgb);
+private:
+	ThreadPool* m_Pool = nullptr;
+	std::string m_Prefix;
+	ImageFormat m_Format = IMAGE_FORMAT_PPM;
+	std::vector<std::future<bool>> m_Pending;
+	uint32_t m_Failed = 0;
+};
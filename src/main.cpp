@@ -3,16 +3,75 @@
 #define GLFW_EXPOSE_NATIVE_WIN32
 #include <GLFW/glfw3native.h>
 #include "dx.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+//how long the window waits for input when the engine had nothing to retrace, shader edits are noticed at this rate
+#define IDLE_WAIT_SECONDS 0.05
 GLFWwindow* window;
 DXEngine dxEngine;
 int main(int argc, char** argv) {
+	//--frames N sets how many frames are in flight
+	//--profile N writes a trace of startup and the first N frames to profile.json
+	//--progressive E accumulates samples until every tile's relative error is below E
+	//--headless N renders N frames without a window and writes them to --out prefix (default frame) as --format ppm or png
+	//with --progressive N caps the frames and only the final image is written
+	//--denoise N filters written images with N a-trous passes, at most 8
+	//--budget MS lowers the trace resolution whenever DispatchRays takes longer than MS
+	//--rate checkerboard|variable traces only part of the pixels each frame and reconstructs the rest
+	//--spheres N replaces the tessellated sphere with N analytic spheres
+	uint32_t framesInFlight = 2;
+	uint32_t profileFrames = 0;
+	uint32_t headlessFrames = 0;
+	const char* outputPrefix = "frame";
+	ImageFormat format = IMAGE_FORMAT_PPM;
+	for (int i = 1; i + 1 < argc; ++i) {
+		if (strcmp(argv[i], "--frames") == 0)
+			framesInFlight = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--profile") == 0)
+			profileFrames = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--headless") == 0)
+			headlessFrames = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--out") == 0)
+			outputPrefix = argv[++i];
+		else if (strcmp(argv[i], "--progressive") == 0)
+			dxEngine.EnableProgressive((float)atof(argv[++i]));
+		else if (strcmp(argv[i], "--denoise") == 0)
+			dxEngine.EnableDenoiser((uint32_t)atoi(argv[++i]));
+		else if (strcmp(argv[i], "--budget") == 0)
+			dxEngine.EnableDynamicResolution((float)atof(argv[++i]));
+		else if (strcmp(argv[i], "--rate") == 0) {
+			const char* rate = argv[++i];
+			if (strcmp(rate, "checkerboard") == 0)
+				dxEngine.EnableTraceRate(TRACE_RATE_CHECKERBOARD);
+			else if (strcmp(rate, "variable") == 0)
+				dxEngine.EnableTraceRate(TRACE_RATE_VARIABLE);
+			else
+				printf("Unknown trace rate %s, expected checkerboard or variable, tracing every pixel\n", rate);
+		}
+		else if (strcmp(argv[i], "--spheres") == 0)
+			dxEngine.EnableAnalyticSpheres((uint32_t)atoi(argv[++i]));
+		else if (strcmp(argv[i], "--format") == 0)
+			format = strcmp(argv[++i], "png") == 0 ? IMAGE_FORMAT_PNG : IMAGE_FORMAT_PPM;
+	}
+	if (profileFrames > 0)
+		Profiler::BeginCapture(profileFrames, "profile.json");
+	if (headlessFrames > 0) {
+		dxEngine.InitHeadless(1280, 720, framesInFlight, outputPrefix, format);
+		for (uint32_t i = 0; i < headlessFrames && !dxEngine.IsConverged(); ++i)
+			dxEngine.Render();
+		dxEngine.Finish();
+		return 0;
+	}
 	glfwInit();
 	window = glfwCreateWindow(1280, 720, "DXR", nullptr, nullptr);
 	bool close = false;
-	dxEngine.Init(glfwGetWin32Window(window), 1280, 720);
+	dxEngine.Init(glfwGetWin32Window(window), 1280, 720, framesInFlight);
 	while (!glfwWindowShouldClose(window)) {
-		dxEngine.Render();
-		glfwPollEvents();
+		if (dxEngine.Render())
+			glfwPollEvents();
+		else
+			glfwWaitEventsTimeout(IDLE_WAIT_SECONDS);
 	}
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,90 @@
+#include "pipelinemanager.h"
+#include <chrono>
+#include <stdio.h>
+
+PipelineManager::~PipelineManager() {
+	//the rebuild jobs use the device and compiler, let them finish first
+	if (m_Building)
+		m_Pending.wait();
+	if (m_ChangeNotification != INVALID_HANDLE_VALUE)
+		FindCloseChangeNotification(m_ChangeNotification);
+}
+
+void PipelineManager::Init(ThreadPool* pool, ID3D12RaytracingFallbackDevice* rtDevice, ShaderCompiler* compiler, const wchar_t* shaderDir, const std::vector<ShaderLibrary>& libraries) {
+	m_Pool = pool;
+	m_RTDevice = rtDevice;
+	m_Compiler = compiler;
+	for (auto& library : libraries)
+		m_SourceHashes.push_back(m_Compiler->HashSourceFiles(library.filename.c_str()));
+	m_ChangeNotification = FindFirstChangeNotificationW(shaderDir, FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+	if (m_ChangeNotification == INVALID_HANDLE_VALUE)
+		printf("PipelineManager: Could not watch %ls, hot reload is disabled\n", shaderDir);
+
+	//handles handed out by earlier runs stay the same
+	ExportMap exportHandles;
+	m_ExportMapPath = m_Compiler->GetCacheDir() + L"/exports.bin";
+	LoadExportMap(m_ExportMapPath, exportHandles);
+	m_SavedExportCount = exportHandles.size();
+
+	m_Pending = CompileRTPipelineAsync(*m_Pool, m_RTDevice, *m_Compiler, libraries, exportHandles);
+	m_Building = true;
+}
+
+void PipelineManager::Update() {
+	if (m_ChangeNotification != INVALID_HANDLE_VALUE && WaitForSingleObject(m_ChangeNotification, 0) == WAIT_OBJECT_0) {
+		m_SourcesChanged = true;
+		FindNextChangeNotification(m_ChangeNotification);
+	}
+	//changes made while a rebuild is running are picked up after it has been swapped in
+	if (!m_SourcesChanged || m_Building)
+		return;
+	m_SourcesChanged = false;
+
+	//the notification only says something in the directory changed, the hashes tell which libraries are affected
+	std::vector<uint32_t> changed;
+	for (uint32_t i = 0; i < (uint32_t)m_Pipeline.libraries.size(); ++i) {
+		uint64_t hash = m_Compiler->HashSourceFiles(m_Pipeline.libraries[i].filename.c_str());
+		if (hash != m_SourceHashes[i]) {
+			m_SourceHashes[i] = hash;
+			changed.push_back(i);
+		}
+	}
+	if (changed.empty())
+		return;
+	m_Pending = RebuildRTPipelineAsync(*m_Pool, m_RTDevice, *m_Compiler, m_Pipeline, changed);
+	m_Building = true;
+}
+
+bool PipelineManager::SwapPipeline(uint64_t fenceValue) {
+	if (!m_Building || m_Pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		return false;
+	m_Building = false;
+	RaytracingPipeline pipeline = m_Pending.get();
+	if (!pipeline.pipelineState && m_Pipeline.pipelineState) {
+		printf("PipelineManager: Rebuild failed, keeping the current pipeline\n");
+		return false;
+	}
+	//frames already recorded with the old pipeline may still be in flight
+	if (m_Pipeline.pipelineState)
+		m_RetiredPipelines.push_back({ fenceValue, m_Pipeline });
+	m_Pipeline = pipeline;
+	//exports are only ever added, so a different count means new handles
+	if (m_Pipeline.exportHandles.size() != m_SavedExportCount && SaveExportMap(m_ExportMapPath, m_Pipeline.exportHandles))
+		m_SavedExportCount = m_Pipeline.exportHandles.size();
+	return m_Pipeline.pipelineState != nullptr;
+}
+
+void PipelineManager::Reclaim(uint64_t completedFenceValue) {
+	while (!m_RetiredPipelines.empty() && m_RetiredPipelines.front().fenceValue <= completedFenceValue)
+		m_RetiredPipelines.pop_front();
+}
+
+RaytracingPipeline& PipelineManager::GetPipeline() {
+	if (m_Building && m_Pipeline.libraries.empty()) {
+		m_Pending.wait();
+		SwapPipeline(0);
+		if (!m_Pipeline.pipelineState)
+			printf("PipelineManager: Pipeline failed to build\n");
+	}
+	return m_Pipeline;
+}
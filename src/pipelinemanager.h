@@ -0,0 +1,48 @@
+#pragma once
+#include <dx/d3d12_1.h>
+#include <dx/D3D12RaytracingFallback.h>
+#include <stdint.h>
+#include <deque>
+#include <future>
+#include <string>
+#include <vector>
+#include "dxshader.h"
+#include "shadercompiler.h"
+#include "threadpool.h"
+
+//Owns the raytracing pipeline and rebuilds it when a shader source changes.
+//Only the collections of changed libraries are recompiled, the others are relinked as they are.
+//A rebuilt pipeline is swapped in at a frame boundary, the previous one is kept until the gpu is done with it.
+class PipelineManager {
+public:
+	PipelineManager(){}
+	~PipelineManager();
+
+	//starts compiling every library, shaderDir is watched for changes afterwards
+	void Init(ThreadPool* pool, ID3D12RaytracingFallbackDevice* rtDevice, ShaderCompiler* compiler, const wchar_t* shaderDir, const std::vector<ShaderLibrary>& libraries);
+	//starts a rebuild in the background when a library or one of its includes changed
+	void Update();
+	//call between frames, returns true when a finished rebuild replaced the pipeline
+	bool SwapPipeline(uint64_t fenceValue);
+	void Reclaim(uint64_t completedFenceValue);
+	//blocks until the first build is done
+	RaytracingPipeline& GetPipeline();
+private:
+	struct RetiredPipeline {
+		uint64_t fenceValue;
+		RaytracingPipeline pipeline;
+	};
+
+	ThreadPool* m_Pool = nullptr;
+	ID3D12RaytracingFallbackDevice* m_RTDevice = nullptr;
+	ShaderCompiler* m_Compiler = nullptr;
+	HANDLE m_ChangeNotification = INVALID_HANDLE_VALUE;
+	bool m_SourcesChanged = false;
+	std::vector<uint64_t> m_SourceHashes;
+	std::wstring m_ExportMapPath;
+	size_t m_SavedExportCount = 0;
+	RaytracingPipeline m_Pipeline;
+	std::future<RaytracingPipeline> m_Pending;
+	bool m_Building = false;
+	std::deque<RetiredPipeline> m_RetiredPipelines;
+};
@@ -0,0 +1,207 @@
+#include "profiler.h"
+#include <dx/d3dx12.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stdio.h>
+
+#define PROFILER_THREAD_EVENTS 65536
+
+struct ProfileEvent {
+	const char* name;
+	int64_t start;
+	int64_t end;
+};
+
+//only the owning thread writes, the count is published after the event so the trace writer never reads a partial one
+struct ThreadBuffer {
+	uint32_t threadId;
+	bool gpu;
+	std::atomic<uint32_t> generation{ 0 };
+	std::atomic<uint32_t> count{ 0 };
+	ProfileEvent events[PROFILER_THREAD_EVENTS];
+};
+
+std::atomic<bool> Profiler::s_Capturing{ false };
+std::atomic<bool> Profiler::s_Collecting{ false };
+std::atomic<uint32_t> Profiler::s_Generation{ 0 };
+uint32_t Profiler::s_FramesLeft = 0;
+uint32_t Profiler::s_DrainLeft = 0;
+std::string Profiler::s_Filename;
+
+static std::mutex s_BufferMutex;
+static std::vector<std::unique_ptr<ThreadBuffer>> s_Buffers;
+static thread_local ThreadBuffer* t_Buffer = nullptr;
+static ThreadBuffer* s_GpuBuffer = nullptr;
+static int64_t s_CaptureStart = 0;
+
+static ThreadBuffer* CreateBuffer(bool gpu) {
+	std::unique_ptr<ThreadBuffer> buffer = std::make_unique<ThreadBuffer>();
+	buffer->threadId = gpu ? 0 : GetCurrentThreadId();
+	buffer->gpu = gpu;
+	ThreadBuffer* ret = buffer.get();
+	std::lock_guard<std::mutex> lock(s_BufferMutex);
+	s_Buffers.push_back(std::move(buffer));
+	return ret;
+}
+
+static void Append(ThreadBuffer* buffer, uint32_t generation, const char* name, int64_t start, int64_t end) {
+	//a buffer is emptied lazily by its own thread the first time it records in a new capture
+	if (buffer->generation.load(std::memory_order_relaxed) != generation) {
+		buffer->count.store(0, std::memory_order_relaxed);
+		buffer->generation.store(generation, std::memory_order_release);
+	}
+	uint32_t count = buffer->count.load(std::memory_order_relaxed);
+	if (count >= PROFILER_THREAD_EVENTS)
+		return;
+	buffer->events[count] = { name, start, end };
+	buffer->count.store(count + 1, std::memory_order_release);
+}
+
+int64_t Profiler::Now() {
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart;
+}
+
+void Profiler::BeginCapture(uint32_t frameCount, const char* filename) {
+	if (IsCollecting() || frameCount == 0)
+		return;
+	s_Filename = filename;
+	s_FramesLeft = frameCount;
+	s_CaptureStart = Now();
+	s_Generation.fetch_add(1, std::memory_order_release);
+	s_Collecting.store(true, std::memory_order_relaxed);
+	s_Capturing.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::EndFrame(uint32_t drainFrames) {
+	if (IsCapturing()) {
+		if (--s_FramesLeft == 0) {
+			s_Capturing.store(false, std::memory_order_relaxed);
+			s_DrainLeft = drainFrames;
+		}
+		return;
+	}
+	if (!IsCollecting())
+		return;
+	//gpu timings of the captured frames arrive up to drainFrames frames later
+	if (s_DrainLeft > 0 && --s_DrainLeft > 0)
+		return;
+	s_Collecting.store(false, std::memory_order_relaxed);
+	WriteTrace();
+}
+
+void Profiler::AddEvent(const char* name, int64_t start, int64_t end) {
+	if (!t_Buffer)
+		t_Buffer = CreateBuffer(false);
+	Append(t_Buffer, s_Generation.load(std::memory_order_acquire), name, start, end);
+}
+
+void Profiler::AddGpuEvent(const char* name, int64_t start, int64_t end) {
+	if (!IsCollecting())
+		return;
+	if (!s_GpuBuffer)
+		s_GpuBuffer = CreateBuffer(true);
+	Append(s_GpuBuffer, s_Generation.load(std::memory_order_acquire), name, start, end);
+}
+
+void Profiler::WriteTrace() {
+	FILE* file = fopen(s_Filename.c_str(), "w");
+	if (!file) {
+		printf("Profiler: Could not write %s\n", s_Filename.c_str());
+		return;
+	}
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	double toMicroseconds = 1000000.0 / (double)frequency.QuadPart;
+	uint32_t generation = s_Generation.load(std::memory_order_acquire);
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"CPU\"}},\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"GPU\"}}");
+	uint32_t eventCount = 0;
+	std::lock_guard<std::mutex> lock(s_BufferMutex);
+	for (auto& buffer : s_Buffers) {
+		if (buffer->generation.load(std::memory_order_acquire) != generation)
+			continue;
+		uint32_t count = buffer->count.load(std::memory_order_acquire);
+		for (uint32_t i = 0; i < count; ++i) {
+			const ProfileEvent& e = buffer->events[i];
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+				e.name, buffer->gpu ? 1 : 0, buffer->threadId, (double)(e.start - s_CaptureStart) * toMicroseconds, (double)(e.end - e.start) * toMicroseconds);
+		}
+		eventCount += count;
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	printf("Profiler: Wrote %u events to %s\n", eventCount, s_Filename.c_str());
+}
+
+void GpuProfiler::Init(ID3D12Device* device, ID3D12CommandQueue* queue) {
+	D3D12_QUERY_HEAP_DESC queryHeapDesc = {};
+	queryHeapDesc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+	queryHeapDesc.Count = GPU_PROFILER_MAX_FRAMES * GPU_PROFILER_MAX_SCOPES * 2;
+	device->CreateQueryHeap(&queryHeapDesc, IID_PPV_ARGS(&m_QueryHeap));
+	const auto readbackHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_READBACK);
+	auto readbackDesc = CD3DX12_RESOURCE_DESC::Buffer(queryHeapDesc.Count * sizeof(uint64_t));
+	device->CreateCommittedResource(&readbackHeapProperties, D3D12_HEAP_FLAG_NONE, &readbackDesc, D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&m_Readback));
+
+	//gpu ticks are mapped onto the qpc clock the cpu scopes use
+	queue->GetTimestampFrequency(&m_GpuFrequency);
+	uint64_t cpuTimestamp = 0;
+	queue->GetClockCalibration(&m_GpuCalibration, &cpuTimestamp);
+	m_CpuCalibration = (int64_t)cpuTimestamp;
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	m_CpuFrequency = frequency.QuadPart;
+}
+
+uint32_t GpuProfiler::Begin(ID3D12GraphicsCommandList* cmdList, uint32_t frameIndex, const char* name) {
+	if (!m_QueryHeap || !Profiler::IsCapturing())
+		return INVALID_SCOPE;
+	Frame& frame = m_Frames[frameIndex];
+	uint32_t scope = frame.count.fetch_add(1);
+	if (scope >= GPU_PROFILER_MAX_SCOPES)
+		return INVALID_SCOPE;
+	frame.names[scope] = name;
+	cmdList->EndQuery(m_QueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, (frameIndex * GPU_PROFILER_MAX_SCOPES + scope) * 2);
+	return scope;
+}
+
+void GpuProfiler::End(ID3D12GraphicsCommandList* cmdList, uint32_t frameIndex, uint32_t scope) {
+	if (scope == INVALID_SCOPE)
+		return;
+	cmdList->EndQuery(m_QueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, (frameIndex * GPU_PROFILER_MAX_SCOPES + scope) * 2 + 1);
+}
+
+void GpuProfiler::Resolve(ID3D12GraphicsCommandList* cmdList, uint32_t frameIndex) {
+	Frame& frame = m_Frames[frameIndex];
+	uint32_t count = frame.count.load();
+	frame.resolved = count < GPU_PROFILER_MAX_SCOPES ? count : GPU_PROFILER_MAX_SCOPES;
+	if (frame.resolved == 0)
+		return;
+	uint32_t first = frameIndex * GPU_PROFILER_MAX_SCOPES * 2;
+	cmdList->ResolveQueryData(m_QueryHeap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, first, frame.resolved * 2, m_Readback.Get(), first * sizeof(uint64_t));
+}
+
+void GpuProfiler::Collect(uint32_t frameIndex) {
+	Frame& frame = m_Frames[frameIndex];
+	if (frame.resolved > 0) {
+		uint32_t first = frameIndex * GPU_PROFILER_MAX_SCOPES * 2;
+		D3D12_RANGE readRange = { first * sizeof(uint64_t), (first + frame.resolved * 2) * sizeof(uint64_t) };
+		D3D12_RANGE writeRange = { 0, 0 };
+		uint64_t* timestamps;
+		if (SUCCEEDED(m_Readback->Map(0, &readRange, (void**)&timestamps))) {
+			double toCpu = (double)m_CpuFrequency / (double)m_GpuFrequency;
+			for (uint32_t i = 0; i < frame.resolved; ++i) {
+				int64_t start = m_CpuCalibration + (int64_t)((double)((int64_t)(timestamps[first + i * 2] - m_GpuCalibration)) * toCpu);
+				int64_t end = m_CpuCalibration + (int64_t)((double)((int64_t)(timestamps[first + i * 2 + 1] - m_GpuCalibration)) * toCpu);
+				Profiler::AddGpuEvent(frame.names[i], start, end);
+			}
+			m_Readback->Unmap(0, &writeRange);
+		}
+	}
+	frame.resolved = 0;
+	frame.count.store(0);
+}
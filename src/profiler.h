@@ -0,0 +1,88 @@
+#pragma once
+#include <dx/d3d12_1.h>
+#include <wrl/client.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+using Microsoft::WRL::ComPtr;
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+//times the enclosing scope, name must outlive the capture (a string literal)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+
+//Records nested cpu scopes and gpu timestamp pairs and writes them as a Chrome trace (chrome://tracing).
+//Every thread appends to its own fixed size buffer, so recording takes no lock.
+//With no capture running a scope costs one relaxed atomic load, so it can stay in release builds.
+class Profiler {
+public:
+	//records the next frameCount frames, the trace is written to filename once their gpu work has been collected
+	static void BeginCapture(uint32_t frameCount, const char* filename);
+	//call once per frame, drainFrames is how many frames the gpu may still be behind
+	static void EndFrame(uint32_t drainFrames);
+	static bool IsCapturing() { return s_Capturing.load(std::memory_order_relaxed); }
+	static bool IsCollecting() { return s_Collecting.load(std::memory_order_relaxed); }
+
+	static int64_t Now();
+	static void AddEvent(const char* name, int64_t start, int64_t end);
+	//gpu events are placed on their own row, timestamps already converted to Now() ticks
+	static void AddGpuEvent(const char* name, int64_t start, int64_t end);
+private:
+	static void WriteTrace();
+
+	static std::atomic<bool> s_Capturing;
+	static std::atomic<bool> s_Collecting;
+	static std::atomic<uint32_t> s_Generation;
+	static uint32_t s_FramesLeft;
+	static uint32_t s_DrainLeft;
+	static std::string s_Filename;
+};
+
+class ProfileScope {
+public:
+	ProfileScope(const char* name) : m_Name(Profiler::IsCapturing() ? name : nullptr), m_Start(m_Name ? Profiler::Now() : 0) {}
+	~ProfileScope() {
+		if (m_Name)
+			Profiler::AddEvent(m_Name, m_Start, Profiler::Now());
+	}
+private:
+	const char* m_Name;
+	int64_t m_Start;
+};
+
+#define GPU_PROFILER_MAX_SCOPES 64
+#define GPU_PROFILER_MAX_FRAMES 4
+
+//Timestamp pairs around command list ranges, resolved per frame and read back once the frame's fence has completed.
+//Begin and End may be called from several recording threads at once.
+class GpuProfiler {
+public:
+	static const uint32_t INVALID_SCOPE = ~0u;
+
+	GpuProfiler(){}
+	~GpuProfiler(){}
+
+	void Init(ID3D12Device* device, ID3D12CommandQueue* queue);
+	//returns INVALID_SCOPE while no capture is running or the frame is out of scopes
+	uint32_t Begin(ID3D12GraphicsCommandList* cmdList, uint32_t frameIndex, const char* name);
+	void End(ID3D12GraphicsCommandList* cmdList, uint32_t frameIndex, uint32_t scope);
+	//true if the frame recorded scopes, Resolve then has to go on a list submitted after all of them
+	bool HasScopes(uint32_t frameIndex) const { return m_Frames[frameIndex].count.load() > 0; }
+	void Resolve(ID3D12GraphicsCommandList* cmdList, uint32_t frameIndex);
+	//call once the frame's fence has completed
+	void Collect(uint32_t frameIndex);
+private:
+	struct Frame {
+		std::atomic<uint32_t> count{ 0 };
+		uint32_t resolved = 0;
+		const char* names[GPU_PROFILER_MAX_SCOPES];
+	};
+
+	ComPtr<ID3D12QueryHeap> m_QueryHeap;
+	ComPtr<ID3D12Resource> m_Readback;
+	Frame m_Frames[GPU_PROFILER_MAX_FRAMES];
+	uint64_t m_GpuFrequency = 1;
+	uint64_t m_GpuCalibration = 0;
+	int64_t m_CpuCalibration = 0;
+	int64_t m_CpuFrequency = 1;
+};
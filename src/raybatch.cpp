@@ -0,0 +1,88 @@
+#include "raybatch.h"
+#include <algorithm>
+
+static void TraceRange(const CpuScene& scene, const RayBatch& rays, const HitBatch& hits, uint32_t flags, uint32_t first, uint32_t last) {
+	for (uint32_t i = first; i < last; ++i) {
+		CpuRay ray;
+		ray.origin = glm::vec3(rays.originX[i], rays.originY[i], rays.originZ[i]);
+		ray.direction = glm::vec3(rays.directionX[i], rays.directionY[i], rays.directionZ[i]);
+		ray.tMin = rays.tMin[i];
+		ray.tMax = rays.tMax[i];
+		CpuHit hit;
+		scene.Intersect(ray, flags, hit);
+		if (hits.t)
+			hits.t[i] = hit.t;
+		if (hits.u)
+			hits.u[i] = hit.u;
+		if (hits.v)
+			hits.v[i] = hit.v;
+		if (hits.instanceId)
+			hits.instanceId[i] = hit.instanceId;
+		if (hits.primitiveId)
+			hits.primitiveId[i] = hit.primitiveId;
+	}
+}
+
+//runs range(first, last) over chunks of count on the pool and waits for all of them
+template<typename RangeFunc>
+static void ParallelChunks(uint32_t count, uint32_t chunkSize, ThreadPool* pool, RangeFunc range) {
+	if (!pool || pool->GetThreadCount() <= 1 || count <= chunkSize) {
+		range(0u, count);
+		return;
+	}
+	std::vector<std::future<void>> jobs;
+	jobs.reserve((count + chunkSize - 1) / chunkSize);
+	for (uint32_t first = 0; first < count; first += chunkSize) {
+		uint32_t last = std::min(first + chunkSize, count);
+		jobs.push_back(pool->Submit([&range, first, last]() { range(first, last); }));
+	}
+	for (auto& job : jobs)
+		job.get();
+}
+
+void TraceBatch(const CpuScene& scene, const RayBatch& rays, const HitBatch& hits, uint32_t flags, ThreadPool* pool) {
+	ParallelChunks(rays.count, RAY_BATCH_CHUNK_SIZE, pool, [&](uint32_t first, uint32_t last) {
+		TraceRange(scene, rays, hits, flags, first, last);
+	});
+}
+
+void FindClosestPoints(const CpuScene& scene, const PointBatch& points, const ClosestPointResults& results, ThreadPool* pool) {
+	ParallelChunks(points.count, RAY_BATCH_CHUNK_SIZE, pool, [&](uint32_t first, uint32_t last) {
+		for (uint32_t i = first; i < last; ++i) {
+			CpuClosestPoint closest;
+			scene.FindClosestPoint(glm::vec3(points.x[i], points.y[i], points.z[i]), points.maxDistance[i], closest);
+			if (results.x)
+				results.x[i] = closest.position.x;
+			if (results.y)
+				results.y[i] = closest.position.y;
+			if (results.z)
+				results.z[i] = closest.position.z;
+			if (results.distance)
+				results.distance[i] = closest.distance;
+			if (results.instanceId)
+				results.instanceId[i] = closest.instanceId;
+			if (results.primitiveId)
+				results.primitiveId[i] = closest.primitiveId;
+		}
+	});
+}
+
+void OverlapBatch(const CpuScene& scene, const CpuOverlapVolume* volumes, uint32_t count, std::vector<std::vector<CpuOverlap>>& results, ThreadPool* pool) {
+	results.resize(count);
+	ParallelChunks(count, VOLUME_BATCH_CHUNK_SIZE, pool, [&](uint32_t first, uint32_t last) {
+		for (uint32_t i = first; i < last; ++i) {
+			results[i].clear();
+			scene.Overlap(volumes[i], results[i]);
+		}
+	});
+}
+
+void CullFrustumBatch(const CpuScene& scene, const CpuFrustum* frustums, uint32_t count, std::vector<std::vector<uint32_t>>& visible, ThreadPool* pool) {
+	visible.resize(count);
+	ParallelChunks(count, VOLUME_BATCH_CHUNK_SIZE, pool, [&](uint32_t first, uint32_t last) {
+		for (uint32_t i = first; i < last; ++i) {
+			visible[i].clear();
+			scene.CullFrustum(frustums[i], visible[i]);
+		}
+	});
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include <stdint.h>
+#include "cpubvh.h"
+#include "threadpool.h"
+//rays or points handed to one pool job, large enough to amortize the queue, small enough to balance threads
+#define RAY_BATCH_CHUNK_SIZE 1024
+//overlap and frustum queries visit many primitives each, so fewer go to a job
+#define VOLUME_BATCH_CHUNK_SIZE 32
+
+//Structure of arrays view over caller owned rays, one array per component so callers can hand over
+//their own columns without repacking. Directions need not be normalized, t is measured in their length.
+struct RayBatch {
+	const float* originX;
+	const float* originY;
+	const float* originZ;
+	const float* directionX;
+	const float* directionY;
+	const float* directionZ;
+	const float* tMin;
+	const float* tMax;
+	uint32_t count;
+};
+
+//Caller owned results, same layout and count as the rays. Misses write t = tMax and CPU_INVALID_ID.
+//Any array may be null when the caller does not need it.
+struct HitBatch {
+	float* t;
+	float* u;
+	float* v;
+	uint32_t* instanceId;
+	uint32_t* primitiveId;
+};
+
+//Traces every ray against the scene, split across the pool in chunks, and returns once all are written.
+//Runs on the calling thread when pool is null. Must not be called from a job of the same pool.
+void TraceBatch(const CpuScene& scene, const RayBatch& rays, const HitBatch& hits, uint32_t flags, ThreadPool* pool);
+
+struct PointBatch {
+	const float* x;
+	const float* y;
+	const float* z;
+	const float* maxDistance;
+	uint32_t count;
+};
+
+//Misses write the query point, distance = maxDistance and CPU_INVALID_ID. Any array may be null.
+struct ClosestPointResults {
+	float* x;
+	float* y;
+	float* z;
+	float* distance;
+	uint32_t* instanceId;
+	uint32_t* primitiveId;
+};
+
+//Same threading as TraceBatch, all queries share the scene's ray tracing bvh.
+void FindClosestPoints(const CpuScene& scene, const PointBatch& points, const ClosestPointResults& results, ThreadPool* pool);
+//results[i] receives the triangles overlapping volumes[i]
+void OverlapBatch(const CpuScene& scene, const CpuOverlapVolume* volumes, uint32_t count, std::vector<std::vector<CpuOverlap>>& results, ThreadPool* pool);
+//visible[i] receives the instances inside frustums[i], e.g. one per shadow cascade
+void CullFrustumBatch(const CpuScene& scene, const CpuFrustum* frustums, uint32_t count, std::vector<std::vector<uint32_t>>& visible, ThreadPool* pool);
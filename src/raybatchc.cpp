@@ -0,0 +1,99 @@
+#include "raybatchc.h"
+#include "raybatch.h"
+#include <memory>
+
+static_assert(RQ_TRACE_ANY_HIT == CPU_TRACE_ANY_HIT && RQ_TRACE_CULL_BACK_FACING == CPU_TRACE_CULL_BACK_FACING, "rq trace flags out of sync");
+static_assert(RQ_INVALID_ID == CPU_INVALID_ID, "rq invalid id out of sync");
+
+struct RqProcedural {
+	RqIntersectFunc intersect;
+	void* userData;
+};
+
+struct RqScene {
+	CpuScene scene;
+	ThreadPool pool;
+	//userData of the procedural geometries, kept at a stable address
+	std::vector<std::unique_ptr<RqProcedural>> procedurals;
+};
+
+static bool IntersectProcedural(void* userData, uint32_t primitiveId, const CpuTraversalRay& ray, CpuHit& hit) {
+	RqProcedural* procedural = (RqProcedural*)userData;
+	float t, u = 0.0f, v = 0.0f;
+	if (!procedural->intersect(procedural->userData, primitiveId, &ray.origin.x, &ray.direction.x, ray.tMin, hit.t, &t, &u, &v))
+		return false;
+	//the callback is outside our control, so its range is checked again
+	if (t < ray.tMin || t >= hit.t)
+		return false;
+	hit.t = t;
+	hit.u = u;
+	hit.v = v;
+	return true;
+}
+
+static glm::mat4 ToMatrix(const float* transform) {
+	//3x4 row major to glm's column major 4x4
+	glm::mat4 m(1.0f);
+	for (int row = 0; row < 3; ++row)
+		for (int col = 0; col < 4; ++col)
+			m[col][row] = transform[row * 4 + col];
+	return m;
+}
+
+uint32_t rqGetAbiVersion(void) {
+	return RQ_ABI_VERSION;
+}
+
+RqScene* rqSceneCreate(uint32_t threadCount) {
+	RqScene* scene = new RqScene();
+	if (threadCount != 1)
+		scene->pool.Init(threadCount);
+	return scene;
+}
+
+void rqSceneDestroy(RqScene* scene) {
+	delete scene;
+}
+
+uint32_t rqSceneAddTriangles(RqScene* scene, const float* vertices, uint32_t vertexCount) {
+	return scene->scene.AddTriangles((const glm::vec3*)vertices, vertexCount);
+}
+
+uint32_t rqSceneAddSpheres(RqScene* scene, const float* spheres, uint32_t count) {
+	return scene->scene.AddSpheres((const glm::vec4*)spheres, count);
+}
+
+uint32_t rqSceneAddProcedural(RqScene* scene, const float* bounds, uint32_t count, RqIntersectFunc intersect, void* userData) {
+	std::vector<Aabb> boxes(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		boxes[i].min = glm::vec3(bounds[i * 6 + 0], bounds[i * 6 + 1], bounds[i * 6 + 2]);
+		boxes[i].max = glm::vec3(bounds[i * 6 + 3], bounds[i * 6 + 4], bounds[i * 6 + 5]);
+	}
+	scene->procedurals.emplace_back(new RqProcedural{ intersect, userData });
+	return scene->scene.AddProcedural(boxes.data(), count, IntersectProcedural, scene->procedurals.back().get());
+}
+
+uint32_t rqSceneAddInstance(RqScene* scene, uint32_t geometry, const float* transform) {
+	return scene->scene.AddInstance(geometry, ToMatrix(transform));
+}
+
+void rqSceneSetInstanceTransform(RqScene* scene, uint32_t instance, const float* transform) {
+	scene->scene.SetInstanceTransform(instance, ToMatrix(transform));
+}
+
+void rqSceneBuild(RqScene* scene) {
+	scene->scene.Build();
+}
+
+void rqTraceBatch(const RqScene* scene, const RqRayBatch* rays, const RqHitBatch* hits, uint32_t flags) {
+	RayBatch batch = { rays->originX, rays->originY, rays->originZ, rays->directionX, rays->directionY, rays->directionZ, rays->tMin, rays->tMax, rays->count };
+	HitBatch results = { hits->t, hits->u, hits->v, hits->instanceId, hits->primitiveId };
+	//the pool is only read through Submit, which locks internally
+	TraceBatch(scene->scene, batch, results, flags, const_cast<ThreadPool*>(&scene->pool));
+}
+
+void rqFindClosestPoints(const RqScene* scene, const RqPointBatch* points, const RqClosestPointResults* results) {
+	PointBatch batch = { points->x, points->y, points->z, points->maxDistance, points->count };
+	ClosestPointResults closest = { results->x, results->y, results->z, results->distance, results->instanceId, results->primitiveId };
+	FindClosestPoints(scene->scene, batch, closest, const_cast<ThreadPool*>(&scene->pool));
+}
@@ -0,0 +1,90 @@
+#pragma once
+//C interface to the cpu ray queries for clients that embed the tracer without its c++ types.
+//Only fixed width types and opaque handles cross it, so it stays stable as the c++ side changes.
+#include <stdint.h>
+
+#ifndef RQ_API
+#define RQ_API
+#endif
+#define RQ_ABI_VERSION 3
+#define RQ_INVALID_ID 0xFFFFFFFFu
+
+//trace flags, mirror CpuTraceFlags
+#define RQ_TRACE_CLOSEST_HIT 0
+#define RQ_TRACE_ANY_HIT 1
+#define RQ_TRACE_CULL_BACK_FACING 2
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct RqScene RqScene;
+
+//one array per component, count entries each
+typedef struct RqRayBatch {
+	const float* originX;
+	const float* originY;
+	const float* originZ;
+	const float* directionX;
+	const float* directionY;
+	const float* directionZ;
+	const float* tMin;
+	const float* tMax;
+	uint32_t count;
+} RqRayBatch;
+
+//any array may be null, misses write t = tMax and RQ_INVALID_ID
+typedef struct RqHitBatch {
+	float* t;
+	float* u;
+	float* v;
+	uint32_t* instanceId;
+	uint32_t* primitiveId;
+} RqHitBatch;
+
+//query points, count entries each
+typedef struct RqPointBatch {
+	const float* x;
+	const float* y;
+	const float* z;
+	const float* maxDistance;
+	uint32_t count;
+} RqPointBatch;
+
+//any array may be null, misses write the query point, distance = maxDistance and RQ_INVALID_ID
+typedef struct RqClosestPointResults {
+	float* x;
+	float* y;
+	float* z;
+	float* distance;
+	uint32_t* instanceId;
+	uint32_t* primitiveId;
+} RqClosestPointResults;
+
+//custom intersection of procedural primitive primitiveId with an object space ray, like an hlsl intersection shader:
+//only a t in [tMin, tMax) may be reported, by writing t and two attributes and returning non-zero. Called from many threads at once.
+typedef uint32_t (*RqIntersectFunc)(void* userData, uint32_t primitiveId, const float* origin, const float* direction, float tMin, float tMax, float* t, float* u, float* v);
+
+RQ_API uint32_t rqGetAbiVersion(void);
+//threadCount 0 uses one thread per hardware thread, 1 traces on the calling thread
+RQ_API RqScene* rqSceneCreate(uint32_t threadCount);
+RQ_API void rqSceneDestroy(RqScene* scene);
+//unindexed triangle list of vertexCount xyz triples, returns the geometry index
+RQ_API uint32_t rqSceneAddTriangles(RqScene* scene, const float* vertices, uint32_t vertexCount);
+//since abi version 3, count spheres as x, y, z, radius quadruples intersected analytically
+RQ_API uint32_t rqSceneAddSpheres(RqScene* scene, const float* spheres, uint32_t count);
+//since abi version 3, count boxes as min xyz, max xyz like D3D12_RAYTRACING_AABB, userData must outlive the scene
+RQ_API uint32_t rqSceneAddProcedural(RqScene* scene, const float* bounds, uint32_t count, RqIntersectFunc intersect, void* userData);
+//transform is a row major 3x4 matrix like D3D12_RAYTRACING_INSTANCE_DESC, returns the instance id
+RQ_API uint32_t rqSceneAddInstance(RqScene* scene, uint32_t geometry, const float* transform);
+RQ_API void rqSceneSetInstanceTransform(RqScene* scene, uint32_t instance, const float* transform);
+//must be called after adding or moving instances and before tracing
+RQ_API void rqSceneBuild(RqScene* scene);
+//blocks until every hit is written, any number of threads may trace one built scene at once
+RQ_API void rqTraceBatch(const RqScene* scene, const RqRayBatch* rays, const RqHitBatch* hits, uint32_t flags);
+//since abi version 2, closest surface point to every query point
+RQ_API void rqFindClosestPoints(const RqScene* scene, const RqPointBatch* points, const RqClosestPointResults* results);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,26 @@
+#include "reconstructor.h"
+#include "profiler.h"
+#include <dx/d3dx12.h>
+
+void Reconstructor::Init(ID3D12Device* device, ShaderCompiler* compiler) {
+	PROFILE_SCOPE("InitReconstructor");
+	CD3DX12_DESCRIPTOR_RANGE UAVDescriptor;
+	UAVDescriptor.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
+	CD3DX12_ROOT_PARAMETER rootParameters[RECONSTRUCT_ROOT_COUNT];
+	rootParameters[RECONSTRUCT_ROOT_OUTPUT].InitAsDescriptorTable(1, &UAVDescriptor);
+	rootParameters[RECONSTRUCT_ROOT_ACCUMULATION].InitAsUnorderedAccessView(1);
+	rootParameters[RECONSTRUCT_ROOT_BLOCK_RATES].InitAsUnorderedAccessView(2);
+	rootParameters[RECONSTRUCT_ROOT_CONSTANTS].InitAsConstants(sizeof(ReconstructConstants) / sizeof(uint32_t), 0);
+	CD3DX12_ROOT_SIGNATURE_DESC rootSignatureDesc(ARRAYSIZE(rootParameters), rootParameters);
+	m_Pass.Init(device, compiler, "Reconstructor", L"shader/reconstruct.hlsl", rootSignatureDesc);
+}
+
+void Reconstructor::Record(ID3D12GraphicsCommandList* cmdList, D3D12_GPU_DESCRIPTOR_HANDLE output, D3D12_GPU_VIRTUAL_ADDRESS accumulation,
+	D3D12_GPU_VIRTUAL_ADDRESS blockRates, const ReconstructConstants& constants) {
+	m_Pass.Bind(cmdList);
+	cmdList->SetComputeRootDescriptorTable(RECONSTRUCT_ROOT_OUTPUT, output);
+	cmdList->SetComputeRootUnorderedAccessView(RECONSTRUCT_ROOT_ACCUMULATION, accumulation);
+	cmdList->SetComputeRootUnorderedAccessView(RECONSTRUCT_ROOT_BLOCK_RATES, blockRates);
+	cmdList->SetComputeRoot32BitConstants(RECONSTRUCT_ROOT_CONSTANTS, sizeof(constants) / sizeof(uint32_t), &constants, 0);
+	ComputePass::Dispatch(cmdList, constants.width, constants.height, RECONSTRUCT_GROUP_SIZE);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <dx/d3d12_1.h>
+#include <stdint.h>
+#include "computepass.h"
+#define RECONSTRUCT_GROUP_SIZE 8
+
+//root signature slots, mirrored by the registers in reconstruct.hlsl
+enum ReconstructRootParameter {
+	RECONSTRUCT_ROOT_OUTPUT,
+	RECONSTRUCT_ROOT_ACCUMULATION,
+	RECONSTRUCT_ROOT_BLOCK_RATES,
+	RECONSTRUCT_ROOT_CONSTANTS,
+	RECONSTRUCT_ROOT_COUNT
+};
+
+struct ReconstructConstants {
+	uint32_t width;
+	uint32_t height;
+	uint32_t rateMode;
+	uint32_t frameIndex;
+	uint32_t blockCountX;
+	uint32_t blockCount;
+	float gradientThreshold;
+	uint32_t updateRates;
+};
+
+//Compute pass after a checkerboard or variable rate trace.
+//Pixels without a ray this frame take their last traced value clamped to the range of the traced pixels around them,
+//and the variable rate of every 2x2 block for the next frame is chosen from the reconstructed luminance gradient.
+class Reconstructor {
+public:
+	Reconstructor(){}
+	~Reconstructor(){}
+
+	//compiles reconstruct.hlsl, may run on a pool thread
+	void Init(ID3D12Device* device, ShaderCompiler* compiler);
+	bool IsReady() const { return m_Pass.IsReady(); }
+	//the list's descriptor heap must hold output
+	void Record(ID3D12GraphicsCommandList* cmdList, D3D12_GPU_DESCRIPTOR_HANDLE output, D3D12_GPU_VIRTUAL_ADDRESS accumulation,
+		D3D12_GPU_VIRTUAL_ADDRESS blockRates, const ReconstructConstants& constants);
+private:
+	ComputePass m_Pass;
+};
@@ -0,0 +1,42 @@
+#include "resolutioncontroller.h"
+#include <algorithm>
+#include <math.h>
+
+//weight of the newest measurement in the running cost
+static const double s_CostSmoothing = 0.1;
+
+void ResolutionController::Init(uint32_t width, uint32_t height, float budgetMs, float minScale) {
+	m_Width = width;
+	m_Height = height;
+	m_BudgetMs = budgetMs;
+	m_MinScale = std::min(std::max(minScale, 0.1f), 1.0f);
+	m_MsPerPixel = 0.0;
+	Apply(1.0f);
+}
+
+void ResolutionController::Update(double dispatchMs, uint32_t tracedWidth, uint32_t tracedHeight) {
+	if (!IsEnabled() || tracedWidth == 0 || tracedHeight == 0)
+		return;
+	double msPerPixel = dispatchMs / ((double)tracedWidth * tracedHeight);
+	m_MsPerPixel = m_MsPerPixel > 0.0 ? m_MsPerPixel + (msPerPixel - m_MsPerPixel) * s_CostSmoothing : msPerPixel;
+	if (m_MsPerPixel <= 0.0)
+		return;
+
+	//ray count grows with the square of the scale
+	double pixels = m_BudgetMs / m_MsPerPixel;
+	float scale = (float)sqrt(pixels / ((double)m_Width * m_Height));
+	scale = std::min(std::max(scale, m_MinScale), 1.0f);
+	if (fabsf(scale - m_Scale) > RESOLUTION_HYSTERESIS * m_Scale || (scale == 1.0f && m_Scale != 1.0f))
+		Apply(scale);
+}
+
+void ResolutionController::Apply(float scale) {
+	m_Scale = scale;
+	if (scale >= 1.0f) {
+		m_TraceWidth = m_Width;
+		m_TraceHeight = m_Height;
+		return;
+	}
+	m_TraceWidth = std::max((uint32_t)(m_Width * scale) / RESOLUTION_ALIGNMENT * RESOLUTION_ALIGNMENT, (uint32_t)RESOLUTION_ALIGNMENT);
+	m_TraceHeight = std::max((uint32_t)(m_Height * scale) / RESOLUTION_ALIGNMENT * RESOLUTION_ALIGNMENT, (uint32_t)RESOLUTION_ALIGNMENT);
+}
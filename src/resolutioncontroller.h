@@ -0,0 +1,37 @@
+#pragma once
+#include <stdint.h>
+//trace dimensions are kept a multiple of this, so the upsample ratio only changes in small steps
+#define RESOLUTION_ALIGNMENT 8
+//a new scale is only taken when it differs by more than this, so the resolution does not flicker between two sizes
+#define RESOLUTION_HYSTERESIS 0.05f
+
+//Picks the trace resolution that keeps DispatchRays inside a gpu time budget.
+//Cost is tracked per traced pixel, so measurements from frames traced at another resolution are still usable
+//and the frames in flight do not make the controller oscillate.
+class ResolutionController {
+public:
+	ResolutionController(){}
+	~ResolutionController(){}
+
+	//budgetMs 0 disables it, the trace resolution then stays at width x height
+	void Init(uint32_t width, uint32_t height, float budgetMs, float minScale);
+	//dispatch time of a completed frame and the resolution it was traced at
+	void Update(double dispatchMs, uint32_t tracedWidth, uint32_t tracedHeight);
+
+	bool IsEnabled() const { return m_BudgetMs > 0.0f; }
+	uint32_t GetWidth() const { return m_TraceWidth; }
+	uint32_t GetHeight() const { return m_TraceHeight; }
+	float GetScale() const { return m_Scale; }
+	double GetCostPerMegapixel() const { return m_MsPerPixel * 1000000.0; }
+private:
+	void Apply(float scale);
+
+	uint32_t m_Width = 0;
+	uint32_t m_Height = 0;
+	uint32_t m_TraceWidth = 0;
+	uint32_t m_TraceHeight = 0;
+	float m_BudgetMs = 0.0f;
+	float m_MinScale = 1.0f;
+	float m_Scale = 1.0f;
+	double m_MsPerPixel = 0.0;
+};
@@ -0,0 +1,91 @@
+#include "resourcepool.h"
+#include <dx/d3dx12.h>
+#include <stdio.h>
+
+void ResourcePool::Init(ID3D12Device* device, uint64_t heapSize) {
+	m_Device = device;
+	m_HeapSize = heapSize;
+}
+
+uint32_t ResourcePool::CreateHeap(uint64_t size) {
+	std::unique_ptr<Heap> heap = std::make_unique<Heap>();
+	heap->allocator.Init(size, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT);
+	CD3DX12_HEAP_DESC heapDesc(heap->allocator.GetSize(), D3D12_HEAP_TYPE_DEFAULT, D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT, D3D12_HEAP_FLAG_ALLOW_ONLY_BUFFERS);
+	HR(m_Device->CreateHeap(&heapDesc, IID_PPV_ARGS(&heap->heap)), "Create resource pool heap");
+	m_Heaps.push_back(std::move(heap));
+	return (uint32_t)m_Heaps.size() - 1;
+}
+
+PooledBuffer ResourcePool::Allocate(uint64_t size, D3D12_RESOURCE_STATES initialState) {
+	PooledBuffer buffer;
+	uint64_t offset = BuddyAllocator::INVALID_OFFSET;
+	uint32_t heapIndex = 0;
+	for (; heapIndex < m_Heaps.size(); ++heapIndex) {
+		offset = m_Heaps[heapIndex]->allocator.Allocate(size);
+		if (offset != BuddyAllocator::INVALID_OFFSET)
+			break;
+	}
+	if (offset == BuddyAllocator::INVALID_OFFSET) {
+		//requests bigger than the default heap size get a heap of their own
+		heapIndex = CreateHeap(size > m_HeapSize ? size : m_HeapSize);
+		offset = m_Heaps[heapIndex]->allocator.Allocate(size);
+	}
+
+	auto bufDesc = CD3DX12_RESOURCE_DESC::Buffer(size, D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+	HR(m_Device->CreatePlacedResource(m_Heaps[heapIndex]->heap.Get(), offset, &bufDesc, initialState, nullptr, IID_PPV_ARGS(&buffer.resource)), "Create placed resource");
+	buffer.heapIndex = heapIndex;
+	buffer.offset = offset;
+	buffer.size = size;
+
+	uint64_t used = GetStats().usedBytes;
+	if (used > m_PeakUsed)
+		m_PeakUsed = used;
+	return buffer;
+}
+
+void ResourcePool::Free(PooledBuffer& buffer, uint64_t fenceValue) {
+	if (!buffer.resource)
+		return;
+	m_DeferredFrees.push_back({ fenceValue, buffer.resource, buffer.heapIndex, buffer.offset, true });
+	buffer = PooledBuffer();
+}
+
+void ResourcePool::FreeAliased(PooledBuffer& buffer, uint64_t fenceValue) {
+	if (!buffer.resource)
+		return;
+	m_Heaps[buffer.heapIndex]->allocator.Free(buffer.offset);
+	m_DeferredFrees.push_back({ fenceValue, buffer.resource, buffer.heapIndex, buffer.offset, false });
+	buffer = PooledBuffer();
+}
+
+void ResourcePool::Reclaim(uint64_t completedFenceValue) {
+	while (!m_DeferredFrees.empty() && m_DeferredFrees.front().fenceValue <= completedFenceValue) {
+		DeferredFree& df = m_DeferredFrees.front();
+		if (df.releaseRange)
+			m_Heaps[df.heapIndex]->allocator.Free(df.offset);
+		m_DeferredFrees.pop_front();
+	}
+}
+
+ResourcePoolStats ResourcePool::GetStats() const {
+	ResourcePoolStats stats = {};
+	uint64_t freeBytes = 0;
+	for (auto& heap : m_Heaps) {
+		stats.reservedBytes += heap->allocator.GetSize();
+		stats.usedBytes += heap->allocator.GetUsed();
+		freeBytes += heap->allocator.GetSize() - heap->allocator.GetUsed();
+		uint64_t largest = heap->allocator.GetLargestFreeBlock();
+		if (largest > stats.largestFreeBlock)
+			stats.largestFreeBlock = largest;
+	}
+	stats.peakUsedBytes = m_PeakUsed > stats.usedBytes ? m_PeakUsed : stats.usedBytes;
+	stats.heapCount = (uint32_t)m_Heaps.size();
+	stats.fragmentation = freeBytes > 0 ? 1.0f - (float)stats.largestFreeBlock / (float)freeBytes : 0.0f;
+	return stats;
+}
+
+void ResourcePool::PrintStats(const char* name) const {
+	ResourcePoolStats stats = GetStats();
+	printf("%s: %u heaps, %llu KB reserved, %llu KB used, %llu KB peak, fragmentation %.2f\n", name, stats.heapCount,
+		stats.reservedBytes / 1024, stats.usedBytes / 1024, stats.peakUsedBytes / 1024, stats.fragmentation);
+}
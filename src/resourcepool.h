@@ -0,0 +1,66 @@
+#pragma once
+#include <dx/d3d12_1.h>
+#include <wrl/client.h>
+#include <stdint.h>
+#include <deque>
+#include <memory>
+#include <vector>
+#include "buddyallocator.h"
+using Microsoft::WRL::ComPtr;
+#define HR(x, s) if(x != S_OK) {MessageBoxA(nullptr, s, "Failure", MB_OK);}
+
+struct PooledBuffer {
+	ComPtr<ID3D12Resource> resource;
+	uint32_t heapIndex = 0;
+	uint64_t offset = 0;
+	uint64_t size = 0;
+};
+
+struct ResourcePoolStats {
+	uint64_t reservedBytes;
+	uint64_t usedBytes;
+	uint64_t peakUsedBytes;
+	uint64_t largestFreeBlock;
+	uint32_t heapCount;
+	//1 - largest free block / total free, 0 means all free memory is one block
+	float fragmentation;
+};
+
+//Places buffers in large default heaps, each heap is suballocated with a buddy allocator.
+//Used for acceleration structure results and scratch memory which otherwise get a committed resource each.
+class ResourcePool {
+public:
+	ResourcePool(){}
+	~ResourcePool(){}
+
+	void Init(ID3D12Device* device, uint64_t heapSize);
+	PooledBuffer Allocate(uint64_t size, D3D12_RESOURCE_STATES initialState);
+	//range and resource are released once fenceValue has completed
+	void Free(PooledBuffer& buffer, uint64_t fenceValue);
+	//range can be handed out again right away, the next resource placed on it must be preceded by an aliasing barrier.
+	//the resource itself is kept alive until fenceValue has completed
+	void FreeAliased(PooledBuffer& buffer, uint64_t fenceValue);
+	void Reclaim(uint64_t completedFenceValue);
+
+	ResourcePoolStats GetStats() const;
+	void PrintStats(const char* name) const;
+private:
+	struct Heap {
+		ComPtr<ID3D12Heap> heap;
+		BuddyAllocator allocator;
+	};
+	struct DeferredFree {
+		uint64_t fenceValue;
+		ComPtr<ID3D12Resource> resource;
+		uint32_t heapIndex;
+		uint64_t offset;
+		bool releaseRange;
+	};
+	uint32_t CreateHeap(uint64_t size);
+
+	ID3D12Device* m_Device = nullptr;
+	uint64_t m_HeapSize = 0;
+	uint64_t m_PeakUsed = 0;
+	std::vector<std::unique_ptr<Heap>> m_Heaps;
+	std::deque<DeferredFree> m_DeferredFrees;
+};
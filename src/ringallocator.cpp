@@ -0,0 +1,66 @@
+#include "ringallocator.h"
+
+static inline uint64_t AlignOffset(uint64_t offset, uint64_t alignment) {
+	return (offset + (alignment - 1)) & ~(alignment - 1);
+}
+
+void RingAllocator::Init(uint64_t size) {
+	m_Size = size;
+	m_Head = 0;
+	m_Tail = 0;
+	m_Used = 0;
+	m_PendingBytes = 0;
+	m_Retired.clear();
+}
+
+uint64_t RingAllocator::Allocate(uint64_t size, uint64_t alignment) {
+	if (m_Used == 0) {
+		m_Head = 0;
+		m_Tail = 0;
+	}
+	uint64_t offset = AlignOffset(m_Head, alignment);
+	uint64_t end;
+	if (m_Head > m_Tail || m_Used == 0) {
+		//free space is [head, size) followed by [0, tail)
+		if (offset + size <= m_Size) {
+			end = offset + size;
+		} else if (size <= m_Tail) {
+			//wrap around, the skipped bytes at the end are charged to this allocation
+			offset = 0;
+			end = size;
+			m_Used += m_Size - m_Head;
+			m_PendingBytes += m_Size - m_Head;
+			m_Head = 0;
+		} else {
+			return INVALID_OFFSET;
+		}
+	} else if (offset + size <= m_Tail) {
+		//free space is [head, tail)
+		end = offset + size;
+	} else {
+		return INVALID_OFFSET;
+	}
+	m_Used += end - m_Head;
+	m_PendingBytes += end - m_Head;
+	m_Head = end;
+	return offset;
+}
+
+void RingAllocator::Retire(uint64_t fenceValue) {
+	if (m_PendingBytes == 0)
+		return;
+	Segment seg;
+	seg.fenceValue = fenceValue;
+	seg.end = m_Head;
+	seg.bytes = m_PendingBytes;
+	m_Retired.push_back(seg);
+	m_PendingBytes = 0;
+}
+
+void RingAllocator::Reclaim(uint64_t completedFenceValue) {
+	while (!m_Retired.empty() && m_Retired.front().fenceValue <= completedFenceValue) {
+		m_Tail = m_Retired.front().end;
+		m_Used -= m_Retired.front().bytes;
+		m_Retired.pop_front();
+	}
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <stdint.h>
+#include <deque>
+//Offset-only ring allocator, every range handed out since the last Retire is owned by that fence value
+//and becomes reusable once the fence value has completed. Has no D3D dependency so it can be driven by a fake timeline.
+class RingAllocator {
+public:
+	static const uint64_t INVALID_OFFSET = ~0ull;
+
+	RingAllocator(){}
+	~RingAllocator(){}
+
+	void Init(uint64_t size);
+	uint64_t Allocate(uint64_t size, uint64_t alignment);
+	void Retire(uint64_t fenceValue);
+	void Reclaim(uint64_t completedFenceValue);
+
+	uint64_t GetSize() const { return m_Size; }
+	uint64_t GetUsed() const { return m_Used; }
+private:
+	struct Segment {
+		uint64_t fenceValue;
+		uint64_t end;
+		uint64_t bytes;
+	};
+	uint64_t m_Size = 0;
+	uint64_t m_Head = 0;
+	uint64_t m_Tail = 0;
+	uint64_t m_Used = 0;
+	uint64_t m_PendingBytes = 0;
+	std::deque<Segment> m_Retired;
+};
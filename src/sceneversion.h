@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+
+//everything a traced frame depends on
+enum SceneComponent {
+	//the raygen's root arguments, which hold the viewport
+	SCENE_CAMERA,
+	SCENE_INSTANCES,
+	SCENE_GEOMETRY,
+	SCENE_PIPELINE,
+	SCENE_COMPONENT_COUNT
+};
+
+//Counts changes to the inputs of a trace. A frame traced at one version is still valid
+//as long as the version has not moved, so the engine can present it again instead of retracing.
+class SceneVersion {
+public:
+	SceneVersion(){}
+	~SceneVersion(){}
+
+	void Bump(SceneComponent component) {
+		++m_Counters[component];
+		++m_Version;
+	}
+	//bumps component if an external version it mirrors moved
+	void Observe(SceneComponent component, uint64_t sourceVersion, uint64_t* lastSeen) {
+		if (*lastSeen == sourceVersion)
+			return;
+		*lastSeen = sourceVersion;
+		Bump(component);
+	}
+	uint64_t GetVersion() const { return m_Version; }
+	uint64_t GetCounter(SceneComponent component) const { return m_Counters[component]; }
+	//true if nothing but component changed since an earlier copy of this version
+	bool OnlyChanged(SceneComponent component, const SceneVersion& since) const {
+		for (uint32_t c = 0; c < SCENE_COMPONENT_COUNT; ++c)
+			if (c != component && m_Counters[c] != since.m_Counters[c])
+				return false;
+		return true;
+	}
+private:
+	uint64_t m_Version = 0;
+	uint64_t m_Counters[SCENE_COMPONENT_COUNT] = {};
+};
@@ -0,0 +1,196 @@
+#include "shadercompiler.h"
+#include "profiler.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdio.h>
+
+static const uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+static const uint64_t FNV_PRIME = 0x100000001b3ull;
+
+static uint64_t HashBytes(uint64_t hash, const void* data, size_t size) {
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+static uint64_t HashString(uint64_t hash, const std::wstring& str) {
+	//include the terminator so "ab" + "c" and "a" + "bc" hash differently
+	return HashBytes(hash, str.c_str(), (str.size() + 1) * sizeof(wchar_t));
+}
+
+static bool ReadFile(const std::wstring& filename, std::string& out) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file.is_open())
+		return false;
+	std::stringstream ss;
+	ss << file.rdbuf();
+	out = ss.str();
+	return true;
+}
+
+static std::wstring DirectoryOf(const std::wstring& filename) {
+	size_t slash = filename.find_last_of(L"/\\");
+	return slash == std::wstring::npos ? std::wstring() : filename.substr(0, slash + 1);
+}
+
+void ShaderCompiler::Init(const wchar_t* cacheDir) {
+	m_DllSupport.Initialize();
+	std::unique_ptr<Instance> instance = AcquireInstance();
+
+	//a new compiler can produce different code, so its version is part of every key
+	ComPtr<IDxcVersionInfo> versionInfo;
+	if (SUCCEEDED(instance->compiler.As(&versionInfo))) {
+		UINT32 major = 0, minor = 0;
+		versionInfo->GetVersion(&major, &minor);
+		m_CompilerVersion = (major << 16) | minor;
+	}
+	ReleaseInstance(std::move(instance));
+
+	m_CacheDir = cacheDir;
+	CreateDirectoryW(m_CacheDir.c_str(), nullptr);
+}
+
+std::unique_ptr<ShaderCompiler::Instance> ShaderCompiler::AcquireInstance() {
+	{
+		std::lock_guard<std::mutex> lock(m_InstanceMutex);
+		if (!m_FreeInstances.empty()) {
+			std::unique_ptr<Instance> instance = std::move(m_FreeInstances.back());
+			m_FreeInstances.pop_back();
+			return instance;
+		}
+	}
+	//the dll is loaded once in Init, creating more instances from it is cheap
+	std::unique_ptr<Instance> instance = std::make_unique<Instance>();
+	m_DllSupport.CreateInstance(CLSID_DxcCompiler, instance->compiler.GetAddressOf());
+	m_DllSupport.CreateInstance(CLSID_DxcLibrary, instance->library.GetAddressOf());
+	instance->library->CreateIncludeHandler(&instance->includeHandler);
+	return instance;
+}
+
+void ShaderCompiler::ReleaseInstance(std::unique_ptr<Instance> instance) {
+	std::lock_guard<std::mutex> lock(m_InstanceMutex);
+	m_FreeInstances.push_back(std::move(instance));
+}
+
+void ShaderCompiler::HashIncludes(const std::wstring& filename, const std::string& source, uint64_t& hash, std::vector<std::wstring>& visited) {
+	std::wstring dir = DirectoryOf(filename);
+	std::istringstream lines(source);
+	std::string line;
+	while (std::getline(lines, line)) {
+		size_t pos = line.find_first_not_of(" \t");
+		if (pos == std::string::npos || line[pos] != '#')
+			continue;
+		pos = line.find_first_not_of(" \t", pos + 1);
+		if (pos == std::string::npos || line.compare(pos, 7, "include") != 0)
+			continue;
+		size_t open = line.find_first_of("\"<", pos + 7);
+		if (open == std::string::npos)
+			continue;
+		size_t close = line.find_first_of("\">", open + 1);
+		if (close == std::string::npos)
+			continue;
+		std::string name = line.substr(open + 1, close - open - 1);
+		std::wstring includePath = dir + std::wstring(name.begin(), name.end());
+		if (std::find(visited.begin(), visited.end(), includePath) != visited.end())
+			continue;
+		visited.push_back(includePath);
+
+		hash = HashString(hash, includePath);
+		std::string includeSource;
+		if (ReadFile(includePath, includeSource)) {
+			hash = HashBytes(hash, includeSource.data(), includeSource.size());
+			HashIncludes(includePath, includeSource, hash, visited);
+		}
+	}
+}
+
+uint64_t ShaderCompiler::HashSources(const std::wstring& filename, std::string& source) {
+	uint64_t hash = HashBytes(FNV_OFFSET, source.data(), source.size());
+	std::vector<std::wstring> visited;
+	HashIncludes(filename, source, hash, visited);
+	return hash;
+}
+
+uint64_t ShaderCompiler::HashSourceFiles(const wchar_t* filename) {
+	std::string str;
+	if (!ReadFile(filename, str))
+		return 0;
+	return HashSources(filename, str);
+}
+
+ComPtr<IDxcBlob> ShaderCompiler::LoadCached(Instance* instance, const std::wstring& path) {
+	std::string data;
+	if (!ReadFile(path, data) || data.empty())
+		return nullptr;
+	ComPtr<IDxcBlobEncoding> blob;
+	instance->library->CreateBlobWithEncodingOnHeapCopy(data.data(), (UINT32)data.size(), 0, &blob);
+	ComPtr<IDxcBlob> ret;
+	blob.As(&ret);
+	return ret;
+}
+
+void ShaderCompiler::StoreCached(const std::wstring& path, IDxcBlob* blob) {
+	//write to a temporary first so a crash never leaves a truncated blob behind
+	std::wstring tmpPath = path + L"." + std::to_wstring(GetCurrentThreadId()) + L".tmp";
+	{
+		std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!file.is_open())
+			return;
+		file.write((const char*)blob->GetBufferPointer(), blob->GetBufferSize());
+	}
+	MoveFileExW(tmpPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+}
+
+ComPtr<IDxcBlob> ShaderCompiler::Compile(const wchar_t* filename, const wchar_t* entryPoint, const wchar_t* target, const std::vector<std::wstring>& args) {
+	PROFILE_SCOPE("CompileShader");
+	std::string str;
+	if (!ReadFile(filename, str)) {
+		printf("ShaderCompiler: Could not open %ls\n", filename);
+		return nullptr;
+	}
+
+	uint64_t key = HashSources(filename, str);
+	key = HashString(key, entryPoint);
+	key = HashString(key, target);
+	for (auto& arg : args)
+		key = HashString(key, arg);
+	key = HashBytes(key, &m_CompilerVersion, sizeof(m_CompilerVersion));
+
+	wchar_t keyStr[17];
+	swprintf(keyStr, 17, L"%016llx", key);
+	std::wstring cachePath = m_CacheDir + L"/" + keyStr + L".dxil";
+	std::unique_ptr<Instance> instance = AcquireInstance();
+	ComPtr<IDxcBlob> cached = LoadCached(instance.get(), cachePath);
+	if (cached) {
+		m_CacheHits++;
+		ReleaseInstance(std::move(instance));
+		return cached;
+	}
+	m_CacheMisses++;
+
+	ComPtr<IDxcBlobEncoding> textBlob;
+	instance->library->CreateBlobWithEncodingFromPinned((LPBYTE)str.data(), (UINT32)str.size(), 0, &textBlob);
+	std::vector<LPCWSTR> argPtrs;
+	for (auto& arg : args)
+		argPtrs.push_back(arg.c_str());
+	ComPtr<IDxcOperationResult> result;
+	instance->compiler->Compile(textBlob.Get(), filename, entryPoint, target, argPtrs.data(), (UINT32)argPtrs.size(), nullptr, 0, instance->includeHandler.Get(), &result);
+	ReleaseInstance(std::move(instance));
+	HRESULT status;
+	result->GetStatus(&status);
+	if (FAILED(status)) {
+		ComPtr<IDxcBlobEncoding> error;
+		result->GetErrorBuffer(&error);
+		printf("ShaderCompiler: Error! \n%s\n", (char*)error->GetBufferPointer());
+		return nullptr;
+	}
+
+	ComPtr<IDxcBlob> ret;
+	result->GetResult(&ret);
+	StoreCached(cachePath, ret.Get());
+	return ret;
+}
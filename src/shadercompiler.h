@@ -0,0 +1,50 @@
+#pragma once
+#include <dx/dxcapi.use.h>
+#include <wrl/client.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+using Microsoft::WRL::ComPtr;
+
+//Loads dxc once for the whole run and caches compiled DXIL on disk.
+//The cache key hashes the source, every file it includes, entry point, target profile, arguments and compiler version,
+//so a warm start with unchanged shaders never invokes the compiler.
+//dxc objects are not thread safe, so every concurrent compile borrows its own compiler instance from a pool.
+class ShaderCompiler {
+public:
+	ShaderCompiler(){}
+	~ShaderCompiler(){}
+
+	void Init(const wchar_t* cacheDir);
+	ComPtr<IDxcBlob> Compile(const wchar_t* filename, const wchar_t* entryPoint, const wchar_t* target, const std::vector<std::wstring>& args);
+	ComPtr<IDxcBlob> CompileLibrary(const wchar_t* filename) { return Compile(filename, L"", L"lib_6_1", std::vector<std::wstring>()); }
+	//hash of a file and everything it includes, 0 if it can not be read
+	uint64_t HashSourceFiles(const wchar_t* filename);
+
+	const std::wstring& GetCacheDir() const { return m_CacheDir; }
+	uint32_t GetCacheHits() const { return m_CacheHits; }
+	uint32_t GetCacheMisses() const { return m_CacheMisses; }
+private:
+	struct Instance {
+		ComPtr<IDxcCompiler> compiler;
+		ComPtr<IDxcLibrary> library;
+		ComPtr<IDxcIncludeHandler> includeHandler;
+	};
+	std::unique_ptr<Instance> AcquireInstance();
+	void ReleaseInstance(std::unique_ptr<Instance> instance);
+	uint64_t HashSources(const std::wstring& filename, std::string& source);
+	void HashIncludes(const std::wstring& filename, const std::string& source, uint64_t& hash, std::vector<std::wstring>& visited);
+	ComPtr<IDxcBlob> LoadCached(Instance* instance, const std::wstring& path);
+	void StoreCached(const std::wstring& path, IDxcBlob* blob);
+
+	dxc::DxcDllSupport m_DllSupport;
+	std::mutex m_InstanceMutex;
+	std::vector<std::unique_ptr<Instance>> m_FreeInstances;
+	std::wstring m_CacheDir;
+	uint32_t m_CompilerVersion = 0;
+	std::atomic<uint32_t> m_CacheHits{ 0 };
+	std::atomic<uint32_t> m_CacheMisses{ 0 };
+};
@@ -0,0 +1,148 @@
+#include "shadertable.h"
+#include <dx/d3dx12.h>
+#include <string.h>
+
+static inline uint32_t AlignSize(uint32_t size, uint32_t alignment) {
+	return (size + (alignment - 1)) & ~(alignment - 1);
+}
+
+void ShaderTableBuilder::Init(ID3D12Device* device, uint32_t shaderIDSize) {
+	m_Device = device;
+	m_ShaderIDSize = shaderIDSize;
+	for (uint32_t s = 0; s < SHADER_TABLE_SECTION_COUNT; ++s)
+		m_Sections[s] = Section();
+	m_Image.clear();
+	m_DirtyBlocks.clear();
+	m_LayoutChanged = true;
+}
+
+void ShaderTableBuilder::SetSectionLayout(ShaderTableSection section, uint32_t recordCount, uint32_t maxRootArgsSize) {
+	Section& sec = m_Sections[section];
+	if (sec.count == recordCount && sec.maxRootArgsSize == maxRootArgsSize)
+		return;
+	sec.count = recordCount;
+	sec.maxRootArgsSize = maxRootArgsSize;
+	Relayout();
+}
+
+uint32_t ShaderTableBuilder::AllocateHitGroupRange(uint32_t geometryCount) {
+	const Section& sec = m_Sections[SHADER_TABLE_HITGROUP];
+	uint32_t base = sec.count;
+	SetSectionLayout(SHADER_TABLE_HITGROUP, base + geometryCount * m_RayTypeCount, sec.maxRootArgsSize);
+	return base;
+}
+
+void ShaderTableBuilder::Relayout() {
+	Section oldSections[SHADER_TABLE_SECTION_COUNT];
+	memcpy(oldSections, m_Sections, sizeof(m_Sections));
+	std::vector<uint8_t> oldImage;
+	oldImage.swap(m_Image);
+
+	uint32_t offset = 0;
+	for (uint32_t s = 0; s < SHADER_TABLE_SECTION_COUNT; ++s) {
+		Section& sec = m_Sections[s];
+		sec.offset = offset;
+		sec.stride = AlignSize(m_ShaderIDSize + sec.maxRootArgsSize, D3D12_RAYTRACING_SHADER_RECORD_BYTE_ALIGNMENT);
+		offset = AlignSize(offset + sec.stride * sec.count, SHADER_TABLE_BYTE_ALIGNMENT);
+	}
+	m_Image.assign(offset, 0);
+	//keep the records that still have a slot so growing a section does not need every record to be set again
+	for (uint32_t s = 0; s < SHADER_TABLE_SECTION_COUNT; ++s) {
+		const Section& from = oldSections[s];
+		const Section& to = m_Sections[s];
+		uint32_t count = from.count < to.count ? from.count : to.count;
+		uint32_t size = from.stride < to.stride ? from.stride : to.stride;
+		for (uint32_t i = 0; i < count; ++i)
+			memcpy(m_Image.data() + to.offset + i * to.stride, oldImage.data() + from.offset + i * from.stride, size);
+	}
+	m_DirtyBlocks.assign(offset / SHADER_TABLE_BYTE_ALIGNMENT, true);
+	m_LayoutChanged = true;
+	++m_Version;
+}
+
+void ShaderTableBuilder::SetRecord(ShaderTableSection section, uint32_t index, const void* shaderID, const void* rootArgs, uint32_t rootArgsSize) {
+	const Section& sec = m_Sections[section];
+	if (index >= sec.count || rootArgsSize > sec.maxRootArgsSize || !shaderID)
+		return;
+	uint32_t offset = sec.offset + index * sec.stride;
+	uint8_t* record = m_Image.data() + offset;
+	//rewriting an identical record does not cost an upload
+	if (memcmp(record, shaderID, m_ShaderIDSize) == 0 && (rootArgsSize == 0 || memcmp(record + m_ShaderIDSize, rootArgs, rootArgsSize) == 0))
+		return;
+	memcpy(record, shaderID, m_ShaderIDSize);
+	if (rootArgsSize > 0)
+		memcpy(record + m_ShaderIDSize, rootArgs, rootArgsSize);
+	for (uint32_t b = offset / SHADER_TABLE_BYTE_ALIGNMENT; b <= (offset + sec.stride - 1) / SHADER_TABLE_BYTE_ALIGNMENT; ++b)
+		m_DirtyBlocks[b] = true;
+	++m_Version;
+}
+
+void ShaderTableBuilder::Upload(ID3D12GraphicsCommandList* cmdList, UploadRing& ring, uint64_t fenceValue) {
+	if (m_Image.empty())
+		return;
+	if (m_LayoutChanged && m_BufferSize < m_Image.size()) {
+		if (m_Buffer)
+			m_RetiredBuffers.push_back({ fenceValue, m_Buffer });
+		const auto defaultHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+		auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(m_Image.size());
+		m_Device->CreateCommittedResource(
+			&defaultHeapProperties,
+			D3D12_HEAP_FLAG_NONE,
+			&bufferDesc,
+			D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+			nullptr,
+			IID_PPV_ARGS(&m_Buffer));
+		m_BufferSize = m_Image.size();
+	}
+	m_LayoutChanged = false;
+
+	bool transitioned = false;
+	uint32_t blockCount = (uint32_t)m_DirtyBlocks.size();
+	for (uint32_t b = 0; b < blockCount;) {
+		if (!m_DirtyBlocks[b]) {
+			b++;
+			continue;
+		}
+		//coalesce neighbouring dirty blocks into one copy
+		uint32_t end = b;
+		while (end < blockCount && m_DirtyBlocks[end])
+			end++;
+		uint64_t start = (uint64_t)b * SHADER_TABLE_BYTE_ALIGNMENT;
+		uint64_t size = (uint64_t)(end - b) * SHADER_TABLE_BYTE_ALIGNMENT;
+		UploadAllocation alloc = ring.Upload(m_Image.data() + start, size);
+		//blocks the ring had no room for stay dirty and are retried by the next Upload
+		if (alloc.cpuAddress) {
+			if (!transitioned) {
+				cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_Buffer.Get(), D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST));
+				transitioned = true;
+			}
+			cmdList->CopyBufferRegion(m_Buffer.Get(), start, alloc.resource, alloc.offset, size);
+			for (uint32_t cleared = b; cleared < end; ++cleared)
+				m_DirtyBlocks[cleared] = false;
+		}
+		b = end;
+	}
+	if (transitioned)
+		cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(m_Buffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+}
+
+void ShaderTableBuilder::Reclaim(uint64_t completedFenceValue) {
+	while (!m_RetiredBuffers.empty() && m_RetiredBuffers.front().fenceValue <= completedFenceValue)
+		m_RetiredBuffers.pop_front();
+}
+
+void ShaderTableBuilder::FillDispatchDesc(D3D12_FALLBACK_DISPATCH_RAYS_DESC* desc) const {
+	D3D12_GPU_VIRTUAL_ADDRESS base = m_Buffer->GetGPUVirtualAddress();
+	const Section& rayGen = m_Sections[SHADER_TABLE_RAYGEN];
+	desc->RayGenerationShaderRecord.StartAddress = base + rayGen.offset;
+	desc->RayGenerationShaderRecord.SizeInBytes = rayGen.stride;
+
+	D3D12_GPU_VIRTUAL_ADDRESS_RANGE_AND_STRIDE* tables[] = { &desc->MissShaderTable, &desc->HitGroupTable, &desc->CallableShaderTable };
+	ShaderTableSection sections[] = { SHADER_TABLE_MISS, SHADER_TABLE_HITGROUP, SHADER_TABLE_CALLABLE };
+	for (uint32_t i = 0; i < ARRAYSIZE(tables); ++i) {
+		const Section& sec = m_Sections[sections[i]];
+		tables[i]->StartAddress = sec.count > 0 ? base + sec.offset : 0;
+		tables[i]->SizeInBytes = (uint64_t)sec.stride * sec.count;
+		tables[i]->StrideInBytes = sec.count > 0 ? sec.stride : 0;
+	}
+}
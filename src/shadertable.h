@@ -0,0 +1,73 @@
+#pragma once
+#include <dx/d3d12_1.h>
+#include <wrl/client.h>
+#include <dx/D3D12RaytracingFallback.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include "uploadring.h"
+using Microsoft::WRL::ComPtr;
+
+#define SHADER_TABLE_BYTE_ALIGNMENT 64
+
+enum ShaderTableSection {
+	SHADER_TABLE_RAYGEN,
+	SHADER_TABLE_MISS,
+	SHADER_TABLE_HITGROUP,
+	SHADER_TABLE_CALLABLE,
+	SHADER_TABLE_SECTION_COUNT
+};
+
+//Lays out raygen, miss, hitgroup and callable records back to back in one gpu buffer.
+//Every section gets the smallest stride that fits its largest root arguments.
+//Records are written to a cpu image and only the ones that changed are copied to the gpu on Upload.
+class ShaderTableBuilder {
+public:
+	ShaderTableBuilder(){}
+	~ShaderTableBuilder(){}
+
+	void Init(ID3D12Device* device, uint32_t shaderIDSize);
+	void SetSectionLayout(ShaderTableSection section, uint32_t recordCount, uint32_t maxRootArgsSize);
+	//hitgroup records for one instance, geometryCount * rayTypeCount records starting at the returned index,
+	//the returned index is the instance's InstanceContributionToHitGroupIndex
+	uint32_t AllocateHitGroupRange(uint32_t geometryCount);
+	void SetRayTypeCount(uint32_t rayTypeCount) { m_RayTypeCount = rayTypeCount; }
+	uint32_t GetRayTypeCount() const { return m_RayTypeCount; }
+
+	void SetRecord(ShaderTableSection section, uint32_t index, const void* shaderID, const void* rootArgs, uint32_t rootArgsSize);
+	//record index the hardware picks, with MultiplierForGeometryContributionToHitGroupIndex == ray type count
+	uint32_t HitGroupRecordIndex(uint32_t instanceContribution, uint32_t geometryIndex, uint32_t rayType) const {
+		return instanceContribution + geometryIndex * m_RayTypeCount + rayType;
+	}
+
+	//records the copies of all changed records, buffers replaced by a relayout are released after fenceValue
+	void Upload(ID3D12GraphicsCommandList* cmdList, UploadRing& ring, uint64_t fenceValue);
+	void Reclaim(uint64_t completedFenceValue);
+	void FillDispatchDesc(D3D12_FALLBACK_DISPATCH_RAYS_DESC* desc) const;
+	//changes whenever a record's contents or the layout change, root arguments hold the camera
+	uint64_t GetVersion() const { return m_Version; }
+private:
+	struct Section {
+		uint32_t offset = 0;
+		uint32_t stride = 0;
+		uint32_t count = 0;
+		uint32_t maxRootArgsSize = 0;
+	};
+	struct RetiredBuffer {
+		uint64_t fenceValue;
+		ComPtr<ID3D12Resource> buffer;
+	};
+	void Relayout();
+
+	ID3D12Device* m_Device = nullptr;
+	uint32_t m_ShaderIDSize = 0;
+	uint32_t m_RayTypeCount = 1;
+	Section m_Sections[SHADER_TABLE_SECTION_COUNT];
+	std::vector<uint8_t> m_Image;
+	std::vector<bool> m_DirtyBlocks; //one flag per SHADER_TABLE_BYTE_ALIGNMENT bytes of the image
+	bool m_LayoutChanged = false;
+	uint64_t m_Version = 0;
+	ComPtr<ID3D12Resource> m_Buffer;
+	uint64_t m_BufferSize = 0;
+	std::deque<RetiredBuffer> m_RetiredBuffers;
+};
@@ -0,0 +1,35 @@
+#include "threadpool.h"
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Quit = true;
+	}
+	m_Cond.notify_all();
+	for (auto& thread : m_Threads)
+		thread.join();
+}
+
+void ThreadPool::Init(uint32_t threadCount) {
+	if (threadCount == 0)
+		threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0)
+		threadCount = 1;
+	for (uint32_t i = 0; i < threadCount; ++i)
+		m_Threads.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+}
+
+void ThreadPool::WorkerLoop() {
+	for (;;) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Cond.wait(lock, [this]() { return m_Quit || !m_Queue.empty(); });
+			if (m_Quit && m_Queue.empty())
+				return;
+			job = std::move(m_Queue.front());
+			m_Queue.pop_front();
+		}
+		job();
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <stdint.h>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Fixed set of worker threads pulling jobs from one FIFO queue.
+//Jobs are started in submission order, so a job may wait on the futures of jobs submitted before it.
+class ThreadPool {
+public:
+	ThreadPool(){}
+	~ThreadPool();
+
+	//threadCount 0 uses one thread per hardware thread
+	void Init(uint32_t threadCount);
+
+	template<typename F>
+	auto Submit(F&& job) -> std::future<decltype(job())> {
+		typedef decltype(job()) Result;
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<F>(job));
+		std::future<Result> future = task->get_future();
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_Queue.push_back([task]() { (*task)(); });
+		}
+		m_Cond.notify_one();
+		return future;
+	}
+
+	uint32_t GetThreadCount() const { return (uint32_t)m_Threads.size(); }
+private:
+	void WorkerLoop();
+
+	std::vector<std::thread> m_Threads;
+	std::deque<std::function<void()>> m_Queue;
+	std::mutex m_Mutex;
+	std::condition_variable m_Cond;
+	bool m_Quit = false;
+};
@@ -0,0 +1,22 @@
+#include "timeline.h"
+
+bool Timeline::IsComplete(uint64_t value) {
+	if (value <= m_CompletedValue)
+		return true;
+	return GetCompletedValue() >= value;
+}
+
+uint64_t Timeline::GetCompletedValue() {
+	uint64_t completed = PollCompleted();
+	if (completed > m_CompletedValue)
+		m_CompletedValue = completed;
+	return m_CompletedValue;
+}
+
+void SimulatedTimeline::Simulate(uint64_t value) {
+	uint64_t lastSignaled = GetLastSignaled();
+	if (value > lastSignaled)
+		value = lastSignaled;
+	if (value > m_CompletedValue)
+		m_CompletedValue = value;
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+
+//A monotonic timeline of points signaled by one queue.
+//Work recorded now belongs to GetNextValue() and is complete once IsComplete returns true for it.
+//Has no D3D dependency: D3D12Timeline backs it with a fence, SimulatedTimeline only completes points through Simulate,
+//so deferred frees and frame pacing can be driven deterministically without a gpu.
+class Timeline {
+public:
+	Timeline(){}
+	virtual ~Timeline(){}
+
+	//blocks the cpu until value is reached
+	virtual void Wait(uint64_t value) = 0;
+	//cheap, only polls the queue when the cached value is not recent enough
+	bool IsComplete(uint64_t value);
+	uint64_t GetCompletedValue();
+	uint64_t GetNextValue() const { return m_NextValue; }
+	uint64_t GetLastSignaled() const { return m_NextValue - 1; }
+protected:
+	//latest value the queue reports as completed, may be older than the cached one
+	virtual uint64_t PollCompleted() = 0;
+	void Reset() { m_NextValue = 1; m_CompletedValue = 0; }
+
+	uint64_t m_NextValue = 1;
+	uint64_t m_CompletedValue = 0;
+};
+
+//a queue that never runs on its own, the caller decides when signaled points complete
+class SimulatedTimeline : public Timeline {
+public:
+	SimulatedTimeline(){}
+	~SimulatedTimeline(){}
+
+	//a point for the work submitted so far
+	uint64_t Signal() { return m_NextValue++; }
+	//completes every signaled point up to value
+	void Simulate(uint64_t value);
+	//nothing else would ever complete it, a simulated wait completes in submission order
+	void Wait(uint64_t value) override { Simulate(value); }
+protected:
+	uint64_t PollCompleted() override { return m_CompletedValue; }
+};
@@ -0,0 +1,77 @@
+#include "uploadring.h"
+#include <dx/d3dx12.h>
+#include <stdio.h>
+#include <string.h>
+
+UploadRing::~UploadRing() {
+	if (m_Buffer && m_CPUBase)
+		m_Buffer->Unmap(0, nullptr);
+}
+
+void UploadRing::Init(ID3D12Device* device, uint64_t size) {
+	m_Device = device;
+	const auto uploadHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+	auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(size);
+	device->CreateCommittedResource(
+		&uploadHeapProperties,
+		D3D12_HEAP_FLAG_NONE,
+		&bufferDesc,
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&m_Buffer));
+	//upload heaps can stay mapped for the lifetime of the resource
+	m_Buffer->Map(0, nullptr, reinterpret_cast<void**>(&m_CPUBase));
+	m_GPUBase = m_Buffer->GetGPUVirtualAddress();
+	m_Allocator.Init(size);
+}
+
+UploadAllocation UploadRing::Allocate(uint64_t size, uint64_t alignment) {
+	UploadAllocation alloc;
+	uint64_t offset = m_Allocator.Allocate(size, alignment);
+	if (offset == RingAllocator::INVALID_OFFSET)
+		return AllocateDedicated(size);
+	alloc.resource = m_Buffer.Get();
+	alloc.offset = offset;
+	alloc.cpuAddress = m_CPUBase + offset;
+	alloc.gpuAddress = m_GPUBase + offset;
+	return alloc;
+}
+
+UploadAllocation UploadRing::AllocateDedicated(uint64_t size) {
+	//committed buffers start at a 64KB boundary, which satisfies every alignment the ring is asked for
+	UploadAllocation alloc;
+	const auto uploadHeapProperties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD);
+	auto bufferDesc = CD3DX12_RESOURCE_DESC::Buffer(size);
+	ComPtr<ID3D12Resource> buffer;
+	uint8_t* cpuAddress = nullptr;
+	if (FAILED(m_Device->CreateCommittedResource(&uploadHeapProperties, D3D12_HEAP_FLAG_NONE, &bufferDesc, D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&buffer)))
+		|| FAILED(buffer->Map(0, nullptr, reinterpret_cast<void**>(&cpuAddress)))) {
+		printf("UploadRing: Out of memory! %llu of %llu bytes in flight, no dedicated buffer for %llu\n", m_Allocator.GetUsed(), m_Allocator.GetSize(), size);
+		return alloc;
+	}
+	alloc.resource = buffer.Get();
+	alloc.cpuAddress = cpuAddress;
+	alloc.gpuAddress = buffer->GetGPUVirtualAddress();
+	m_PendingBuffers.push_back(buffer);
+	return alloc;
+}
+
+void UploadRing::Retire(uint64_t fenceValue) {
+	m_Allocator.Retire(fenceValue);
+	for (auto& buffer : m_PendingBuffers)
+		m_RetiredBuffers.push_back({ fenceValue, buffer });
+	m_PendingBuffers.clear();
+}
+
+void UploadRing::Reclaim(uint64_t completedFenceValue) {
+	m_Allocator.Reclaim(completedFenceValue);
+	while (!m_RetiredBuffers.empty() && m_RetiredBuffers.front().fenceValue <= completedFenceValue)
+		m_RetiredBuffers.pop_front();
+}
+
+UploadAllocation UploadRing::Upload(const void* data, uint64_t size, uint64_t alignment) {
+	UploadAllocation alloc = Allocate(size, alignment);
+	if (alloc.cpuAddress)
+		memcpy(alloc.cpuAddress, data, size);
+	return alloc;
+}
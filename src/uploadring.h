@@ -0,0 +1,48 @@
+#pragma once
+#include <dx/d3d12_1.h>
+#include <wrl/client.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include "ringallocator.h"
+using Microsoft::WRL::ComPtr;
+
+struct UploadAllocation {
+	ID3D12Resource* resource = nullptr;
+	uint64_t offset = 0;
+	uint8_t* cpuAddress = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS gpuAddress = 0;
+};
+
+//One persistently mapped upload buffer that all small uploads are sub-allocated from.
+//Requests the ring can not fit, larger than it or while it is full, get a committed buffer of their own that lives as long as a ring range would.
+//Call Retire with the fence value signaled after the work using the allocations and Reclaim with the completed value.
+class UploadRing {
+public:
+	UploadRing(){}
+	~UploadRing();
+
+	void Init(ID3D12Device* device, uint64_t size);
+	//only returns an empty allocation if not even a dedicated buffer could be created
+	UploadAllocation Allocate(uint64_t size, uint64_t alignment = D3D12_RAW_UAV_SRV_BYTE_ALIGNMENT);
+	UploadAllocation Upload(const void* data, uint64_t size, uint64_t alignment = D3D12_RAW_UAV_SRV_BYTE_ALIGNMENT);
+	void Retire(uint64_t fenceValue);
+	void Reclaim(uint64_t completedFenceValue);
+
+	ID3D12Resource* GetResource() const { return m_Buffer.Get(); }
+private:
+	struct RetiredBuffer {
+		uint64_t fenceValue;
+		ComPtr<ID3D12Resource> resource;
+	};
+	UploadAllocation AllocateDedicated(uint64_t size);
+
+	ID3D12Device* m_Device = nullptr;
+	ComPtr<ID3D12Resource> m_Buffer;
+	uint8_t* m_CPUBase = nullptr;
+	D3D12_GPU_VIRTUAL_ADDRESS m_GPUBase = 0;
+	RingAllocator m_Allocator;
+	//dedicated buffers handed out since the last Retire, and those waiting for their fence
+	std::vector<ComPtr<ID3D12Resource>> m_PendingBuffers;
+	std::deque<RetiredBuffer> m_RetiredBuffers;
+};
@@ -0,0 +1,26 @@
+#include "upsampler.h"
+#include "profiler.h"
+#include <dx/d3dx12.h>
+
+void Upsampler::Init(ID3D12Device* device, ShaderCompiler* compiler) {
+	PROFILE_SCOPE("InitUpsampler");
+	CD3DX12_DESCRIPTOR_RANGE UAVDescriptor;
+	UAVDescriptor.Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0);
+	CD3DX12_ROOT_PARAMETER rootParameters[UPSAMPLE_ROOT_COUNT];
+	rootParameters[UPSAMPLE_ROOT_OUTPUT].InitAsDescriptorTable(1, &UAVDescriptor);
+	rootParameters[UPSAMPLE_ROOT_ACCUMULATION].InitAsUnorderedAccessView(1);
+	rootParameters[UPSAMPLE_ROOT_AUXILIARY].InitAsUnorderedAccessView(2);
+	rootParameters[UPSAMPLE_ROOT_CONSTANTS].InitAsConstants(sizeof(UpsampleConstants) / sizeof(uint32_t), 0);
+	CD3DX12_ROOT_SIGNATURE_DESC rootSignatureDesc(ARRAYSIZE(rootParameters), rootParameters);
+	m_Pass.Init(device, compiler, "Upsampler", L"shader/upsample.hlsl", rootSignatureDesc);
+}
+
+void Upsampler::Record(ID3D12GraphicsCommandList* cmdList, D3D12_GPU_DESCRIPTOR_HANDLE output, D3D12_GPU_VIRTUAL_ADDRESS accumulation,
+	D3D12_GPU_VIRTUAL_ADDRESS auxiliary, const UpsampleConstants& constants) {
+	m_Pass.Bind(cmdList);
+	cmdList->SetComputeRootDescriptorTable(UPSAMPLE_ROOT_OUTPUT, output);
+	cmdList->SetComputeRootUnorderedAccessView(UPSAMPLE_ROOT_ACCUMULATION, accumulation);
+	cmdList->SetComputeRootUnorderedAccessView(UPSAMPLE_ROOT_AUXILIARY, auxiliary);
+	cmdList->SetComputeRoot32BitConstants(UPSAMPLE_ROOT_CONSTANTS, sizeof(constants) / sizeof(uint32_t), &constants, 0);
+	ComputePass::Dispatch(cmdList, constants.targetWidth, constants.targetHeight, UPSAMPLE_GROUP_SIZE);
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <dx/d3d12_1.h>
+#include <stdint.h>
+#include "computepass.h"
+#define UPSAMPLE_GROUP_SIZE 8
+
+//root signature slots, mirrored by the registers in upsample.hlsl
+enum UpsampleRootParameter {
+	UPSAMPLE_ROOT_OUTPUT,
+	UPSAMPLE_ROOT_ACCUMULATION,
+	UPSAMPLE_ROOT_AUXILIARY,
+	UPSAMPLE_ROOT_CONSTANTS,
+	UPSAMPLE_ROOT_COUNT
+};
+
+struct UpsampleConstants {
+	uint32_t sourceWidth;
+	uint32_t sourceHeight;
+	uint32_t targetWidth;
+	uint32_t targetHeight;
+};
+
+//Compute pass that scales the accumulated color of a reduced resolution trace up to the output target.
+//Taps are weighted by depth and normal from the auxiliary buffer so silhouettes are not blurred across.
+class Upsampler {
+public:
+	Upsampler(){}
+	~Upsampler(){}
+
+	//compiles upsample.hlsl, may run on a pool thread
+	void Init(ID3D12Device* device, ShaderCompiler* compiler);
+	bool IsReady() const { return m_Pass.IsReady(); }
+	//the list's descriptor heap must hold output, the accumulation and auxiliary buffers are rows of sourceWidth pixels
+	void Record(ID3D12GraphicsCommandList* cmdList, D3D12_GPU_DESCRIPTOR_HANDLE output, D3D12_GPU_VIRTUAL_ADDRESS accumulation,
+		D3D12_GPU_VIRTUAL_ADDRESS auxiliary, const UpsampleConstants& constants);
+private:
+	ComputePass m_Pass;
+};
@@ -0,0 +1,82 @@
+#include "test.h"
+#include "mockcommandlists.h"
+#include "commandlistpool.h"
+
+typedef CommandListPool<MockCommandLists> MockListPool;
+
+static std::vector<MockListPool::RecordJob> MakeJobs(uint32_t count) {
+	std::vector<MockListPool::RecordJob> jobs;
+	for (uint32_t i = 0; i < count; ++i) {
+		jobs.push_back([i](MockCommandList& cmd) {
+			cmd.commands.push_back(i);
+			cmd.recordedOn = std::this_thread::get_id();
+		});
+	}
+	return jobs;
+}
+
+TEST(RecordKeepsJobOrder) {
+	ThreadPool pool;
+	pool.Init(4);
+	MockListPool lists;
+	std::vector<MockCommandList*> recorded = lists.Record(pool, MakeJobs(16));
+	CHECK(recorded.size() == 16);
+	bool onOtherThread = false;
+	for (uint32_t i = 0; i < recorded.size(); ++i) {
+		CHECK(!recorded[i]->open);
+		CHECK(recorded[i]->commands.size() == 1 && recorded[i]->commands[0] == i);
+		onOtherThread |= recorded[i]->recordedOn != std::this_thread::get_id();
+	}
+	//the first job runs on the calling thread, the rest on the pool
+	CHECK(recorded[0]->recordedOn == std::this_thread::get_id());
+	CHECK(onOtherThread);
+	CHECK(lists.GetBackend().GetMisuses() == 0);
+}
+
+TEST(ListsAreReusedOnlyOnceTheirFenceCompleted) {
+	ThreadPool pool;
+	pool.Init(2);
+	MockListPool lists;
+	std::vector<MockCommandList*> frame1 = lists.Record(pool, MakeJobs(3));
+	lists.Retire(frame1, 1);
+	//fence 1 has not completed, so a second frame needs lists of its own
+	std::vector<MockCommandList*> frame2 = lists.Record(pool, MakeJobs(3));
+	lists.Retire(frame2, 2);
+	CHECK(lists.GetBackend().GetCreated() == 6);
+	CHECK(lists.GetBackend().GetResets() == 0);
+
+	lists.Reclaim(1);
+	std::vector<MockCommandList*> frame3 = lists.Record(pool, MakeJobs(3));
+	CHECK(lists.GetBackend().GetCreated() == 6);
+	CHECK(lists.GetBackend().GetResets() == 3);
+	for (MockCommandList* cmd : frame3) {
+		bool fromFrame1 = cmd == frame1[0] || cmd == frame1[1] || cmd == frame1[2];
+		CHECK(fromFrame1);
+		//a reset list only holds what was recorded since
+		CHECK(cmd->commands.size() == 1);
+	}
+	//a fourth list is new, frame 2's are still in flight
+	std::vector<MockCommandList*> frame4 = lists.Record(pool, MakeJobs(4));
+	CHECK(lists.GetBackend().GetCreated() == 10);
+	CHECK(lists.GetListCount() == 10);
+	CHECK(lists.GetBackend().GetMisuses() == 0);
+}
+
+TEST(FramesInFlightBoundTheListCount) {
+	ThreadPool pool;
+	pool.Init(4);
+	MockListPool lists;
+	const uint64_t framesInFlight = 3;
+	const uint32_t jobsPerFrame = 5;
+	for (uint64_t fence = 1; fence <= 200; ++fence) {
+		//the frame pacing wait: frame fence - framesInFlight has completed before this one records
+		if (fence > framesInFlight)
+			lists.Reclaim(fence - framesInFlight);
+		std::vector<MockCommandList*> recorded = lists.Record(pool, MakeJobs(jobsPerFrame));
+		for (uint32_t i = 0; i < recorded.size(); ++i)
+			CHECK(recorded[i]->commands.size() == 1 && recorded[i]->commands[0] == i);
+		lists.Retire(recorded, fence);
+	}
+	CHECK(lists.GetListCount() == framesInFlight * jobsPerFrame);
+	CHECK(lists.GetBackend().GetMisuses() == 0);
+}
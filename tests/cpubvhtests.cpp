@@ -0,0 +1,108 @@
+#include "test.h"
+#include "cpubvh.h"
+#include <math.h>
+
+//centers at 2^-i leave a SAH split nothing better than peeling off the largest box, one level per primitive
+static const uint32_t s_DegenerateCount = 140;
+
+static uint32_t GetBvhDepth(const std::vector<BvhNode>& nodes, uint32_t node) {
+	if (nodes[node].count > 0)
+		return 0;
+	uint32_t left = GetBvhDepth(nodes, nodes[node].leftOrFirst);
+	uint32_t right = GetBvhDepth(nodes, nodes[node].leftOrFirst + 1);
+	return 1 + (left > right ? left : right);
+}
+
+TEST(DegenerateBvhFitsTheTraversalStack) {
+	std::vector<Aabb> bounds(s_DegenerateCount);
+	for (uint32_t i = 0; i < s_DegenerateCount; ++i) {
+		float center = ldexpf(1.0f, -(int)i);
+		bounds[i].Grow(glm::vec3(center * 0.9f, -1.0f, -1.0f));
+		bounds[i].Grow(glm::vec3(center * 1.1f, 1.0f, 1.0f));
+	}
+	std::vector<BvhNode> nodes;
+	std::vector<uint32_t> order;
+	BuildBvh(bounds, nodes, order);
+	//a walk holds at most one entry per level below the root, plus the two children it just pushed
+	CHECK(GetBvhDepth(nodes, 0) + 1 <= CPU_BVH_STACK_SIZE);
+	std::vector<uint32_t> seen(s_DegenerateCount, 0);
+	for (const BvhNode& node : nodes) {
+		for (uint32_t i = node.leftOrFirst; node.count > 0 && i < node.leftOrFirst + node.count; ++i)
+			++seen[order[i]];
+	}
+	for (uint32_t i = 0; i < s_DegenerateCount; ++i)
+		CHECK(seen[i] == 1);
+}
+
+TEST(DegenerateBvhTracesLikeBruteForce) {
+	//walls at x = 2^-i, rays coming from -x reach the deepest leaf first
+	std::vector<glm::vec3> vertices;
+	for (uint32_t i = 0; i < s_DegenerateCount; ++i) {
+		float x = ldexpf(1.0f, -(int)i);
+		vertices.push_back(glm::vec3(x, -1.0f, -1.0f));
+		vertices.push_back(glm::vec3(x, 2.0f, -1.0f));
+		vertices.push_back(glm::vec3(x, -1.0f, 2.0f));
+	}
+	CpuScene scene;
+	uint32_t geometry = scene.AddTriangles(vertices.data(), (uint32_t)vertices.size());
+	scene.AddInstance(geometry, glm::mat4(1.0f));
+	scene.Build();
+
+	const float origins[] = { -1.0f, 0.0f, 0.5f, 2.0f };
+	for (float originX : origins) {
+		for (float direction : { 1.0f, -1.0f }) {
+			CpuRay ray = { glm::vec3(originX, 0.25f, 0.25f), 0.0f, glm::vec3(direction, 0.0f, 0.0f), 100.0f };
+			float expected = ray.tMax;
+			for (uint32_t i = 0; i < s_DegenerateCount; ++i) {
+				float t = (ldexpf(1.0f, -(int)i) - originX) * direction;
+				if (t >= ray.tMin && t < expected)
+					expected = t;
+			}
+			CpuHit hit;
+			bool found = scene.Intersect(ray, CPU_TRACE_CLOSEST_HIT, hit);
+			CHECK(found == (expected < ray.tMax));
+			CHECK(fabsf(hit.t - expected) <= 1e-5f);
+			CpuHit anyHit;
+			CHECK(scene.Intersect(ray, CPU_TRACE_ANY_HIT, anyHit) == found);
+		}
+	}
+
+	CpuClosestPoint closest;
+	CHECK(scene.FindClosestPoint(glm::vec3(-1.0f, 0.25f, 0.25f), 100.0f, closest));
+	CHECK(fabsf(closest.distance - 1.0f) <= 1e-5f);
+	std::vector<CpuOverlap> overlaps;
+	CpuOverlapVolume volume = { CpuOverlapVolume::BOX, glm::vec3(0.0f, 0.25f, 0.25f), glm::vec3(2.0f, 0.5f, 0.5f) };
+	scene.Overlap(volume, overlaps);
+	CHECK(overlaps.size() == s_DegenerateCount);
+}
+
+TEST(SpheresOverlapByTheirSurface) {
+	const glm::vec4 sphere(0.0f, 0.0f, 0.0f, 1.0f);
+	CpuScene scene;
+	uint32_t geometry = scene.AddSpheres(&sphere, 1);
+	scene.AddInstance(geometry, glm::mat4(1.0f));
+	//moved and uniformly scaled by 2, the sphere stays a sphere
+	glm::mat4 scaled(2.0f);
+	scaled[3] = glm::vec4(10.0f, 0.0f, 0.0f, 1.0f);
+	scene.AddInstance(geometry, scaled);
+	scene.Build();
+
+	struct Case {
+		CpuOverlapVolume volume;
+		uint32_t expected;
+	};
+	//corners of the bounding box lie 0.73 outside the surface
+	const Case cases[] = {
+		{ { CpuOverlapVolume::SPHERE, glm::vec3(0.95f), glm::vec3(0.1f) }, 0 },
+		{ { CpuOverlapVolume::BOX, glm::vec3(0.95f), glm::vec3(0.1f) }, 0 },
+		{ { CpuOverlapVolume::SPHERE, glm::vec3(0.6f), glm::vec3(0.1f) }, 1 },
+		{ { CpuOverlapVolume::BOX, glm::vec3(0.62f), glm::vec3(0.05f) }, 1 },
+		{ { CpuOverlapVolume::SPHERE, glm::vec3(11.9f, 1.9f, 0.0f), glm::vec3(0.1f) }, 0 },
+		{ { CpuOverlapVolume::SPHERE, glm::vec3(11.4f, 1.4f, 0.0f), glm::vec3(0.1f) }, 1 },
+	};
+	for (const Case& c : cases) {
+		std::vector<CpuOverlap> overlaps;
+		scene.Overlap(c.volume, overlaps);
+		CHECK(overlaps.size() == c.expected);
+	}
+}
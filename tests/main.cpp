@@ -0,0 +1,14 @@
+#include "test.h"
+
+int main() {
+	int failedTests = 0;
+	for (TestCase* test : TestCase::GetTests()) {
+		int failuresBefore = TestCase::GetFailures();
+		test->run();
+		bool passed = TestCase::GetFailures() == failuresBefore;
+		printf("%s %s\n", passed ? "[ OK ]" : "[FAIL]", test->name);
+		failedTests += passed ? 0 : 1;
+	}
+	printf("%d of %d tests failed\n", failedTests, (int)TestCase::GetTests().size());
+	return failedTests == 0 ? 0 : 1;
+}
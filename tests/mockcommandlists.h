@@ -0,0 +1,50 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+//stands in for an allocator/command list pair, the commands are whatever the test records
+struct MockCommandList {
+	uint32_t id = 0;
+	bool open = false;
+	uint32_t resets = 0;
+	std::vector<uint32_t> commands;
+	std::thread::id recordedOn;
+};
+
+//CommandListPool backend without a device, counts what the pool asks of it and flags calls D3D12 would reject
+class MockCommandLists {
+public:
+	typedef MockCommandList List;
+
+	MockCommandLists(){}
+	~MockCommandLists(){}
+
+	void Create(MockCommandList& cmd) {
+		cmd.id = m_Created++;
+		cmd.open = true;
+	}
+	//D3D12 only resets closed lists
+	void Reset(MockCommandList& cmd) {
+		if (cmd.open)
+			m_Misuses++;
+		cmd.open = true;
+		cmd.resets++;
+		cmd.commands.clear();
+		m_Resets++;
+	}
+	void Close(MockCommandList& cmd) {
+		if (!cmd.open)
+			m_Misuses++;
+		cmd.open = false;
+	}
+
+	uint32_t GetCreated() const { return m_Created; }
+	uint32_t GetResets() const { return m_Resets; }
+	uint32_t GetMisuses() const { return m_Misuses; }
+private:
+	std::atomic<uint32_t> m_Created{ 0 };
+	std::atomic<uint32_t> m_Resets{ 0 };
+	std::atomic<uint32_t> m_Misuses{ 0 };
+};
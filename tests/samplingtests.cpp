@@ -0,0 +1,165 @@
+#include "test.h"
+#include "adaptivesampler.h"
+#include "dirtyregion.h"
+#include "resolutioncontroller.h"
+#include <string.h>
+
+//the raygen writes tile errors as float bits
+static std::vector<uint32_t> TileErrors(uint32_t count, float error) {
+	uint32_t bits;
+	memcpy(&bits, &error, sizeof(bits));
+	return std::vector<uint32_t>(count, bits);
+}
+
+static uint32_t CountActive(const std::vector<uint32_t>& mask) {
+	uint32_t active = 0;
+	for (uint32_t tile : mask)
+		active += tile ? 1 : 0;
+	return active;
+}
+
+TEST(SamplerTracesMinimumSamplesBeforeTrustingErrors) {
+	AdaptiveSampler sampler;
+	sampler.Init(32, 16, 16, 0.1f, 100);
+	CHECK(sampler.GetTileCount() == 2);
+	std::vector<uint32_t> converged = TileErrors(2, 0.0f);
+	for (uint32_t i = 0; i < ADAPTIVE_MIN_SAMPLES; ++i) {
+		std::vector<uint32_t> mask = sampler.BeginFrame();
+		CHECK(CountActive(mask) == 2);
+		CHECK(sampler.GetSampleIndex() == i);
+		CHECK(sampler.NeedsReset() == (i == 0));
+		CHECK(!sampler.IsConverged());
+		sampler.ReadErrors(mask, sampler.GetEpoch(), converged.data());
+	}
+	CHECK(CountActive(sampler.BeginFrame()) == 0);
+	CHECK(sampler.IsConverged());
+	CHECK(sampler.GetAverageSamples() == ADAPTIVE_MIN_SAMPLES);
+}
+
+TEST(SamplerStopsAtTheSampleCap) {
+	AdaptiveSampler sampler;
+	sampler.Init(16, 16, 16, 0.1f, 12);
+	std::vector<uint32_t> noisy = TileErrors(1, 1.0f);
+	for (uint32_t i = 0; i < 12; ++i) {
+		std::vector<uint32_t> mask = sampler.BeginFrame();
+		CHECK(CountActive(mask) == 1);
+		sampler.ReadErrors(mask, sampler.GetEpoch(), noisy.data());
+	}
+	CHECK(CountActive(sampler.BeginFrame()) == 0);
+	CHECK(sampler.IsConverged());
+	CHECK(sampler.GetAverageSamples() == 12.0);
+
+	//a cap below the minimum is raised to it
+	sampler.Init(16, 16, 16, 0.1f, 2);
+	for (uint32_t i = 0; i < ADAPTIVE_MIN_SAMPLES; ++i)
+		CHECK(CountActive(sampler.BeginFrame()) == 1);
+	CHECK(CountActive(sampler.BeginFrame()) == 0);
+}
+
+TEST(SamplerIgnoresErrorsFromBeforeAReset) {
+	AdaptiveSampler sampler;
+	sampler.Init(32, 16, 16, 0.1f, 100);
+	//recorded before the reset, its errors come back after it
+	std::vector<uint32_t> lateMask = sampler.BeginFrame();
+	uint32_t lateEpoch = sampler.GetEpoch();
+	sampler.Reset();
+	CHECK(sampler.GetEpoch() != lateEpoch);
+	std::vector<uint32_t> converged = TileErrors(2, 0.0f);
+	for (uint32_t i = 0; i < ADAPTIVE_MIN_SAMPLES; ++i) {
+		std::vector<uint32_t> mask = sampler.BeginFrame();
+		CHECK(sampler.NeedsReset() == (i == 0));
+		sampler.ReadErrors(mask, sampler.GetEpoch(), converged.data());
+	}
+	std::vector<uint32_t> noisy = TileErrors(2, 1.0f);
+	sampler.ReadErrors(lateMask, lateEpoch, noisy.data());
+	CHECK(CountActive(sampler.BeginFrame()) == 0);
+	CHECK(sampler.IsConverged());
+}
+
+TEST(SamplerKeepsErrorsOfUntracedTiles) {
+	AdaptiveSampler sampler;
+	sampler.Init(32, 16, 16, 0.1f, 100);
+	std::vector<uint32_t> errors = TileErrors(2, 0.0f);
+	for (uint32_t i = 0; i < ADAPTIVE_MIN_SAMPLES; ++i) {
+		std::vector<uint32_t> mask = sampler.BeginFrame();
+		sampler.ReadErrors(mask, sampler.GetEpoch(), errors.data());
+	}
+	//the raygen leaves garbage in tiles it skipped, only traced tiles count
+	std::vector<uint32_t> mask = sampler.BeginFrame();
+	CHECK(CountActive(mask) == 0);
+	std::vector<uint32_t> noisy = TileErrors(2, 1.0f);
+	sampler.ReadErrors(mask, sampler.GetEpoch(), noisy.data());
+	CHECK(CountActive(sampler.BeginFrame()) == 0);
+}
+
+TEST(DisabledSamplerTracesEveryTileEveryFrame) {
+	AdaptiveSampler sampler;
+	sampler.Init(32, 16, 16, 0.0f, 100);
+	for (uint32_t i = 0; i < 3; ++i) {
+		CHECK(CountActive(sampler.BeginFrame()) == 2);
+		CHECK(sampler.NeedsReset());
+		CHECK(sampler.GetSampleIndex() == 0);
+	}
+	CHECK(!sampler.IsConverged());
+}
+
+TEST(DirtyRegionMarksTheTilesABoxCovers) {
+	DirtyRegion region;
+	region.Init(64, 64, 16);
+	CHECK(region.GetTileCount() == 16);
+	CHECK(region.IsEmpty());
+	//y flips like the raygen's viewport, top left is (-1, 1)
+	const glm::vec4 viewport(-1.0f, 1.0f, 1.0f, -1.0f);
+	//pixels 28.8 to 35.2 on both axes, a pixel of margin still stays inside tiles 1 and 2
+	region.AddWorldBounds(glm::vec3(-0.1f, -0.1f, -5.0f), glm::vec3(0.1f, 0.1f, 5.0f), viewport);
+	CHECK(region.GetDirtyTileCount() == 4);
+	const std::vector<uint32_t>& mask = region.GetTileMask();
+	CHECK(mask[5] && mask[6] && mask[9] && mask[10]);
+	//adding it again does not count the tiles twice
+	region.AddWorldBounds(glm::vec3(-0.1f, -0.1f, 0.0f), glm::vec3(0.1f, 0.1f, 0.0f), viewport);
+	CHECK(region.GetDirtyTileCount() == 4);
+	//a box off screen dirties nothing
+	region.AddWorldBounds(glm::vec3(5.0f, 5.0f, 0.0f), glm::vec3(6.0f, 6.0f, 0.0f), viewport);
+	CHECK(region.GetDirtyTileCount() == 4);
+	//one straddling the left edge is clamped to the first column
+	region.Clear();
+	CHECK(region.IsEmpty());
+	region.AddWorldBounds(glm::vec3(-3.0f, 0.9f, 0.0f), glm::vec3(-0.9f, 0.95f, 0.0f), viewport);
+	CHECK(region.GetDirtyTileCount() == 1);
+	CHECK(region.GetTileMask()[0] != 0);
+}
+
+TEST(ResolutionFollowsTheBudget) {
+	ResolutionController disabled;
+	disabled.Init(1920, 1080, 0.0f, 0.5f);
+	disabled.Update(100.0, 1920, 1080);
+	CHECK(disabled.GetWidth() == 1920 && disabled.GetHeight() == 1080);
+
+	ResolutionController controller;
+	controller.Init(1920, 1080, 4.0f, 0.5f);
+	CHECK(controller.GetWidth() == 1920 && controller.GetScale() == 1.0f);
+	//twice over budget, half the pixels
+	controller.Update(8.0, 1920, 1080);
+	CHECK(controller.GetScale() > 0.70f && controller.GetScale() < 0.71f);
+	CHECK(controller.GetWidth() % RESOLUTION_ALIGNMENT == 0 && controller.GetHeight() % RESOLUTION_ALIGNMENT == 0);
+	CHECK(controller.GetWidth() < 1920 && controller.GetHeight() < 1080);
+	//the same cost per pixel measured at the new size keeps it
+	uint32_t width = controller.GetWidth();
+	uint32_t height = controller.GetHeight();
+	float scale = controller.GetScale();
+	controller.Update(8.0 * width * height / (1920.0 * 1080.0), width, height);
+	CHECK(controller.GetScale() == scale);
+	//a slightly cheaper frame stays inside the hysteresis
+	controller.Update(7.8 * width * height / (1920.0 * 1080.0), width, height);
+	CHECK(controller.GetScale() == scale);
+	//far over budget is clamped to the minimum scale
+	for (uint32_t i = 0; i < 100; ++i)
+		controller.Update(100.0, controller.GetWidth(), controller.GetHeight());
+	CHECK(controller.GetScale() == 0.5f);
+	CHECK(controller.GetWidth() == 960 && controller.GetHeight() == 536);
+	//and cheap frames bring it back to full resolution
+	for (uint32_t i = 0; i < 200; ++i)
+		controller.Update(0.1, controller.GetWidth(), controller.GetHeight());
+	CHECK(controller.GetScale() == 1.0f);
+	CHECK(controller.GetWidth() == 1920 && controller.GetHeight() == 1080);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <stdio.h>
+#include <vector>
+
+//Minimal self registering tests, every TEST in the linked files runs once from main.cpp.
+//A failed CHECK reports its location and the test keeps going.
+struct TestCase {
+	const char* name;
+	void (*run)();
+	TestCase(const char* testName, void (*testRun)()) : name(testName), run(testRun) { GetTests().push_back(this); }
+	static std::vector<TestCase*>& GetTests() {
+		static std::vector<TestCase*> tests;
+		return tests;
+	}
+	static int& GetFailures() {
+		static int failures = 0;
+		return failures;
+	}
+};
+
+#define TEST(name) \
+	static void name(); \
+	static TestCase name##Case(#name, name); \
+	static void name()
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+			TestCase::GetFailures()++; \
+		} \
+	} while (0)
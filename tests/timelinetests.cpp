@@ -0,0 +1,144 @@
+#include "test.h"
+#include "timeline.h"
+#include "ringallocator.h"
+#include "commandlistpool.h"
+#include "mockcommandlists.h"
+#include <map>
+
+//deterministic stand in for how far a gpu gets between two cpu frames
+static uint32_t NextRandom(uint32_t& state) {
+	state = state * 1664525u + 1013904223u;
+	return state >> 8;
+}
+
+TEST(SimulatedPointsCompleteOnlyWhenSimulated) {
+	SimulatedTimeline timeline;
+	CHECK(timeline.GetNextValue() == 1);
+	uint64_t first = timeline.Signal();
+	uint64_t second = timeline.Signal();
+	CHECK(first == 1 && second == 2);
+	CHECK(timeline.GetLastSignaled() == 2);
+	CHECK(!timeline.IsComplete(first));
+	timeline.Simulate(first);
+	CHECK(timeline.IsComplete(first));
+	CHECK(!timeline.IsComplete(second));
+	//points that were never signaled can not complete
+	timeline.Simulate(100);
+	CHECK(timeline.GetCompletedValue() == 2);
+	CHECK(!timeline.IsComplete(3));
+}
+
+TEST(SimulatedWaitCompletesInSubmissionOrder) {
+	SimulatedTimeline timeline;
+	for (int i = 0; i < 4; ++i)
+		timeline.Signal();
+	timeline.Wait(3);
+	CHECK(timeline.IsComplete(1) && timeline.IsComplete(2) && timeline.IsComplete(3));
+	CHECK(!timeline.IsComplete(4));
+	//completed values never go back
+	timeline.Simulate(1);
+	CHECK(timeline.GetCompletedValue() == 3);
+}
+
+TEST(RingFreesWaitForTheirFrame) {
+	struct Range {
+		uint64_t fenceValue;
+		uint64_t offset;
+		uint64_t size;
+	};
+	const uint64_t framesInFlight = 3;
+	SimulatedTimeline timeline;
+	RingAllocator ring;
+	ring.Init(4096);
+	std::vector<Range> inFlight;
+	uint32_t random = 7;
+	uint32_t failedAllocations = 0;
+	for (uint32_t frame = 0; frame < 2000; ++frame) {
+		//frame pacing: the frame that last used this frame's context must be done before recording
+		uint64_t next = timeline.GetNextValue();
+		if (next > framesInFlight)
+			timeline.Wait(next - framesInFlight);
+		CHECK(timeline.GetLastSignaled() - timeline.GetCompletedValue() < framesInFlight);
+		ring.Reclaim(timeline.GetCompletedValue());
+		for (size_t i = 0; i < inFlight.size();) {
+			if (timeline.IsComplete(inFlight[i].fenceValue)) {
+				inFlight[i] = inFlight.back();
+				inFlight.pop_back();
+			} else {
+				i++;
+			}
+		}
+
+		uint32_t allocations = 1 + NextRandom(random) % 4;
+		for (uint32_t a = 0; a < allocations; ++a) {
+			uint64_t size = 16 + NextRandom(random) % 400;
+			uint64_t offset = ring.Allocate(size, 16);
+			if (offset == RingAllocator::INVALID_OFFSET) {
+				failedAllocations++;
+				continue;
+			}
+			CHECK(offset % 16 == 0 && offset + size <= ring.GetSize());
+			//nothing the gpu may still read is handed out again
+			for (const Range& range : inFlight)
+				CHECK(offset + size <= range.offset || range.offset + range.size <= offset);
+			inFlight.push_back({ next, offset, size });
+		}
+		uint64_t signaled = timeline.Signal();
+		CHECK(signaled == next);
+		ring.Retire(signaled);
+
+		//the gpu finishes between zero and two frames while the cpu records one
+		timeline.Simulate(timeline.GetCompletedValue() + NextRandom(random) % 3);
+	}
+	//the sizes are small enough that the pacing alone keeps the ring from running out
+	CHECK(failedAllocations == 0);
+	timeline.Wait(timeline.GetLastSignaled());
+	ring.Reclaim(timeline.GetCompletedValue());
+	CHECK(ring.GetUsed() == 0);
+}
+
+//the upload ring gives these to a dedicated buffer, the ring itself must come out of them unchanged
+TEST(RingRejectsRangesLargerThanItself) {
+	RingAllocator ring;
+	ring.Init(4096);
+	uint64_t first = ring.Allocate(1000, 16);
+	CHECK(first == 0);
+	//a million spheres' boxes against a ring of 4096, empty and partly used
+	CHECK(ring.Allocate(24000000, 16) == RingAllocator::INVALID_OFFSET);
+	CHECK(ring.Allocate(4097, 1) == RingAllocator::INVALID_OFFSET);
+	CHECK(ring.GetUsed() == 1000);
+	ring.Retire(1);
+	ring.Reclaim(1);
+	CHECK(ring.GetUsed() == 0);
+	CHECK(ring.Allocate(4097, 1) == RingAllocator::INVALID_OFFSET);
+	CHECK(ring.GetUsed() == 0);
+	//the whole ring still fits once it is free
+	CHECK(ring.Allocate(4096, 16) == 0);
+	CHECK(ring.GetUsed() == 4096);
+}
+
+TEST(PooledListsWaitForTheirFrame) {
+	ThreadPool pool;
+	pool.Init(3);
+	CommandListPool<MockCommandLists> lists;
+	SimulatedTimeline timeline;
+	std::map<MockCommandList*, uint64_t> lastSubmitted;
+	uint32_t random = 11;
+	for (uint32_t frame = 0; frame < 300; ++frame) {
+		lists.Reclaim(timeline.GetCompletedValue());
+		uint32_t jobCount = 1 + NextRandom(random) % 6;
+		std::vector<CommandListPool<MockCommandLists>::RecordJob> jobs(jobCount, [](MockCommandList& cmd) { cmd.commands.push_back(0); });
+		std::vector<MockCommandList*> recorded = lists.Record(pool, jobs);
+		for (MockCommandList* cmd : recorded) {
+			auto last = lastSubmitted.find(cmd);
+			CHECK(last == lastSubmitted.end() || timeline.IsComplete(last->second));
+			CHECK(cmd->commands.size() == 1);
+		}
+		uint64_t signaled = timeline.Signal();
+		lists.Retire(recorded, signaled);
+		for (MockCommandList* cmd : recorded)
+			lastSubmitted[cmd] = signaled;
+		timeline.Simulate(timeline.GetCompletedValue() + NextRandom(random) % 3);
+	}
+	CHECK(lists.GetBackend().GetMisuses() == 0);
+}